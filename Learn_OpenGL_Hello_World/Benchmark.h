@@ -0,0 +1,196 @@
+#pragma once
+
+// Benchmark sample collection and JSON report for camera path replays
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// Measures whole-frame GPU time with GL_TIME_ELAPSED queries. Results are read once they are available,
+// usually a couple of frames later, so the CPU never waits on the GPU; a query not ready yet stays pending and
+// is read on a later frame. Only if MAX_QUERIES frames are in flight at once is a frame left untimed, counted
+// in UntimedFrames.
+class GpuFrameTimer
+{
+public:
+	static const unsigned int MAX_QUERIES = 8;
+
+	unsigned int UntimedFrames = 0;
+
+	void Init()
+	{
+		glGenQueries(MAX_QUERIES, queries);
+		oldest = 0;
+		pending = 0;
+		timing = false;
+	}
+
+	void Release()
+	{
+		glDeleteQueries(MAX_QUERIES, queries);
+	}
+
+	void BeginFrame()
+	{
+		timing = pending < MAX_QUERIES;
+		if (!timing)
+		{
+			UntimedFrames++;
+			return;
+		}
+		glBeginQuery(GL_TIME_ELAPSED, queries[(oldest + pending) % MAX_QUERIES]);
+	}
+
+	// Ends this frame's query, which stays pending until ReadResult() returns it
+	void EndFrame()
+	{
+		if (!timing)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		pending++;
+		timing = false;
+	}
+
+	// Returns the oldest pending frame's time if it is available (or after waiting for it, with wait). Frames
+	// finish in order, so call until it returns false.
+	bool ReadResult(double& gpuMilliseconds, bool wait = false)
+	{
+		if (pending == 0)
+			return false;
+		GLuint query = queries[oldest];
+		if (!wait)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return false;
+		}
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		oldest = (oldest + 1) % MAX_QUERIES;
+		pending--;
+		gpuMilliseconds = elapsed / 1.0e6;
+		return true;
+	}
+
+private:
+	GLuint queries[MAX_QUERIES];
+	unsigned int oldest = 0; // ring index of the oldest pending query
+	unsigned int pending = 0;
+	bool timing = false; // this frame's query is running
+};
+
+// Summary statistics of a list of samples
+struct SampleSummary {
+	double Min = 0.0, Avg = 0.0, P50 = 0.0, P95 = 0.0, P99 = 0.0, Max = 0.0;
+
+	static SampleSummary From(std::vector<double> samples)
+	{
+		SampleSummary summary;
+		if (samples.empty())
+			return summary;
+		std::sort(samples.begin(), samples.end());
+		double total = 0.0;
+		for (unsigned int i = 0; i < samples.size(); i++)
+			total += samples[i];
+		summary.Min = samples.front();
+		summary.Max = samples.back();
+		summary.Avg = total / samples.size();
+		summary.P50 = Percentile(samples, 0.50);
+		summary.P95 = Percentile(samples, 0.95);
+		summary.P99 = Percentile(samples, 0.99);
+		return summary;
+	}
+
+	// Nearest-rank percentile of already sorted samples
+	static double Percentile(const std::vector<double>& sorted, double fraction)
+	{
+		unsigned int rank = (unsigned int)(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[rank];
+	}
+
+	void WriteJson(std::ostream& out) const
+	{
+		out << "{ \"min\": " << Min << ", \"avg\": " << Avg << ", \"p50\": " << P50
+			<< ", \"p95\": " << P95 << ", \"p99\": " << P99 << ", \"max\": " << Max << " }";
+	}
+};
+
+// Collects per-frame measurements during a replay and writes the final report
+class BenchmarkRecorder
+{
+public:
+	void AddFrame(double frameMilliseconds, unsigned int drawCalls, unsigned int triangles)
+	{
+		frameTimes.push_back(frameMilliseconds);
+		this->drawCalls.push_back(drawCalls);
+		this->triangles.push_back(triangles);
+	}
+
+	void AddGpuTime(double gpuMilliseconds)
+	{
+		gpuTimes.push_back(gpuMilliseconds);
+	}
+
+	// Frames the GPU timer couldn't time (GpuFrameTimer::UntimedFrames), reported next to gpu_time_ms
+	void SetUntimedGpuFrames(unsigned int count)
+	{
+		untimedGpuFrames = count;
+	}
+
+	// Any other named measurement (GPU pass times, shader invocations), summarised under "series"
+	void AddSample(const std::string& name, double value)
+	{
+		series[name].push_back(value);
+	}
+
+	bool WriteReport(const std::string& path, const std::string& replayPath) const
+	{
+		std::ofstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "ERROR::BENCHMARK::FILE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+		file << "{\n";
+		file << "  \"camera_path\": \"" << replayPath << "\",\n";
+		file << "  \"frames\": " << frameTimes.size() << ",\n";
+		file << "  \"frame_time_ms\": ";
+		SampleSummary::From(frameTimes).WriteJson(file);
+		file << ",\n  \"gpu_time_ms\": ";
+		SampleSummary::From(gpuTimes).WriteJson(file);
+		file << ",\n  \"gpu_frames_timed\": " << gpuTimes.size();
+		file << ",\n  \"gpu_frames_untimed\": " << untimedGpuFrames;
+		file << ",\n  \"draw_calls\": ";
+		SampleSummary::From(drawCalls).WriteJson(file);
+		file << ",\n  \"triangles\": ";
+		SampleSummary::From(triangles).WriteJson(file);
+		file << ",\n  \"series\": {";
+		for (std::map<std::string, std::vector<double> >::const_iterator i = series.begin(); i != series.end(); ++i)
+		{
+			file << (i != series.begin() ? ",\n" : "\n") << "    \"" << i->first << "\": ";
+			SampleSummary::From(i->second).WriteJson(file);
+		}
+		file << (series.empty() ? "}" : "\n  }");
+		file << "\n}\n";
+		std::cout << "Benchmark report written to " << path << std::endl;
+		return true;
+	}
+
+private:
+	std::vector<double> frameTimes;
+	std::vector<double> gpuTimes;
+	unsigned int untimedGpuFrames = 0;
+	std::vector<double> drawCalls;
+	std::vector<double> triangles;
+	std::map<std::string, std::vector<double> > series;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+// Recorded camera path (pose and scene toggles per frame) used for deterministic benchmark replays
+
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+struct CameraPathFrame {
+	glm::vec3 Position;
+	float Yaw;
+	float Pitch;
+	float Zoom;
+	bool FlashlightOn;
+	bool MovingLight;
+	bool OutlineOn;
+};
+
+class CameraPath
+{
+public:
+	std::vector<CameraPathFrame> Frames;
+
+	void Record(const CameraPathFrame& frame)
+	{
+		Frames.push_back(frame);
+	}
+
+	// Frame to play back at the given index (the path loops when more frames are requested than were recorded)
+	const CameraPathFrame& At(unsigned int index) const
+	{
+		return Frames[index % Frames.size()];
+	}
+
+	bool Empty() const { return Frames.empty(); }
+
+	// Text format, one frame per line: x y z yaw pitch zoom flashlight movingLight outline
+	bool Save(const std::string& path) const
+	{
+		std::ofstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "ERROR::CAMERA_PATH::FILE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+		file.precision(9);
+		for (unsigned int i = 0; i < Frames.size(); i++)
+		{
+			const CameraPathFrame& f = Frames[i];
+			file << f.Position.x << " " << f.Position.y << " " << f.Position.z << " "
+				<< f.Yaw << " " << f.Pitch << " " << f.Zoom << " "
+				<< f.FlashlightOn << " " << f.MovingLight << " " << f.OutlineOn << "\n";
+		}
+		return true;
+	}
+
+	bool Load(const std::string& path)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return false;
+		}
+		Frames.clear();
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream(line);
+			CameraPathFrame f;
+			if (stream >> f.Position.x >> f.Position.y >> f.Position.z >> f.Yaw >> f.Pitch >> f.Zoom
+				>> f.FlashlightOn >> f.MovingLight >> f.OutlineOn)
+				Frames.push_back(f);
+		}
+		return !Frames.empty();
+	}
+};
+
+#endif
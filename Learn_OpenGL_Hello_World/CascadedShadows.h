@@ -0,0 +1,269 @@
+#pragma once
+
+// Cascaded shadow map of a directional light. The camera frustum up to ShadowDistance is split into
+// NumCascades depth slices, spaced between uniform and logarithmic by SplitLambda, and each slice's bounding
+// sphere is covered by one layer of a depth texture array rendered from the light. The sphere's size doesn't
+// change as the camera turns and its centre is snapped to whole texels in light space, so shadow edges don't
+// shimmer while the camera moves.
+//
+// Layers are kept across frames. Static casters are rendered into a second array, only when a cascade's
+// placement changes (the light turned, or the camera left the cascade's padding). A cascade is re-rendered by
+// copying its static layer and drawing the dynamic casters on top, only on frames where its static layer
+// changed or a dynamic caster inside it moved (MarkMoved()).
+
+#ifndef CASCADED_SHADOWS_H
+#define CASCADED_SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <Frustum.h>
+#include <FrameContext.h>
+#include <FrameGraph.h>
+#include <Shader.h>
+
+class CascadedShadowMap
+{
+public:
+	static const unsigned int MAX_CASCADES = 4; // size of the shaders' cascade arrays
+	// Receivers are offset along their normal by this many texels of their cascade before the depth compare
+	static constexpr float NORMAL_OFFSET_TEXELS = 1.5f;
+
+	// Settings, read by Init() and Update()
+	unsigned int NumCascades = 3;
+	float SplitLambda = 0.75f; // 0 = uniform split distances, 1 = logarithmic
+	float ShadowDistance = 40.0f; // camera depth covered by the last cascade
+	int Resolution = 2048;
+	// Cascades cover their slice's sphere enlarged by this fraction and follow the camera in steps of up to
+	// that much, so the cached layers stay valid while the camera moves within the margin
+	float CachePadding = 0.15f;
+	// false re-renders every caster into every cascade each frame, without the static layers (for comparison)
+	bool Caching = true;
+	// Set each frame by the caller: a light casts shadows. Apply() turns the shadows off in the shaders otherwise.
+	bool Enabled = false;
+
+	struct Cascade {
+		glm::mat4 View = glm::mat4(1.0f); // world to light space
+		glm::mat4 Projection = glm::mat4(1.0f); // light space to clip space
+		glm::mat4 ShadowMatrix = glm::mat4(1.0f); // world to shadow map coordinates and depth, all in [0, 1]
+		Frustum Volume; // casters outside it can't shadow the cascade
+		float SplitFar = 0.0f; // camera depth where the slice ends
+		float TexelSize = 0.0f; // world size of one shadow map texel
+		bool StaticDirty = true; // static layer re-rendered this frame
+		bool Dirty = true; // sampled layer re-rendered this frame
+		// Draws queued for this frame's re-render, counted by the caller
+		unsigned int StaticDraws = 0;
+		unsigned int DynamicDraws = 0;
+		// Snapped placement the layers were rendered with (light space)
+		glm::vec3 Center = glm::vec3(0.0f);
+		float HalfSize = 0.0f;
+		float Top = 0.0f; // z of the near plane, at or above the highest caster
+		bool Valid = false;
+	};
+
+	void Init()
+	{
+		NumCascades = glm::clamp(NumCascades, 1u, MAX_CASCADES);
+		shadowTexture = createArray(true);
+		staticTexture = createArray(false);
+		glGenFramebuffers(1, &copyFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, copyFramebuffer);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		for (unsigned int i = 0; i < MAX_CASCADES; i++)
+			cascades[i] = Cascade();
+		initialized = true;
+	}
+
+	void Release()
+	{
+		if (!initialized)
+			return;
+		glDeleteTextures(1, &shadowTexture);
+		glDeleteTextures(1, &staticTexture);
+		glDeleteFramebuffers(1, &copyFramebuffer);
+		shadowTexture = staticTexture = copyFramebuffer = 0;
+		initialized = false;
+	}
+
+	// Re-allocates the arrays at another size (the quality governor's shadow knob); every cascade is re-rendered
+	void SetResolution(int resolution)
+	{
+		if (resolution == Resolution)
+			return;
+		Resolution = resolution;
+		if (!initialized)
+			return;
+		glDeleteTextures(1, &shadowTexture);
+		glDeleteTextures(1, &staticTexture);
+		shadowTexture = createArray(true);
+		staticTexture = createArray(false);
+		for (unsigned int i = 0; i < MAX_CASCADES; i++)
+			cascades[i].Valid = false;
+	}
+
+	bool Initialized() const { return initialized; }
+	Cascade& GetCascade(unsigned int index) { return cascades[index]; }
+	const Cascade& GetCascade(unsigned int index) const { return cascades[index]; }
+	// Depth array sampled by the lit shaders, and the static casters' cached layers
+	GLuint Texture() const { return shadowTexture; }
+	GLuint StaticTexture() const { return staticTexture; }
+	// One layer of either array, for importing into the frame graph
+	FrameGraphTextureDesc LayerDesc() const { return { Resolution, Resolution, GL_DEPTH_COMPONENT24 }; }
+
+	// Fits the cascades to this frame's camera. casterBounds encloses every shadow caster: each cascade's depth
+	// range reaches up to it, so casters between the light and the slice are drawn. Cascades whose placement
+	// changed are marked StaticDirty and Dirty, the others start clean until MarkMoved().
+	void Update(const FrameContext& frame, const glm::vec3& lightDirection, const AABB& casterBounds)
+	{
+		glm::vec3 newDirection = glm::normalize(lightDirection);
+		bool lightChanged = newDirection != direction;
+		direction = newDirection;
+		// Light space only depends on the direction; up is any axis not parallel to it
+		glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+		// Highest caster above the light space xy plane (the light looks down -z)
+		float casterTop = -FLT_MAX;
+		if (!casterBounds.IsEmpty())
+		{
+			for (int corner = 0; corner < 8; corner++)
+			{
+				glm::vec3 point((corner & 1) ? casterBounds.Max.x : casterBounds.Min.x, (corner & 2) ? casterBounds.Max.y : casterBounds.Min.y,
+					(corner & 4) ? casterBounds.Max.z : casterBounds.Min.z);
+				casterTop = std::max(casterTop, (lightView * glm::vec4(point, 1.0f)).z);
+			}
+		}
+
+		// Camera near plane and field of view from the (symmetric perspective) projection
+		const glm::mat4& projection = frame.Projection;
+		float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+		float zFar = std::max(ShadowDistance, zNear * 2.0f);
+		float tanX = 1.0f / projection[0][0], tanY = 1.0f / projection[1][1];
+		float diagonalSq = tanX * tanX + tanY * tanY; // squared distance of a slice corner from the view axis per unit depth
+		glm::vec3 forward = -glm::vec3(frame.InverseView[2]);
+
+		float sliceNear = zNear;
+		for (unsigned int i = 0; i < NumCascades; i++)
+		{
+			Cascade& cascade = cascades[i];
+			float t = (i + 1) / (float)NumCascades;
+			float logSplit = zNear * std::pow(zFar / zNear, t);
+			float uniformSplit = zNear + (zFar - zNear) * t;
+			float sliceFar = SplitLambda * logSplit + (1.0f - SplitLambda) * uniformSplit;
+
+			// Smallest sphere through the slice's corners has its centre on the view axis, clamped to the far plane
+			float centerDepth = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + diagonalSq), sliceFar);
+			float radius = std::sqrt(std::max((sliceFar - centerDepth) * (sliceFar - centerDepth) + sliceFar * sliceFar * diagonalSq,
+				(centerDepth - sliceNear) * (centerDepth - sliceNear) + sliceNear * sliceNear * diagonalSq));
+			float halfSize = radius * (1.0f + CachePadding);
+			float texelSize = 2.0f * halfSize / Resolution;
+			// Moves in whole texels, and only once the sphere would leave the padding
+			float step = std::max(texelSize, std::floor(radius * CachePadding / texelSize) * texelSize);
+			glm::vec3 center = glm::vec3(lightView * glm::vec4(frame.CameraPosition + forward * centerDepth, 1.0f));
+			center = glm::floor(center / step + 0.5f) * step;
+
+			// Near plane at the highest caster, in steps, kept while it still covers the casters without being
+			// more than two steps too high so casters moving up and down don't re-fit the cascade every frame
+			float top = std::ceil(std::max(center.z + halfSize, casterTop) / step) * step;
+			bool samePlacement = cascade.Valid && !lightChanged && center == cascade.Center && halfSize == cascade.HalfSize;
+			if (samePlacement && cascade.Top >= top && cascade.Top - top <= 2.0f * step)
+				top = cascade.Top;
+
+			cascade.SplitFar = sliceFar;
+			cascade.TexelSize = texelSize;
+			if (!samePlacement || top != cascade.Top || !Caching)
+			{
+				cascade.Center = center;
+				cascade.HalfSize = halfSize;
+				cascade.Top = top;
+				cascade.View = lightView;
+				cascade.Projection = glm::ortho(center.x - halfSize, center.x + halfSize, center.y - halfSize, center.y + halfSize,
+					-top, -(center.z - halfSize));
+				glm::mat4 viewProjection = cascade.Projection * cascade.View;
+				cascade.Volume.Extract(viewProjection);
+				glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+				cascade.ShadowMatrix = bias * viewProjection;
+				cascade.Valid = true;
+				cascade.StaticDirty = cascade.Dirty = true;
+			}
+			else
+				cascade.StaticDirty = cascade.Dirty = false;
+			sliceNear = sliceFar;
+		}
+	}
+
+	// A dynamic caster with the given world bounds (covering where it was and where it is) moved this frame:
+	// the cascades it touches are re-rendered
+	void MarkMoved(const AABB& bounds)
+	{
+		for (unsigned int i = 0; i < NumCascades; i++)
+		{
+			if (!cascades[i].Dirty && cascades[i].Volume.IsBoxVisible(bounds))
+				cascades[i].Dirty = true;
+		}
+	}
+
+	// Copies the cached static depth of a cascade into the framebuffer bound for drawing (its sampled layer)
+	void CopyStaticLayer(unsigned int index) const
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, index);
+		glBlitFramebuffer(0, 0, Resolution, Resolution, 0, 0, Resolution, Resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, 0, 0, 0);
+	}
+
+	// Binds the shadow map and sets the lit shader's cascade uniforms. The sampler is always given its own
+	// unit, since a sampler2DArrayShadow left on unit 0 would clash with the diffuse map.
+	void Apply(Shader& shader, unsigned int unit) const
+	{
+		shader.setInt("shadowMap", unit);
+		shader.setInt("numShadowCascades", initialized && Enabled ? NumCascades : 0);
+		if (!initialized || !Enabled)
+			return;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture);
+		glActiveTexture(GL_TEXTURE0);
+		for (unsigned int i = 0; i < NumCascades; i++)
+		{
+			std::string index = "[" + std::to_string(i) + "]";
+			shader.setMatrix4("shadowMatrices" + index, cascades[i].ShadowMatrix);
+			shader.setFloat("shadowNormalOffsets" + index, cascades[i].TexelSize * NORMAL_OFFSET_TEXELS);
+		}
+	}
+
+private:
+	Cascade cascades[MAX_CASCADES];
+	glm::vec3 direction = glm::vec3(0.0f);
+	GLuint shadowTexture = 0;
+	GLuint staticTexture = 0;
+	GLuint copyFramebuffer = 0;
+	bool initialized = false;
+
+	// Depth array with a layer per cascade, filtered by hardware depth comparison when sampled
+	GLuint createArray(bool compare)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, Resolution, Resolution, NumCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (compare)
+		{
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return texture;
+	}
+};
+
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+
+// Entity-component system with archetype storage: entities with the same set of components share an
+// archetype, which keeps each component type in its own tightly packed array (structure of arrays).
+// Systems iterate those arrays directly with EntityWorld::Each().
+
+#ifndef ECS_H
+#define ECS_H
+
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <iostream>
+#include <type_traits>
+
+typedef unsigned int Entity;
+const Entity NULL_ENTITY = 0xFFFFFFFF;
+
+// Components are plain data copied with memcpy when entities move between archetypes
+const unsigned int MAX_COMPONENT_TYPES = 32;
+static_assert(MAX_COMPONENT_TYPES <= sizeof(unsigned int) * 8, "Archetype masks need a bit per component type");
+
+// Atomic, since job system workers can be the first to use a component type. Ids past the mask's bits would
+// alias other types, so running out is fatal.
+inline unsigned int nextComponentTypeId()
+{
+	static std::atomic<unsigned int> next(0);
+	unsigned int id = next++;
+	if (id >= MAX_COMPONENT_TYPES)
+	{
+		std::cout << "ERROR::ECS::TOO_MANY_COMPONENT_TYPES " << MAX_COMPONENT_TYPES << " supported" << std::endl;
+		std::abort();
+	}
+	return id;
+}
+
+// Small sequential id per component type, assigned on first use
+template<typename T>
+unsigned int componentTypeId()
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Components must be trivially copyable");
+	static unsigned int id = nextComponentTypeId();
+	return id;
+}
+
+// All entities with exactly the same component mask
+class Archetype
+{
+public:
+	unsigned int Mask;
+	std::vector<Entity> Entities;
+
+	unsigned int Size() const { return Entities.size(); }
+
+	template<typename T>
+	T* Column() { return (T*)columns[componentTypeId<T>()].Data.data(); }
+
+private:
+	friend class EntityWorld;
+
+	struct ComponentColumn {
+		size_t ElementSize = 0;
+		std::vector<unsigned char> Data;
+	};
+	ComponentColumn columns[MAX_COMPONENT_TYPES];
+
+	bool has(unsigned int type) const { return (Mask & (1u << type)) != 0; }
+
+	// Appends an uninitialised row
+	unsigned int addRow(Entity entity)
+	{
+		unsigned int row = Entities.size();
+		Entities.push_back(entity);
+		for (unsigned int type = 0; type < MAX_COMPONENT_TYPES; type++)
+			if (has(type))
+				columns[type].Data.resize(columns[type].Data.size() + columns[type].ElementSize);
+		return row;
+	}
+
+	// Removes a row by moving the last row into it. Returns the entity that was moved (or NULL_ENTITY).
+	Entity removeRow(unsigned int row)
+	{
+		unsigned int last = Entities.size() - 1;
+		Entity moved = NULL_ENTITY;
+		for (unsigned int type = 0; type < MAX_COMPONENT_TYPES; type++)
+		{
+			if (!has(type))
+				continue;
+			ComponentColumn& column = columns[type];
+			if (row != last)
+				memcpy(&column.Data[row * column.ElementSize], &column.Data[last * column.ElementSize], column.ElementSize);
+			column.Data.resize(last * column.ElementSize);
+		}
+		if (row != last)
+		{
+			Entities[row] = Entities[last];
+			moved = Entities[row];
+		}
+		Entities.pop_back();
+		return moved;
+	}
+
+	void* component(unsigned int type, unsigned int row) { return &columns[type].Data[row * columns[type].ElementSize]; }
+};
+
+class EntityWorld
+{
+public:
+	EntityWorld()
+	{
+		for (unsigned int i = 0; i < MAX_COMPONENT_TYPES; i++)
+			componentSizes[i] = 0;
+	}
+
+	~EntityWorld()
+	{
+		for (unsigned int i = 0; i < archetypes.size(); i++)
+			delete archetypes[i];
+	}
+
+	template<typename... Components>
+	Entity Create(const Components&... components)
+	{
+		unsigned int mask = maskOf<Components...>();
+		Entity entity = allocateEntity();
+		Archetype* archetype = findOrCreateArchetype(mask);
+		unsigned int row = archetype->addRow(entity);
+		records[entity].Owner = archetype;
+		records[entity].Row = row;
+		int expand[] = { 0, (setComponent(archetype, row, components), 0)... };
+		(void)expand;
+		return entity;
+	}
+
+	void Destroy(Entity entity)
+	{
+		EntityRecord& record = records[entity];
+		if (!record.Owner)
+			return;
+		Entity moved = record.Owner->removeRow(record.Row);
+		if (moved != NULL_ENTITY)
+			records[moved].Row = record.Row;
+		record.Owner = NULL;
+		freeEntities.push_back(entity);
+	}
+
+	template<typename T>
+	bool Has(Entity entity) const
+	{
+		const EntityRecord& record = records[entity];
+		return record.Owner && record.Owner->has(componentTypeId<T>());
+	}
+
+	template<typename T>
+	T& Get(Entity entity)
+	{
+		const EntityRecord& record = records[entity];
+		return *(T*)record.Owner->component(componentTypeId<T>(), record.Row);
+	}
+
+	// Adds (or overwrites) a component, moving the entity to the archetype with the new mask
+	template<typename T>
+	void Add(Entity entity, const T& component)
+	{
+		registerComponent<T>();
+		unsigned int type = componentTypeId<T>();
+		if (!Has<T>(entity))
+			moveEntity(entity, records[entity].Owner->Mask | (1u << type));
+		Get<T>(entity) = component;
+	}
+
+	template<typename T>
+	void Remove(Entity entity)
+	{
+		if (Has<T>(entity))
+			moveEntity(entity, records[entity].Owner->Mask & ~(1u << componentTypeId<T>()));
+	}
+
+	// Calls function(count, Components*...) for every archetype with at least these components,
+	// with pointers to the start of each component array
+	template<typename... Components, typename Function>
+	void Each(Function function)
+	{
+		unsigned int mask = maskOf<Components...>();
+		for (unsigned int i = 0; i < archetypes.size(); i++)
+		{
+			Archetype* archetype = archetypes[i];
+			if ((archetype->Mask & mask) == mask && archetype->Size() > 0)
+				function(archetype->Size(), archetype->Column<Components>()...);
+		}
+	}
+
+	// Number of live entities with at least these components
+	template<typename... Components>
+	unsigned int Count()
+	{
+		unsigned int count = 0;
+		Each<Components...>([&](unsigned int n, Components*...) { count += n; });
+		return count;
+	}
+
+private:
+	struct EntityRecord {
+		Archetype* Owner = NULL;
+		unsigned int Row = 0;
+	};
+
+	std::vector<Archetype*> archetypes;
+	std::vector<EntityRecord> records;
+	std::vector<Entity> freeEntities;
+	size_t componentSizes[MAX_COMPONENT_TYPES];
+
+	template<typename T>
+	void registerComponent()
+	{
+		componentSizes[componentTypeId<T>()] = sizeof(T);
+	}
+
+	template<typename... Components>
+	unsigned int maskOf()
+	{
+		unsigned int mask = 0;
+		int expand[] = { 0, (registerComponent<Components>(), mask |= 1u << componentTypeId<Components>(), 0)... };
+		(void)expand;
+		return mask;
+	}
+
+	template<typename T>
+	void setComponent(Archetype* archetype, unsigned int row, const T& component)
+	{
+		memcpy(archetype->component(componentTypeId<T>(), row), &component, sizeof(T));
+	}
+
+	Entity allocateEntity()
+	{
+		if (!freeEntities.empty())
+		{
+			Entity entity = freeEntities.back();
+			freeEntities.pop_back();
+			return entity;
+		}
+		records.push_back(EntityRecord());
+		return records.size() - 1;
+	}
+
+	Archetype* findOrCreateArchetype(unsigned int mask)
+	{
+		for (unsigned int i = 0; i < archetypes.size(); i++)
+			if (archetypes[i]->Mask == mask)
+				return archetypes[i];
+		Archetype* archetype = new Archetype();
+		archetype->Mask = mask;
+		for (unsigned int type = 0; type < MAX_COMPONENT_TYPES; type++)
+			if (mask & (1u << type))
+				archetype->columns[type].ElementSize = componentSizes[type];
+		archetypes.push_back(archetype);
+		return archetype;
+	}
+
+	// Moves an entity to the archetype of the new mask, keeping the components both have
+	void moveEntity(Entity entity, unsigned int newMask)
+	{
+		EntityRecord& record = records[entity];
+		Archetype* from = record.Owner;
+		Archetype* to = findOrCreateArchetype(newMask);
+		unsigned int row = to->addRow(entity);
+		for (unsigned int type = 0; type < MAX_COMPONENT_TYPES; type++)
+			if (from->has(type) && to->has(type))
+				memcpy(to->component(type, row), from->component(type, record.Row), componentSizes[type]);
+		Entity moved = from->removeRow(record.Row);
+		if (moved != NULL_ENTITY)
+			records[moved].Row = record.Row;
+		record.Owner = to;
+		record.Row = row;
+	}
+};
+
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+
+// Fixed-rate simulation clock with interpolation between the last two simulated states
+
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <glm/glm.hpp>
+#include <camera.h>
+
+// Everything the renderer needs from the simulation, captured after each tick so frames can interpolate
+struct SimulationState {
+	glm::vec3 CameraPosition = glm::vec3(0.0f);
+	float Yaw = YAW;
+	float Pitch = PITCH;
+	float Zoom = ZOOM;
+	// Simulation time (seconds), drives the lamp and cube animations
+	double Time = 0.0;
+
+	static SimulationState Capture(const Camera& camera, double time)
+	{
+		SimulationState state;
+		state.CameraPosition = camera.Position;
+		state.Yaw = camera.Yaw;
+		state.Pitch = camera.Pitch;
+		state.Zoom = camera.Zoom;
+		state.Time = time;
+		return state;
+	}
+
+	// Blend between two states, alpha = 0 gives a, alpha = 1 gives b
+	static SimulationState Lerp(const SimulationState& a, const SimulationState& b, float alpha)
+	{
+		SimulationState state;
+		state.CameraPosition = glm::mix(a.CameraPosition, b.CameraPosition, alpha);
+		state.Yaw = glm::mix(a.Yaw, b.Yaw, alpha);
+		state.Pitch = glm::mix(a.Pitch, b.Pitch, alpha);
+		state.Zoom = glm::mix(a.Zoom, b.Zoom, alpha);
+		state.Time = a.Time + (b.Time - a.Time) * alpha;
+		return state;
+	}
+};
+
+// Accumulates real frame time and hands it out in fixed-size simulation ticks
+class FixedTimestep
+{
+public:
+	// tickRate: simulation ticks per second
+	// maxTicksPerFrame: limits catch-up work after a long frame so a slow frame can't cause a spiral of ever slower frames
+	FixedTimestep(double tickRate = 120.0, unsigned int maxTicksPerFrame = 8) : maxTicksPerFrame(maxTicksPerFrame)
+	{
+		SetTickRate(tickRate);
+	}
+
+	// Rates <= 0 are ignored
+	void SetTickRate(double tickRate)
+	{
+		if (tickRate > 0.0)
+			stepSize = 1.0 / tickRate;
+	}
+	double StepSize() const { return stepSize; }
+
+	// Simulation time of the most recent tick
+	double Time() const { return time; }
+	void Reset(double startTime) { time = startTime; accumulator = 0.0; ticksThisFrame = 0; }
+
+	// Add the real time taken by the last frame. Returns the time skipped instead of simulated.
+	double Advance(double frameTime)
+	{
+		accumulator += frameTime;
+		ticksThisFrame = 0;
+		// Skip time we can't catch up on (e.g. after a breakpoint or window drag). The simulation clock still jumps
+		// over it, so it stays in step with the real-time stamps of queued input.
+		double maxAccumulated = stepSize * maxTicksPerFrame;
+		double skipped = 0.0;
+		if (accumulator > maxAccumulated)
+		{
+			skipped = accumulator - maxAccumulated;
+			accumulator = maxAccumulated;
+			time += skipped;
+		}
+		return skipped;
+	}
+
+	// Returns true while another tick should be simulated this frame, and advances simulation time
+	bool Step()
+	{
+		if (accumulator < stepSize || ticksThisFrame >= maxTicksPerFrame)
+			return false;
+		accumulator -= stepSize;
+		time += stepSize;
+		ticksThisFrame++;
+		return true;
+	}
+
+	// Fraction of a tick left over in the accumulator, used to interpolate between the previous and current state
+	float Alpha() const { return (float)(accumulator / stepSize); }
+
+private:
+	double stepSize = 1.0 / 120.0;
+	double accumulator = 0.0;
+	double time = 0.0;
+	unsigned int maxTicksPerFrame;
+	unsigned int ticksThisFrame = 0;
+};
+
+#endif
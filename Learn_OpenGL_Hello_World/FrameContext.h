@@ -0,0 +1,79 @@
+#pragma once
+
+// Per-frame snapshot of the camera constants and frame time shared by every render setup function
+
+#ifndef FRAME_CONTEXT_H
+#define FRAME_CONTEXT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <camera.h>
+#include <Frustum.h>
+
+struct FrameContext {
+	// Camera matrices
+	glm::mat4 View = glm::mat4(1.0f);
+	glm::mat4 Projection = glm::mat4(1.0f);
+	glm::mat4 ViewProjection = glm::mat4(1.0f);
+	glm::mat4 InverseView = glm::mat4(1.0f);
+	glm::mat4 InverseProjection = glm::mat4(1.0f);
+	glm::mat4 InverseViewProjection = glm::mat4(1.0f);
+	// View frustum planes in world space
+	Frustum ViewFrustum;
+	// Camera state
+	glm::vec3 CameraPosition = glm::vec3(0.0f);
+	glm::vec3 CameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+	float Zoom = 45.0f;
+	// Viewport
+	unsigned int ViewportWidth = 1;
+	unsigned int ViewportHeight = 1;
+	float AspectRatio = 1.0f;
+	// Time (seconds) sampled once for the whole frame, and the time taken by the previous frame
+	float Time = 0.0f;
+	float DeltaTime = 0.0f;
+	unsigned int FrameIndex = 0;
+
+	// Snapshots the camera and frame time. View/projection dependent data is only rebuilt when the camera changed.
+	void Update(Camera& camera, float time, float deltaTime, unsigned int viewportWidth, unsigned int viewportHeight)
+	{
+		Time = time;
+		DeltaTime = deltaTime;
+		FrameIndex++;
+		ViewportWidth = viewportWidth;
+		ViewportHeight = viewportHeight;
+		AspectRatio = (float)viewportWidth / (float)viewportHeight;
+
+		bool viewChanged = !valid || camera.ViewVersion != viewVersion;
+		if (viewChanged)
+		{
+			View = camera.GetViewMatrix();
+			InverseView = glm::inverse(View);
+			viewVersion = camera.ViewVersion;
+		}
+		Projection = camera.GetProjectionMatrix(AspectRatio);
+		bool projChanged = !valid || camera.ProjectionVersion != projVersion;
+		if (projChanged)
+		{
+			InverseProjection = glm::inverse(Projection);
+			projVersion = camera.ProjectionVersion;
+		}
+		if (viewChanged || projChanged)
+		{
+			ViewProjection = Projection * View;
+			InverseViewProjection = InverseView * InverseProjection;
+			ViewFrustum.Extract(ViewProjection);
+		}
+		CameraPosition = camera.Position;
+		CameraFront = camera.Front;
+		Zoom = camera.Zoom;
+		valid = true;
+	}
+
+private:
+	// Camera versions the cached matrices were built from
+	bool valid = false;
+	unsigned int viewVersion = 0;
+	unsigned int projVersion = 0;
+};
+
+#endif
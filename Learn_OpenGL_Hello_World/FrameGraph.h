@@ -0,0 +1,628 @@
+#pragma once
+
+// Frame graph: render passes declare the attachments they read and write, and the graph orders them,
+// culls passes whose outputs are never used, applies each pass's fixed-function state and allocates
+// (and aliases) the transient render targets
+
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <Profiler.h>
+#include <GpuProfiler.h>
+
+// Description of a transient render target texture
+struct FrameGraphTextureDesc {
+	int Width;
+	int Height;
+	GLenum InternalFormat; // e.g. GL_RGBA8, GL_R8, GL_DEPTH24_STENCIL8
+
+	bool operator==(const FrameGraphTextureDesc& other) const
+	{
+		return Width == other.Width && Height == other.Height && InternalFormat == other.InternalFormat;
+	}
+};
+
+// Depth/stencil/raster state a pass runs with. The graph only issues the GL calls for state that differs
+// from the previous pass, so no state leaks from one pass into the next.
+struct PassState {
+	bool DepthTest = true;
+	GLenum DepthFunc = GL_LESS;
+	bool DepthWrite = true;
+	bool StencilTest = false;
+	GLenum StencilFunc = GL_ALWAYS;
+	GLint StencilRef = 0;
+	GLuint StencilReadMask = 0xFF;
+	GLuint StencilWriteMask = 0x00;
+	GLenum StencilFail = GL_KEEP;
+	GLenum StencilDepthFail = GL_KEEP;
+	GLenum StencilPass = GL_KEEP;
+	// Separate operations for back faces (counting stencil volumes); otherwise both faces use the ones above
+	bool StencilTwoSided = false;
+	GLenum StencilBackFail = GL_KEEP;
+	GLenum StencilBackDepthFail = GL_KEEP;
+	GLenum StencilBackPass = GL_KEEP;
+	bool CullFace = true;
+	GLenum CullMode = GL_BACK;
+	bool Blend = false;
+	GLenum BlendSource = GL_ONE;
+	GLenum BlendDestination = GL_ZERO;
+	bool ColorWrite = true;
+	// Depth bias, slope scaled (factor) plus constant (units), e.g. for rendering shadow maps
+	bool PolygonOffset = false;
+	float PolygonOffsetFactor = 0.0f;
+	float PolygonOffsetUnits = 0.0f;
+};
+
+class FrameGraph
+{
+public:
+	// Handle to one version of a resource. Every write produces a new version, which is how passes are ordered.
+	typedef int Handle;
+	static const Handle INVALID_HANDLE = -1;
+	// ImportTexture() layer attaching every layer of the texture
+	static const int ALL_LAYERS = -2;
+
+	// Statistics of the last Compile()
+	unsigned int NumPasses = 0;
+	unsigned int NumCulledPasses = 0;
+	unsigned int NumTransientTextures = 0;
+	unsigned int NumPhysicalTextures = 0;
+
+	// Used by a pass's setup function to declare its inputs and outputs
+	class Builder
+	{
+	public:
+		Builder(FrameGraph& graph, int passIndex) : graph(graph), passIndex(passIndex) {}
+
+		// Declares a new transient texture written by this pass
+		Handle Create(const std::string& name, const FrameGraphTextureDesc& desc)
+		{
+			int resource = graph.addResource(name, false, desc);
+			Handle handle = graph.addVersion(resource, passIndex);
+			graph.passes[passIndex].Writes.push_back(handle);
+			return handle;
+		}
+
+		Handle Read(Handle handle)
+		{
+			graph.passes[passIndex].Reads.push_back(handle);
+			return handle;
+		}
+
+		// Writes (renders on top of) an existing resource, returns the new version
+		Handle Write(Handle handle)
+		{
+			graph.passes[passIndex].Reads.push_back(handle);
+			Handle newVersion = graph.addVersion(graph.versions[handle].Resource, passIndex);
+			graph.passes[passIndex].Writes.push_back(newVersion);
+			return newVersion;
+		}
+
+		void SetState(const PassState& state) { graph.passes[passIndex].State = state; }
+		// Renders into the bottom left width x height of the pass's offscreen targets instead of all of them
+		// (dynamic resolution without reallocating the targets)
+		void SetViewport(int width, int height)
+		{
+			graph.passes[passIndex].ViewportWidth = width;
+			graph.passes[passIndex].ViewportHeight = height;
+		}
+		// Pass must run even if nothing reads its outputs (e.g. readbacks, queries)
+		void SetSideEffect() { graph.passes[passIndex].SideEffect = true; }
+
+	private:
+		FrameGraph& graph;
+		int passIndex;
+	};
+
+	// Gives pass execute functions access to the physical textures behind their handles
+	class Resources
+	{
+	public:
+		Resources(const FrameGraph& graph) : graph(graph) {}
+		GLuint GetTexture(Handle handle) const
+		{
+			const ResourceEntry& resource = graph.resources[graph.versions[handle].Resource];
+			if (resource.External)
+				return resource.External;
+			return resource.Physical >= 0 ? graph.physicalTextures[resource.Physical].Texture : 0;
+		}
+		const FrameGraphTextureDesc& GetDesc(Handle handle) const
+		{
+			return graph.resources[graph.versions[handle].Resource].Desc;
+		}
+	private:
+		const FrameGraph& graph;
+	};
+
+	typedef std::function<void(Builder&)> SetupFunction;
+	typedef std::function<void(const Resources&)> ExecuteFunction;
+
+	// Size of the default framebuffer
+	void SetBackbufferSize(int width, int height)
+	{
+		backbufferWidth = width;
+		backbufferHeight = height;
+	}
+
+	// Framebuffer object that stands in for the default framebuffer (headless rendering), 0 for the window's
+	void SetBackbufferFramebuffer(GLuint framebuffer)
+	{
+		backbufferFramebuffer = framebuffer;
+	}
+
+	// Imports an attachment of the default framebuffer (color, depth or stencil). Its final version is a graph output.
+	Handle ImportBackbuffer(const std::string& name)
+	{
+		FrameGraphTextureDesc desc = { backbufferWidth, backbufferHeight, GL_NONE };
+		int resource = addResource(name, true, desc);
+		return addVersion(resource, -1);
+	}
+
+	// Imports a texture owned outside the graph, whose contents are kept across frames (e.g. cached shadow maps).
+	// layer selects one layer of a 2D array texture, -1 attaches a 2D texture and ALL_LAYERS attaches every layer
+	// (or cube map face) for layered rendering with gl_Layer. Its final version is a graph output.
+	Handle ImportTexture(const std::string& name, GLuint texture, const FrameGraphTextureDesc& desc, int layer = -1)
+	{
+		int resource = addResource(name, true, desc);
+		resources[resource].External = texture;
+		resources[resource].Layer = layer;
+		return addVersion(resource, -1);
+	}
+
+	void AddPass(const std::string& name, SetupFunction setup, ExecuteFunction execute)
+	{
+		Pass pass;
+		pass.Name = name;
+		pass.Execute = execute;
+		passes.push_back(pass);
+		Builder builder(*this, (int)passes.size() - 1);
+		setup(builder);
+	}
+
+	// Orders the passes, culls unused ones and assigns physical textures to the transient resources
+	void Compile()
+	{
+		PROFILE_ZONE("FrameGraph::Compile");
+		// Dependencies: every pass depends on the producers of the versions it reads
+		unsigned int numPasses = passes.size();
+		for (unsigned int i = 0; i < numPasses; i++)
+		{
+			passes[i].Dependencies.clear();
+			for (unsigned int r = 0; r < passes[i].Reads.size(); r++)
+			{
+				int producer = versions[passes[i].Reads[r]].Producer;
+				if (producer >= 0 && producer != (int)i)
+					passes[i].Dependencies.push_back(producer);
+			}
+		}
+
+		// Culling: keep the producers of the final backbuffer versions, side-effect passes, and everything they depend on
+		std::vector<int> stack;
+		for (unsigned int i = 0; i < numPasses; i++)
+		{
+			passes[i].Needed = false;
+			if (passes[i].SideEffect)
+				stack.push_back(i);
+		}
+		for (unsigned int r = 0; r < resources.size(); r++)
+		{
+			if (resources[r].Imported && versions[resources[r].LastVersion].Producer >= 0)
+				stack.push_back(versions[resources[r].LastVersion].Producer);
+		}
+		while (!stack.empty())
+		{
+			int pass = stack.back();
+			stack.pop_back();
+			if (passes[pass].Needed)
+				continue;
+			passes[pass].Needed = true;
+			for (unsigned int d = 0; d < passes[pass].Dependencies.size(); d++)
+				stack.push_back(passes[pass].Dependencies[d]);
+		}
+
+		// Ordering: topological sort of the needed passes, ties broken by declaration order
+		order.clear();
+		std::vector<int> remaining(numPasses, 0);
+		for (unsigned int i = 0; i < numPasses; i++)
+		{
+			for (unsigned int d = 0; d < passes[i].Dependencies.size(); d++)
+				if (passes[passes[i].Dependencies[d]].Needed)
+					remaining[i]++;
+		}
+		std::vector<bool> scheduled(numPasses, false);
+		bool progress = true;
+		while (progress)
+		{
+			progress = false;
+			for (unsigned int i = 0; i < numPasses; i++)
+			{
+				if (!passes[i].Needed || scheduled[i] || remaining[i] > 0)
+					continue;
+				scheduled[i] = true;
+				order.push_back(i);
+				for (unsigned int j = 0; j < numPasses; j++)
+				{
+					for (unsigned int d = 0; d < passes[j].Dependencies.size(); d++)
+						if (passes[j].Dependencies[d] == (int)i)
+							remaining[j]--;
+				}
+				progress = true;
+				break;
+			}
+		}
+
+		NumPasses = numPasses;
+		NumCulledPasses = numPasses - order.size();
+		allocateTransients();
+	}
+
+	// Runs the compiled passes in order
+	void Execute()
+	{
+		PROFILE_ZONE("FrameGraph::Execute");
+		Resources access(*this);
+		bool forceState = true; // state may have been changed outside the graph since last frame
+		for (unsigned int i = 0; i < order.size(); i++)
+		{
+			Pass& pass = passes[order[i]];
+			bindTargets(pass);
+			applyState(pass.State, forceState);
+			forceState = false;
+			gpuProfiler().BeginScope(pass.Name);
+			pass.Execute(access);
+			gpuProfiler().EndScope();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, backbufferFramebuffer);
+		glViewport(0, 0, backbufferWidth, backbufferHeight);
+		frameNumber++;
+	}
+
+	// Clears the passes and resources for the next frame (physical textures are kept in the pool)
+	void Reset()
+	{
+		passes.clear();
+		resources.clear();
+		versions.clear();
+		order.clear();
+	}
+
+	void Release()
+	{
+		for (unsigned int i = 0; i < physicalTextures.size(); i++)
+			glDeleteTextures(1, &physicalTextures[i].Texture);
+		physicalTextures.clear();
+		if (framebuffer)
+			glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+	}
+
+	// Prints the compiled pass order, culled passes and physical texture assignment
+	void Print() const
+	{
+		std::cout << "Frame graph: " << order.size() << " passes (" << NumCulledPasses << " culled), "
+			<< NumTransientTextures << " transient textures in " << NumPhysicalTextures << " physical textures" << std::endl;
+		for (unsigned int i = 0; i < order.size(); i++)
+			std::cout << "  " << i << ": " << passes[order[i]].Name << std::endl;
+		for (unsigned int r = 0; r < resources.size(); r++)
+			if (!resources[r].Imported)
+				std::cout << "  " << resources[r].Name << " -> texture " << resources[r].Physical << std::endl;
+	}
+
+private:
+	struct Pass {
+		std::string Name;
+		ExecuteFunction Execute;
+		std::vector<Handle> Reads;
+		std::vector<Handle> Writes;
+		std::vector<int> Dependencies;
+		PassState State;
+		int ViewportWidth = 0; // 0 = size of the targets
+		int ViewportHeight = 0;
+		bool SideEffect = false;
+		bool Needed = false;
+	};
+
+	struct ResourceEntry {
+		std::string Name;
+		bool Imported;
+		FrameGraphTextureDesc Desc;
+		Handle LastVersion;
+		int Physical; // index into physicalTextures, -1 if not allocated
+		GLuint External; // imported texture (ImportTexture()), 0 for transients and backbuffer attachments
+		int Layer; // layer of an imported array texture, -1 for none, ALL_LAYERS for a layered attachment
+	};
+
+	struct ResourceVersion {
+		int Resource;
+		int Producer; // pass that wrote this version, -1 for imported
+	};
+
+	struct PhysicalTexture {
+		GLuint Texture;
+		FrameGraphTextureDesc Desc;
+		int AvailableAfter; // index in the pass order after which the texture may be reused this frame
+		unsigned int LastUsedFrame;
+	};
+
+	// Textures not used for this many frames are released (e.g. after a resolution change)
+	static const unsigned int POOL_EVICT_FRAMES = 120;
+
+	std::vector<Pass> passes;
+	std::vector<ResourceEntry> resources;
+	std::vector<ResourceVersion> versions;
+	std::vector<int> order;
+	std::vector<PhysicalTexture> physicalTextures;
+	PassState currentState;
+	GLuint framebuffer = 0;
+	int backbufferWidth = 1;
+	int backbufferHeight = 1;
+	GLuint backbufferFramebuffer = 0;
+	unsigned int frameNumber = 0;
+
+	int addResource(const std::string& name, bool imported, const FrameGraphTextureDesc& desc)
+	{
+		ResourceEntry resource = { name, imported, desc, INVALID_HANDLE, -1, 0, -1 };
+		resources.push_back(resource);
+		return (int)resources.size() - 1;
+	}
+
+	Handle addVersion(int resource, int producer)
+	{
+		ResourceVersion version = { resource, producer };
+		versions.push_back(version);
+		resources[resource].LastVersion = (Handle)versions.size() - 1;
+		return resources[resource].LastVersion;
+	}
+
+	// Assigns physical textures to transient resources; resources whose lifetimes (first to last use in the pass
+	// order) don't overlap share the same texture when their descriptions match
+	void allocateTransients()
+	{
+		std::vector<int> firstUse(resources.size(), -1), lastUse(resources.size(), -1);
+		for (unsigned int i = 0; i < order.size(); i++)
+		{
+			const Pass& pass = passes[order[i]];
+			for (int rw = 0; rw < 2; rw++)
+			{
+				const std::vector<Handle>& handles = rw == 0 ? pass.Reads : pass.Writes;
+				for (unsigned int h = 0; h < handles.size(); h++)
+				{
+					int resource = versions[handles[h]].Resource;
+					if (firstUse[resource] < 0)
+						firstUse[resource] = i;
+					lastUse[resource] = i;
+				}
+			}
+		}
+		for (unsigned int p = 0; p < physicalTextures.size(); p++)
+			physicalTextures[p].AvailableAfter = -1;
+
+		// Allocate in order of first use
+		std::vector<int> transients;
+		for (unsigned int r = 0; r < resources.size(); r++)
+			if (!resources[r].Imported && firstUse[r] >= 0)
+				transients.push_back(r);
+		std::sort(transients.begin(), transients.end(), [&](int a, int b) { return firstUse[a] < firstUse[b]; });
+
+		NumTransientTextures = transients.size();
+		unsigned int physicalUsed = 0;
+		std::vector<bool> usedThisFrame(physicalTextures.size(), false);
+		for (unsigned int t = 0; t < transients.size(); t++)
+		{
+			ResourceEntry& resource = resources[transients[t]];
+			int chosen = -1;
+			for (unsigned int p = 0; p < physicalTextures.size(); p++)
+			{
+				if (physicalTextures[p].Desc == resource.Desc && physicalTextures[p].AvailableAfter < firstUse[transients[t]])
+				{
+					chosen = p;
+					break;
+				}
+			}
+			if (chosen < 0)
+			{
+				physicalTextures.push_back(createTexture(resource.Desc));
+				usedThisFrame.push_back(false);
+				chosen = physicalTextures.size() - 1;
+			}
+			if (!usedThisFrame[chosen])
+				physicalUsed++;
+			usedThisFrame[chosen] = true;
+			physicalTextures[chosen].AvailableAfter = lastUse[transients[t]];
+			physicalTextures[chosen].LastUsedFrame = frameNumber;
+			resource.Physical = chosen;
+		}
+		NumPhysicalTextures = physicalUsed;
+
+		// Release pooled textures that haven't been needed for a while
+		for (int p = (int)physicalTextures.size() - 1; p >= 0; p--)
+		{
+			if (frameNumber - physicalTextures[p].LastUsedFrame > POOL_EVICT_FRAMES)
+			{
+				glDeleteTextures(1, &physicalTextures[p].Texture);
+				physicalTextures.erase(physicalTextures.begin() + p);
+				for (unsigned int r = 0; r < resources.size(); r++)
+					if (resources[r].Physical > p)
+						resources[r].Physical--;
+			}
+		}
+	}
+
+	PhysicalTexture createTexture(const FrameGraphTextureDesc& desc)
+	{
+		PhysicalTexture physical;
+		physical.Desc = desc;
+		physical.AvailableAfter = -1;
+		physical.LastUsedFrame = frameNumber;
+		GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+		if (desc.InternalFormat == GL_DEPTH24_STENCIL8)
+		{
+			format = GL_DEPTH_STENCIL;
+			type = GL_UNSIGNED_INT_24_8;
+		}
+		else if (desc.InternalFormat == GL_DEPTH_COMPONENT24 || desc.InternalFormat == GL_DEPTH_COMPONENT32F)
+		{
+			format = GL_DEPTH_COMPONENT;
+			type = GL_FLOAT;
+		}
+		else if (desc.InternalFormat == GL_R8 || desc.InternalFormat == GL_R16F || desc.InternalFormat == GL_R32F)
+			format = GL_RED;
+		else if (desc.InternalFormat == GL_RG8 || desc.InternalFormat == GL_RG16F)
+			format = GL_RG;
+		glGenTextures(1, &physical.Texture);
+		glBindTexture(GL_TEXTURE_2D, physical.Texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.InternalFormat, desc.Width, desc.Height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return physical;
+	}
+
+	static bool isDepthFormat(GLenum format)
+	{
+		return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F;
+	}
+
+	// Attaches a transient or imported texture (or one layer of it) to the bound framebuffer
+	void attach(GLenum attachment, const ResourceEntry& resource)
+	{
+		GLuint texture = resource.External ? resource.External : physicalTextures[resource.Physical].Texture;
+		if (resource.Layer >= 0)
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, texture, 0, resource.Layer);
+		else if (resource.Layer == ALL_LAYERS)
+			glFramebufferTexture(GL_FRAMEBUFFER, attachment, texture, 0);
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+	}
+
+	// Binds the default framebuffer or an offscreen framebuffer with the pass's transient and imported texture
+	// outputs attached
+	void bindTargets(const Pass& pass)
+	{
+		std::vector<int> targets;
+		bool writesBackbuffer = false;
+		for (unsigned int w = 0; w < pass.Writes.size(); w++)
+		{
+			int resource = versions[pass.Writes[w]].Resource;
+			if (resources[resource].Imported && !resources[resource].External)
+				writesBackbuffer = true;
+			else
+				targets.push_back(resource);
+		}
+		if (writesBackbuffer || targets.empty())
+		{
+			if (!targets.empty())
+				std::cout << "ERROR::FRAME_GRAPH::PASS_WRITES_BACKBUFFER_AND_OFFSCREEN " << pass.Name << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, backbufferFramebuffer);
+			glViewport(0, 0, backbufferWidth, backbufferHeight);
+			return;
+		}
+
+		if (!framebuffer)
+			glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		// Detach everything left over from the previous offscreen pass
+		for (int c = 0; c < 4; c++)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, GL_TEXTURE_2D, 0, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+
+		GLenum drawBuffers[4];
+		int numColor = 0;
+		for (unsigned int t = 0; t < targets.size(); t++)
+		{
+			const ResourceEntry& resource = resources[targets[t]];
+			if (resource.Desc.InternalFormat == GL_DEPTH24_STENCIL8)
+				attach(GL_DEPTH_STENCIL_ATTACHMENT, resource);
+			else if (isDepthFormat(resource.Desc.InternalFormat))
+				attach(GL_DEPTH_ATTACHMENT, resource);
+			else if (numColor < 4)
+			{
+				attach(GL_COLOR_ATTACHMENT0 + numColor, resource);
+				drawBuffers[numColor] = GL_COLOR_ATTACHMENT0 + numColor;
+				numColor++;
+			}
+		}
+		// Depth-only passes need the read buffer off too for the framebuffer to be complete
+		if (numColor > 0)
+		{
+			glDrawBuffers(numColor, drawBuffers);
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+		}
+		else
+		{
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+		const FrameGraphTextureDesc& desc = resources[targets[0]].Desc;
+		if (pass.ViewportWidth > 0 && pass.ViewportHeight > 0)
+			glViewport(0, 0, std::min(pass.ViewportWidth, desc.Width), std::min(pass.ViewportHeight, desc.Height));
+		else
+			glViewport(0, 0, desc.Width, desc.Height);
+	}
+
+	static void setEnabled(GLenum cap, bool enabled)
+	{
+		if (enabled)
+			glEnable(cap);
+		else
+			glDisable(cap);
+	}
+
+	// Issues GL calls for the state that differs from the current state
+	void applyState(const PassState& state, bool force)
+	{
+		PassState& cur = currentState;
+		if (force || state.DepthTest != cur.DepthTest)
+			setEnabled(GL_DEPTH_TEST, state.DepthTest);
+		if (force || state.DepthFunc != cur.DepthFunc)
+			glDepthFunc(state.DepthFunc);
+		if (force || state.DepthWrite != cur.DepthWrite)
+			glDepthMask(state.DepthWrite ? GL_TRUE : GL_FALSE);
+		if (force || state.StencilTest != cur.StencilTest)
+			setEnabled(GL_STENCIL_TEST, state.StencilTest);
+		if (force || state.StencilFunc != cur.StencilFunc || state.StencilRef != cur.StencilRef || state.StencilReadMask != cur.StencilReadMask)
+			glStencilFunc(state.StencilFunc, state.StencilRef, state.StencilReadMask);
+		if (force || state.StencilWriteMask != cur.StencilWriteMask)
+			glStencilMask(state.StencilWriteMask);
+		if (force || state.StencilFail != cur.StencilFail || state.StencilDepthFail != cur.StencilDepthFail || state.StencilPass != cur.StencilPass
+			|| state.StencilTwoSided != cur.StencilTwoSided || state.StencilBackFail != cur.StencilBackFail
+			|| state.StencilBackDepthFail != cur.StencilBackDepthFail || state.StencilBackPass != cur.StencilBackPass)
+		{
+			if (state.StencilTwoSided)
+			{
+				glStencilOpSeparate(GL_FRONT, state.StencilFail, state.StencilDepthFail, state.StencilPass);
+				glStencilOpSeparate(GL_BACK, state.StencilBackFail, state.StencilBackDepthFail, state.StencilBackPass);
+			}
+			else
+				glStencilOp(state.StencilFail, state.StencilDepthFail, state.StencilPass);
+		}
+		if (force || state.CullFace != cur.CullFace)
+			setEnabled(GL_CULL_FACE, state.CullFace);
+		if (force || state.CullMode != cur.CullMode)
+			glCullFace(state.CullMode);
+		if (force || state.Blend != cur.Blend)
+			setEnabled(GL_BLEND, state.Blend);
+		if (force || state.BlendSource != cur.BlendSource || state.BlendDestination != cur.BlendDestination)
+			glBlendFunc(state.BlendSource, state.BlendDestination);
+		if (force || state.ColorWrite != cur.ColorWrite)
+		{
+			GLboolean write = state.ColorWrite ? GL_TRUE : GL_FALSE;
+			glColorMask(write, write, write, write);
+		}
+		if (force || state.PolygonOffset != cur.PolygonOffset)
+			setEnabled(GL_POLYGON_OFFSET_FILL, state.PolygonOffset);
+		if (force || state.PolygonOffsetFactor != cur.PolygonOffsetFactor || state.PolygonOffsetUnits != cur.PolygonOffsetUnits)
+			glPolygonOffset(state.PolygonOffsetFactor, state.PolygonOffsetUnits);
+		cur = state;
+	}
+};
+
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+
+// Per-frame CPU timings split into phases, kept for the last N frames in a ring buffer. Reports rolling
+// min/avg/percentiles and a frame time histogram, and exports the window to CSV or JSON. Other per-frame
+// measurements (GPU pass times, ...) can be added as named series, which are summarised the same way.
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <Benchmark.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+enum FramePhase {
+	FRAME_PHASE_INPUT, // events, input and simulation ticks
+	FRAME_PHASE_UPDATE, // entity systems and scene graph
+	FRAME_PHASE_CULLING,
+	FRAME_PHASE_SUBMISSION, // draw recording, sorting and executing the frame graph
+	FRAME_PHASE_SWAP, // buffer swap (or waiting for the frame headless)
+	NUM_FRAME_PHASES
+};
+
+class FrameStats
+{
+public:
+	static const unsigned int DEFAULT_CAPACITY = 1024;
+	static const unsigned int NUM_HISTOGRAM_BUCKETS = 10;
+
+	// Milliseconds per frame of one rendered frame
+	struct FrameRecord {
+		double Total;
+		double Phases[NUM_FRAME_PHASES];
+	};
+
+	FrameStats(unsigned int capacity = DEFAULT_CAPACITY)
+	{
+		SetCapacity(capacity);
+	}
+
+	// Number of frames kept; clears the recorded frames
+	void SetCapacity(unsigned int capacity)
+	{
+		records.assign(capacity > 0 ? capacity : 1, FrameRecord());
+		count = 0;
+		next = 0;
+		totalFrames = 0;
+		series.clear();
+		seriesIndices.clear();
+	}
+
+	// Times are in seconds
+	void BeginFrame(double time)
+	{
+		current = FrameRecord();
+		frameStart = time;
+		phaseStart = time;
+	}
+
+	// Ends the given phase, which started at the previous mark (or the start of the frame). Returns its milliseconds.
+	double Mark(FramePhase phase, double time)
+	{
+		double milliseconds = (time - phaseStart) * 1000.0;
+		current.Phases[phase] += milliseconds;
+		phaseStart = time;
+		return milliseconds;
+	}
+
+	void EndFrame(double time)
+	{
+		current.Total = (time - frameStart) * 1000.0;
+		records[next] = current;
+		next = (next + 1) % records.size();
+		if (count < records.size())
+			count++;
+		totalFrames++;
+	}
+
+	// Adds a value to a named series, keeping as many values per series as frames in the window.
+	// Values need not arrive every frame (GPU results come back a few frames late).
+	void AddSample(const std::string& name, double value)
+	{
+		std::map<std::string, unsigned int>::iterator found = seriesIndices.find(name);
+		if (found == seriesIndices.end())
+		{
+			found = seriesIndices.insert(std::make_pair(name, (unsigned int)series.size())).first;
+			series.push_back(Series());
+			series.back().Name = name;
+			series.back().Values.resize(records.size());
+		}
+		Series& target = series[found->second];
+		target.Values[target.Next] = value;
+		target.Next = (target.Next + 1) % target.Values.size();
+		if (target.Count < target.Values.size())
+			target.Count++;
+	}
+
+	unsigned int NumSeries() const { return series.size(); }
+	const std::string& SeriesName(unsigned int i) const { return series[i].Name; }
+
+	SampleSummary SeriesSummary(unsigned int i) const
+	{
+		const Series& source = series[i];
+		std::vector<double> samples(source.Values.begin(), source.Values.begin() + source.Count);
+		return SampleSummary::From(samples);
+	}
+
+	// Frames in the window, and recorded since the start
+	unsigned int Size() const { return count; }
+	unsigned long long TotalFrames() const { return totalFrames; }
+
+	// Frame i of the window, oldest first
+	const FrameRecord& At(unsigned int i) const
+	{
+		return records[(next + records.size() - count + i) % records.size()];
+	}
+
+	SampleSummary FrameTimeSummary() const
+	{
+		std::vector<double> samples(count);
+		for (unsigned int i = 0; i < count; i++)
+			samples[i] = At(i).Total;
+		return SampleSummary::From(samples);
+	}
+
+	SampleSummary PhaseSummary(FramePhase phase) const
+	{
+		std::vector<double> samples(count);
+		for (unsigned int i = 0; i < count; i++)
+			samples[i] = At(i).Phases[phase];
+		return SampleSummary::From(samples);
+	}
+
+	// Upper bound (ms) of each histogram bucket, the last bucket has no upper bound
+	static double BucketLimit(unsigned int bucket)
+	{
+		static const double limits[NUM_HISTOGRAM_BUCKETS - 1] = { 2.0, 4.0, 8.0, 12.0, 1000.0 / 60.0, 20.0, 1000.0 / 30.0, 50.0, 100.0 };
+		return limits[bucket];
+	}
+
+	// Number of frames in the window per histogram bucket
+	void Histogram(unsigned int buckets[NUM_HISTOGRAM_BUCKETS]) const
+	{
+		for (unsigned int b = 0; b < NUM_HISTOGRAM_BUCKETS; b++)
+			buckets[b] = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int b = 0;
+			while (b < NUM_HISTOGRAM_BUCKETS - 1 && At(i).Total >= BucketLimit(b))
+				b++;
+			buckets[b]++;
+		}
+	}
+
+	static const char* PhaseName(unsigned int phase)
+	{
+		static const char* names[NUM_FRAME_PHASES] = { "input", "update", "culling", "submission", "swap" };
+		return names[phase];
+	}
+
+	// Rolling summary of the window
+	void Print() const
+	{
+		SampleSummary frame = FrameTimeSummary();
+		printf("%f ms per frame (min %f, p50 %f, p95 %f, p99 %f, max %f) over %u frames\n",
+			frame.Avg, frame.Min, frame.P50, frame.P95, frame.P99, frame.Max, count);
+		printf("%f fps = 1 / avg ms per frame\n", frame.Avg > 0.0 ? 1000.0 / frame.Avg : 0.0);
+		printf("avg ms per phase:");
+		for (unsigned int p = 0; p < NUM_FRAME_PHASES; p++)
+			printf(" %s %f", PhaseName(p), PhaseSummary((FramePhase)p).Avg);
+		printf("\n");
+		for (unsigned int i = 0; i < series.size(); i++)
+		{
+			SampleSummary summary = SeriesSummary(i);
+			printf("%s: avg %f, p95 %f, max %f\n", series[i].Name.c_str(), summary.Avg, summary.P95, summary.Max);
+		}
+	}
+
+	// One row per frame of the window (the named series only go into the JSON summary)
+	bool WriteCsv(const std::string& path) const
+	{
+		std::ofstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "ERROR::FRAME_STATS::FILE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+		file << "frame,total_ms";
+		for (unsigned int p = 0; p < NUM_FRAME_PHASES; p++)
+			file << "," << PhaseName(p) << "_ms";
+		file << "\n";
+		unsigned long long firstFrame = totalFrames - count;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const FrameRecord& record = At(i);
+			file << firstFrame + i << "," << record.Total;
+			for (unsigned int p = 0; p < NUM_FRAME_PHASES; p++)
+				file << "," << record.Phases[p];
+			file << "\n";
+		}
+		return true;
+	}
+
+	// Summaries and histogram of the window
+	bool WriteJson(const std::string& path) const
+	{
+		std::ofstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "ERROR::FRAME_STATS::FILE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+		file << "{\n";
+		file << "  \"total_frames\": " << totalFrames << ",\n";
+		file << "  \"window_frames\": " << count << ",\n";
+		file << "  \"frame_time_ms\": ";
+		FrameTimeSummary().WriteJson(file);
+		file << ",\n  \"phase_time_ms\": {\n";
+		for (unsigned int p = 0; p < NUM_FRAME_PHASES; p++)
+		{
+			file << "    \"" << PhaseName(p) << "\": ";
+			PhaseSummary((FramePhase)p).WriteJson(file);
+			file << (p + 1 < NUM_FRAME_PHASES ? ",\n" : "\n");
+		}
+		file << "  },\n  \"series\": {";
+		for (unsigned int i = 0; i < series.size(); i++)
+		{
+			file << (i > 0 ? ",\n" : "\n") << "    \"" << series[i].Name << "\": ";
+			SeriesSummary(i).WriteJson(file);
+		}
+		file << (series.empty() ? "},\n" : "\n  },\n");
+		file << "  \"frame_time_histogram\": [\n";
+		unsigned int buckets[NUM_HISTOGRAM_BUCKETS];
+		Histogram(buckets);
+		for (unsigned int b = 0; b < NUM_HISTOGRAM_BUCKETS; b++)
+		{
+			file << "    { \"max_ms\": ";
+			if (b < NUM_HISTOGRAM_BUCKETS - 1)
+				file << BucketLimit(b);
+			else
+				file << "null";
+			file << ", \"frames\": " << buckets[b] << " }" << (b + 1 < NUM_HISTOGRAM_BUCKETS ? ",\n" : "\n");
+		}
+		file << "  ]\n}\n";
+		return true;
+	}
+
+	// Writes <prefix>.csv and <prefix>.json
+	bool Export(const std::string& prefix) const
+	{
+		bool written = WriteCsv(prefix + ".csv") && WriteJson(prefix + ".json");
+		if (written)
+			std::cout << "Frame stats written to " << prefix << ".csv and " << prefix << ".json" << std::endl;
+		return written;
+	}
+
+private:
+	struct Series {
+		std::string Name;
+		std::vector<double> Values; // ring buffer
+		unsigned int Next = 0;
+		unsigned int Count = 0;
+	};
+
+	std::vector<FrameRecord> records;
+	unsigned int count = 0;
+	unsigned int next = 0;
+	unsigned long long totalFrames = 0;
+	FrameRecord current = FrameRecord();
+	double frameStart = 0.0;
+	double phaseStart = 0.0;
+	std::vector<Series> series; // in the order first added
+	std::map<std::string, unsigned int> seriesIndices;
+};
+
+#endif
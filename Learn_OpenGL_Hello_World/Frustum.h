@@ -0,0 +1,313 @@
+#pragma once
+
+// Bounding volumes and view frustum culling for meshes and procedural objects
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+
+// Use the widest SIMD instruction set the compiler is targeting (AVX with /arch:AVX, otherwise SSE on x86/x64)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_SIMD_WIDTH 8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SIMD_WIDTH 4
+#else
+#define FRUSTUM_SIMD_WIDTH 1
+#endif
+
+// Axis-aligned bounding box
+struct AABB {
+	glm::vec3 Min;
+	glm::vec3 Max;
+
+	// Default box is empty (inverted) so that the first Expand() sets it
+	AABB() : Min(glm::vec3(FLT_MAX)), Max(glm::vec3(-FLT_MAX)) {}
+	AABB(glm::vec3 min, glm::vec3 max) : Min(min), Max(max) {}
+
+	void Expand(const glm::vec3& point)
+	{
+		Min = glm::min(Min, point);
+		Max = glm::max(Max, point);
+	}
+
+	void Expand(const AABB& other)
+	{
+		Min = glm::min(Min, other.Min);
+		Max = glm::max(Max, other.Max);
+	}
+
+	bool IsEmpty() const { return Min.x > Max.x || Min.y > Max.y || Min.z > Max.z; }
+	glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+	glm::vec3 Extents() const { return (Max - Min) * 0.5f; }
+
+	// Returns the box enclosing this box after it is transformed by the given matrix (Arvo's method)
+	AABB Transform(const glm::mat4& matrix) const
+	{
+		glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(), 1.0f));
+		glm::vec3 extents = Extents();
+		glm::vec3 newExtents;
+		for (int i = 0; i < 3; i++)
+			newExtents[i] = fabs(matrix[0][i]) * extents.x + fabs(matrix[1][i]) * extents.y + fabs(matrix[2][i]) * extents.z;
+		return AABB(center - newExtents, center + newExtents);
+	}
+};
+
+// Bounding sphere (used for projected size tests)
+struct BoundingSphere {
+	glm::vec3 Center;
+	float Radius;
+
+	BoundingSphere() : Center(0.0f), Radius(0.0f) {}
+	BoundingSphere(glm::vec3 center, float radius) : Center(center), Radius(radius) {}
+	// Sphere enclosing the given box
+	BoundingSphere(const AABB& box) : Center(box.Center()), Radius(glm::length(box.Extents())) {}
+};
+
+// Six clipping planes of a view frustum
+class Frustum
+{
+public:
+	// Planes stored as (normal, distance) with normals pointing into the frustum
+	// Order: left, right, bottom, top, near, far
+	glm::vec4 Planes[6];
+
+	Frustum() {}
+	Frustum(const glm::mat4& viewProj) { Extract(viewProj); }
+
+	// Extracts the planes from a combined view-projection matrix (Gribb & Hartmann)
+	void Extract(const glm::mat4& viewProj)
+	{
+		// glm matrices are column-major, so m[col][row]
+		glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+		glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+		glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+		glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+		Planes[0] = row3 + row0;
+		Planes[1] = row3 - row0;
+		Planes[2] = row3 + row1;
+		Planes[3] = row3 - row1;
+		Planes[4] = row3 + row2;
+		Planes[5] = row3 - row2;
+		for (int i = 0; i < 6; i++)
+			Planes[i] /= glm::length(glm::vec3(Planes[i]));
+	}
+
+	bool IsSphereVisible(const BoundingSphere& sphere) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec3(Planes[i]), sphere.Center) + Planes[i].w < -sphere.Radius)
+				return false;
+		}
+		return true;
+	}
+
+	bool IsBoxVisible(const AABB& box) const
+	{
+		glm::vec3 center = box.Center();
+		glm::vec3 extents = box.Extents();
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal = glm::vec3(Planes[i]);
+			float distance = glm::dot(normal, center) + Planes[i].w;
+			float radius = glm::dot(glm::abs(normal), extents);
+			if (distance + radius < 0.0f)
+				return false;
+		}
+		return true;
+	}
+};
+
+// Structure-of-arrays list of world space bounding boxes which are culled together in SIMD-width batches
+class CullingBatch
+{
+public:
+	// Results of the last Cull() call, one entry per added object (1 = visible)
+	std::vector<unsigned char> Visible;
+	unsigned int NumVisible = 0;
+	unsigned int NumCulled = 0;
+	// Views each object is visible in, one bit per view, for batches culled for several views at once
+	// (StoreView() and MergeViews()); empty when the batch was only culled for one
+	std::vector<unsigned char> ViewMasks;
+
+	// Remove all objects (keeps the allocated memory for the next frame)
+	void Clear()
+	{
+		centerX.clear(); centerY.clear(); centerZ.clear();
+		extentX.clear(); extentY.clear(); extentZ.clear();
+		radius.clear();
+		Visible.clear();
+		ViewMasks.clear();
+		count = 0;
+	}
+
+	// Adds a world space bounding box, returns the object's index in the batch
+	unsigned int Add(const AABB& worldBox)
+	{
+		glm::vec3 center = worldBox.Center();
+		glm::vec3 extents = worldBox.Extents();
+		// Drop any padding left over from a previous Cull()
+		resizeArrays(count);
+		centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+		extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+		radius.push_back(glm::length(extents));
+		Visible.push_back(1);
+		return count++;
+	}
+
+	unsigned int Size() const { return count; }
+	bool IsVisible(unsigned int index) const { return Visible[index] != 0; }
+	// Views an object is visible in (every view if the batch wasn't culled per view), 0 if culled
+	unsigned int ViewMask(unsigned int index) const
+	{
+		if (!Visible[index])
+			return 0;
+		return ViewMasks.empty() ? ~0u : ViewMasks[index];
+	}
+
+	// Records the result of the last Cull() as the given view's bit of ViewMasks. View 0 starts the masks over.
+	void StoreView(unsigned int view)
+	{
+		if (view == 0)
+			ViewMasks.assign(count, 0);
+		for (unsigned int i = 0; i < count; i++)
+			ViewMasks[i] |= Visible[i] << view;
+	}
+
+	// Makes the objects visible in any of the stored views the visible ones
+	void MergeViews()
+	{
+		NumVisible = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			Visible[i] = ViewMasks[i] != 0;
+			NumVisible += Visible[i];
+		}
+		NumCulled = count - NumVisible;
+	}
+
+	// World space bounding box of an object
+	AABB Box(unsigned int index) const
+	{
+		glm::vec3 center(centerX[index], centerY[index], centerZ[index]);
+		glm::vec3 extents(extentX[index], extentY[index], extentZ[index]);
+		return AABB(center - extents, center + extents);
+	}
+
+	// Tests every object against the frustum planes. When minPixelSize > 0, objects whose projected
+	// diameter is smaller than minPixelSize pixels are rejected as well. projScaleY is proj[1][1].
+	void Cull(const Frustum& frustum, const glm::vec3& viewPos, float projScaleY, float viewportHeight, float minPixelSize = 0.0f)
+	{
+		// Pad the arrays to a whole number of SIMD batches (padding lanes are ignored)
+		unsigned int padded = (count + FRUSTUM_SIMD_WIDTH - 1) / FRUSTUM_SIMD_WIDTH * FRUSTUM_SIMD_WIDTH;
+		resizeArrays(padded);
+		// Projected diameter in pixels = radius * sizeScale / distance
+		float sizeScale = projScaleY * viewportHeight;
+		float minSizeSq = minPixelSize * minPixelSize;
+		bool testSize = minPixelSize > 0.0f;
+
+#if FRUSTUM_SIMD_WIDTH == 8
+		__m256 zero = _mm256_setzero_ps();
+		__m256 camX = _mm256_set1_ps(viewPos.x), camY = _mm256_set1_ps(viewPos.y), camZ = _mm256_set1_ps(viewPos.z);
+		__m256 scale = _mm256_set1_ps(sizeScale), minSq = _mm256_set1_ps(minSizeSq);
+		for (unsigned int i = 0; i < padded; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(&centerX[i]), cy = _mm256_loadu_ps(&centerY[i]), cz = _mm256_loadu_ps(&centerZ[i]);
+			__m256 ex = _mm256_loadu_ps(&extentX[i]), ey = _mm256_loadu_ps(&extentY[i]), ez = _mm256_loadu_ps(&extentZ[i]);
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.Planes[p];
+				__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+				__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fabs(plane.x)), ex), _mm256_mul_ps(_mm256_set1_ps(fabs(plane.y)), ey)),
+					_mm256_mul_ps(_mm256_set1_ps(fabs(plane.z)), ez));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+			}
+			if (testSize)
+			{
+				__m256 dx = _mm256_sub_ps(cx, camX), dy = _mm256_sub_ps(cy, camY), dz = _mm256_sub_ps(cz, camZ);
+				__m256 distSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				__m256 size = _mm256_mul_ps(_mm256_loadu_ps(&radius[i]), scale);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_mul_ps(size, size), _mm256_mul_ps(minSq, distSq), _CMP_GE_OQ));
+			}
+			storeMask(i, _mm256_movemask_ps(inside), 8);
+		}
+#elif FRUSTUM_SIMD_WIDTH == 4
+		__m128 zero = _mm_setzero_ps();
+		__m128 camX = _mm_set1_ps(viewPos.x), camY = _mm_set1_ps(viewPos.y), camZ = _mm_set1_ps(viewPos.z);
+		__m128 scale = _mm_set1_ps(sizeScale), minSq = _mm_set1_ps(minSizeSq);
+		for (unsigned int i = 0; i < padded; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+			__m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.Planes[p];
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+				__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(fabs(plane.y)), ey)),
+					_mm_mul_ps(_mm_set1_ps(fabs(plane.z)), ez));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+			}
+			if (testSize)
+			{
+				__m128 dx = _mm_sub_ps(cx, camX), dy = _mm_sub_ps(cy, camY), dz = _mm_sub_ps(cz, camZ);
+				__m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				__m128 size = _mm_mul_ps(_mm_loadu_ps(&radius[i]), scale);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_mul_ps(size, size), _mm_mul_ps(minSq, distSq)));
+			}
+			storeMask(i, _mm_movemask_ps(inside), 4);
+		}
+#else
+		for (unsigned int i = 0; i < count; i++)
+		{
+			AABB box(glm::vec3(centerX[i] - extentX[i], centerY[i] - extentY[i], centerZ[i] - extentZ[i]),
+				glm::vec3(centerX[i] + extentX[i], centerY[i] + extentY[i], centerZ[i] + extentZ[i]));
+			bool inside = frustum.IsBoxVisible(box);
+			if (inside && testSize)
+			{
+				glm::vec3 toCamera = glm::vec3(centerX[i], centerY[i], centerZ[i]) - viewPos;
+				float size = radius[i] * sizeScale;
+				inside = size * size >= minSizeSq * glm::dot(toCamera, toCamera);
+			}
+			storeMask(i, inside ? 1 : 0, 1);
+		}
+#endif
+		NumVisible = 0;
+		for (unsigned int i = 0; i < count; i++)
+			NumVisible += Visible[i];
+		NumCulled = count - NumVisible;
+	}
+
+private:
+	// Bounding box data, one array per component
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<float> radius;
+	unsigned int count = 0;
+
+	void resizeArrays(unsigned int size)
+	{
+		centerX.resize(size); centerY.resize(size); centerZ.resize(size);
+		extentX.resize(size); extentY.resize(size); extentZ.resize(size);
+		radius.resize(size);
+	}
+
+	// Writes the per-lane results of one batch, ignoring the padding lanes
+	void storeMask(unsigned int first, int mask, unsigned int width)
+	{
+		for (unsigned int lane = 0; lane < width && first + lane < count; lane++)
+			Visible[first + lane] = (mask >> lane) & 1;
+	}
+};
+
+#endif
@@ -0,0 +1,235 @@
+#pragma once
+
+// GPU time of nested scopes (frame graph passes, and optionally every draw) from GL_TIMESTAMP queries.
+// Each frame's queries go into one of NUM_FRAMES slots and are read back when the slot comes round again,
+// so the CPU never waits on the GPU under normal load. Top-level scopes also count vertex and fragment shader
+// invocations when ARB_pipeline_statistics_query is available (those queries can't nest).
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+#ifndef GL_VERTEX_SHADER_INVOCATIONS_ARB
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#endif
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+class GpuProfiler
+{
+public:
+	static const unsigned int NUM_FRAMES = 3;
+
+	struct ScopeResult {
+		std::string Path; // "Pass" or "Pass/draw 3"
+		unsigned int Depth;
+		double Milliseconds;
+		bool HasStatistics; // top-level scopes when pipeline statistics are supported
+		GLuint64 VertexInvocations;
+		GLuint64 FragmentInvocations;
+	};
+
+	// Scopes of the most recently read back frame, in the order they began
+	std::vector<ScopeResult> Results;
+
+	void Init(bool drawScopes)
+	{
+		enabled = true;
+		this->drawScopes = drawScopes;
+		statisticsSupported = hasExtension("GL_ARB_pipeline_statistics_query");
+		std::cout << "GPU profiler: " << (drawScopes ? "per pass and per draw" : "per pass")
+			<< (statisticsSupported ? ", with pipeline statistics" : ", pipeline statistics not supported") << std::endl;
+	}
+
+	void Release()
+	{
+		for (unsigned int i = 0; i < NUM_FRAMES; i++)
+		{
+			FrameSlot& slot = slots[i];
+			if (!slot.Timestamps.empty())
+				glDeleteQueries(slot.Timestamps.size(), slot.Timestamps.data());
+			if (!slot.Statistics.empty())
+				glDeleteQueries(slot.Statistics.size(), slot.Statistics.data());
+			slot = FrameSlot();
+		}
+		enabled = false;
+	}
+
+	bool Enabled() const { return enabled; }
+	bool DrawScopesEnabled() const { return enabled && drawScopes; }
+	bool StatisticsSupported() const { return statisticsSupported; }
+
+	// Reads back the frame that last used this frame's slot. Returns true if Results were updated.
+	bool BeginFrame()
+	{
+		if (!enabled)
+			return false;
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		bool updated = slot.Pending;
+		if (slot.Pending)
+			readBack(slot);
+		slot.Scopes.clear();
+		slot.UsedTimestamps = 0;
+		slot.UsedStatistics = 0;
+		slot.Pending = false;
+		return updated;
+	}
+
+	void EndFrame()
+	{
+		if (!enabled)
+			return;
+		if (!openScopes.empty())
+		{
+			std::cout << "ERROR::GPU_PROFILER::UNCLOSED_SCOPE " << slots[frame % NUM_FRAMES].Scopes[openScopes.back()].Path << std::endl;
+			while (!openScopes.empty())
+				EndScope();
+		}
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		slot.Pending = !slot.Scopes.empty();
+		frame++;
+	}
+
+	void BeginScope(const std::string& name)
+	{
+		if (!enabled)
+			return;
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		Scope scope;
+		scope.Depth = openScopes.size();
+		scope.Path = openScopes.empty() ? name : slot.Scopes[openScopes.back()].Path + "/" + name;
+		scope.BeginQuery = timestampQuery(slot);
+		glQueryCounter(scope.BeginQuery, GL_TIMESTAMP);
+		scope.StatisticsQuery = -1;
+		if (statisticsSupported && scope.Depth == 0)
+		{
+			scope.StatisticsQuery = slot.UsedStatistics;
+			glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, statisticsQuery(slot));
+			glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, statisticsQuery(slot));
+		}
+		openScopes.push_back(slot.Scopes.size());
+		slot.Scopes.push_back(scope);
+	}
+
+	void EndScope()
+	{
+		if (!enabled || openScopes.empty())
+			return;
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		Scope& scope = slot.Scopes[openScopes.back()];
+		openScopes.pop_back();
+		if (scope.StatisticsQuery >= 0)
+		{
+			glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+			glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+		}
+		scope.EndQuery = timestampQuery(slot);
+		glQueryCounter(scope.EndQuery, GL_TIMESTAMP);
+	}
+
+	// Per-draw scope inside the current pass, only when draw scopes are enabled
+	void BeginDrawScope(unsigned int drawIndex)
+	{
+		if (DrawScopesEnabled())
+			BeginScope("draw " + std::to_string(drawIndex));
+	}
+
+	void EndDrawScope()
+	{
+		if (DrawScopesEnabled())
+			EndScope();
+	}
+
+private:
+	struct Scope {
+		std::string Path;
+		unsigned int Depth;
+		GLuint BeginQuery;
+		GLuint EndQuery;
+		int StatisticsQuery; // first of the vertex/fragment invocation pair in the slot, or -1
+	};
+
+	// Queries of one frame in flight; the query objects are kept and reused
+	struct FrameSlot {
+		std::vector<Scope> Scopes;
+		std::vector<GLuint> Timestamps;
+		std::vector<GLuint> Statistics;
+		unsigned int UsedTimestamps = 0;
+		unsigned int UsedStatistics = 0;
+		bool Pending = false;
+	};
+
+	FrameSlot slots[NUM_FRAMES];
+	std::vector<unsigned int> openScopes;
+	unsigned int frame = 0;
+	bool enabled = false;
+	bool drawScopes = false;
+	bool statisticsSupported = false;
+
+	static bool hasExtension(const char* name)
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+		for (GLint i = 0; i < numExtensions; i++)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension && strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	static GLuint nextQuery(std::vector<GLuint>& pool, unsigned int& used)
+	{
+		if (used == pool.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			pool.push_back(query);
+		}
+		return pool[used++];
+	}
+
+	GLuint timestampQuery(FrameSlot& slot) { return nextQuery(slot.Timestamps, slot.UsedTimestamps); }
+	GLuint statisticsQuery(FrameSlot& slot) { return nextQuery(slot.Statistics, slot.UsedStatistics); }
+
+	// With NUM_FRAMES frames in flight the results are normally ready; if the GPU is further behind this waits
+	void readBack(FrameSlot& slot)
+	{
+		Results.resize(slot.Scopes.size());
+		for (unsigned int i = 0; i < slot.Scopes.size(); i++)
+		{
+			const Scope& scope = slot.Scopes[i];
+			ScopeResult& result = Results[i];
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(scope.BeginQuery, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(scope.EndQuery, GL_QUERY_RESULT, &end);
+			result.Path = scope.Path;
+			result.Depth = scope.Depth;
+			result.Milliseconds = end > begin ? (end - begin) / 1.0e6 : 0.0;
+			result.HasStatistics = scope.StatisticsQuery >= 0;
+			result.VertexInvocations = 0;
+			result.FragmentInvocations = 0;
+			if (result.HasStatistics)
+			{
+				glGetQueryObjectui64v(slot.Statistics[scope.StatisticsQuery], GL_QUERY_RESULT, &result.VertexInvocations);
+				glGetQueryObjectui64v(slot.Statistics[scope.StatisticsQuery + 1], GL_QUERY_RESULT, &result.FragmentInvocations);
+			}
+		}
+	}
+};
+
+// Profiler of the frame currently being rendered
+inline GpuProfiler& gpuProfiler()
+{
+	static GpuProfiler profiler;
+	return profiler;
+}
+
+#endif
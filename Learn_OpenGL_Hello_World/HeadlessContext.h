@@ -0,0 +1,201 @@
+#pragma once
+
+// OpenGL context without a visible window, rendering into a framebuffer object that stands in for the window's
+// backbuffer. On Linux it is a surfaceless EGL context, for machines with no display or GPU (works on Mesa's
+// llvmpipe software renderer; link with -lEGL). Elsewhere it is the context of a hidden GLFW window, so the
+// Windows build needs nothing extra.
+
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#if defined(__linux__)
+#define HEADLESS_CONTEXT_EGL 1
+// Keep X11 headers (and their macros) out, the surfaceless platform doesn't need them
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#define HEADLESS_CONTEXT_EGL 0
+#include <GLFW/glfw3.h>
+#endif
+
+class HeadlessContext
+{
+public:
+	// Offscreen backbuffer, valid after CreateFramebuffer()
+	GLuint Framebuffer = 0;
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+
+	// Creates an OpenGL 3.3 core context and makes it current. Load the GL functions with GetProcAddress() afterwards.
+	bool CreateContext()
+	{
+#if HEADLESS_CONTEXT_EGL
+		// Prefer Mesa's surfaceless platform, which needs neither a display server nor a GPU
+		display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		{
+			std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			std::cout << "ERROR::HEADLESS::OPENGL_API_UNAVAILABLE" << std::endl;
+			return false;
+		}
+
+		// Any OpenGL capable config; rendering goes to the framebuffer object, never to an EGL surface
+		EGLConfig config = NULL;
+		EGLint numConfigs = 0;
+		const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+			config = NULL; // EGL_KHR_no_config_context
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+		std::cout << "Headless EGL " << major << "." << minor << " context" << std::endl;
+		return true;
+#else
+		if (!glfwInit())
+		{
+			std::cout << "ERROR::HEADLESS::GLFW_INITIALIZE_FAILED" << std::endl;
+			return false;
+		}
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		// Never shown; its own backbuffer is never drawn to, so its size doesn't matter
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = glfwCreateWindow(1, 1, "LearnOpenGL (headless)", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED" << std::endl;
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(window);
+		std::cout << "Headless context of a hidden GLFW window" << std::endl;
+		return true;
+#endif
+	}
+
+	// GL function loader for glad
+	static void* GetProcAddress(const char* name)
+	{
+#if HEADLESS_CONTEXT_EGL
+		return (void*)eglGetProcAddress(name);
+#else
+		return (void*)glfwGetProcAddress(name);
+#endif
+	}
+
+	// Colour and depth/stencil renderbuffers of the given size, bound as the draw framebuffer
+	bool CreateFramebuffer(unsigned int width, unsigned int height)
+	{
+		Width = width;
+		Height = height;
+		glGenFramebuffers(1, &Framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glGenRenderbuffers(1, &depthStencilBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthStencilBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Writes the backbuffer's colour to a binary PPM image
+	bool SaveImage(const std::string& path)
+	{
+		std::vector<unsigned char> pixels(Width * Height * 3);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (!file)
+		{
+			std::cout << "ERROR::HEADLESS::IMAGE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+		file << "P6\n" << Width << " " << Height << "\n255\n";
+		// GL rows start at the bottom
+		for (int row = Height - 1; row >= 0; row--)
+			file.write((const char*)&pixels[row * Width * 3], Width * 3);
+		return true;
+	}
+
+	void Destroy()
+	{
+		if (Framebuffer)
+		{
+			glDeleteFramebuffers(1, &Framebuffer);
+			glDeleteRenderbuffers(1, &colorBuffer);
+			glDeleteRenderbuffers(1, &depthStencilBuffer);
+			Framebuffer = 0;
+		}
+#if HEADLESS_CONTEXT_EGL
+		if (display != EGL_NO_DISPLAY)
+		{
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (context != EGL_NO_CONTEXT)
+				eglDestroyContext(display, context);
+			eglTerminate(display);
+			display = EGL_NO_DISPLAY;
+			context = EGL_NO_CONTEXT;
+		}
+#else
+		if (window != NULL)
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+			window = NULL;
+		}
+#endif
+	}
+
+private:
+	GLuint colorBuffer = 0;
+	GLuint depthStencilBuffer = 0;
+#if HEADLESS_CONTEXT_EGL
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+#else
+	GLFWwindow* window = NULL;
+#endif
+};
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+// Timestamped input events, collected by the window callbacks and consumed by the fixed-rate simulation
+
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <deque>
+
+enum InputEventType {
+	INPUT_KEY,
+	INPUT_CURSOR,
+	INPUT_SCROLL
+};
+
+struct InputEvent {
+	InputEventType Type;
+	// Time (seconds) the event was received
+	double Time;
+	// Key events
+	int Key;
+	int Action;
+	// Cursor/scroll offsets
+	float X;
+	float Y;
+};
+
+class InputQueue
+{
+public:
+	static const int MAX_KEYS = 512;
+
+	InputQueue()
+	{
+		for (int i = 0; i < MAX_KEYS; i++)
+			keysDown[i] = false;
+	}
+
+	void PushKey(double time, int key, int action)
+	{
+		InputEvent event = { INPUT_KEY, time, key, action, 0.0f, 0.0f };
+		events.push_back(event);
+	}
+
+	void PushCursor(double time, float xOffset, float yOffset)
+	{
+		InputEvent event = { INPUT_CURSOR, time, 0, 0, xOffset, yOffset };
+		events.push_back(event);
+	}
+
+	void PushScroll(double time, float yOffset)
+	{
+		InputEvent event = { INPUT_SCROLL, time, 0, 0, 0.0f, yOffset };
+		events.push_back(event);
+	}
+
+	// Pops every event received up to (and including) the given time, in order.
+	// Key events update the held key state before being passed to the handler.
+	template<typename Handler>
+	void Consume(double untilTime, Handler handler)
+	{
+		while (!events.empty() && events.front().Time <= untilTime)
+		{
+			InputEvent event = events.front();
+			events.pop_front();
+			if (event.Type == INPUT_KEY && event.Key >= 0 && event.Key < MAX_KEYS)
+				keysDown[event.Key] = event.Action != 0; // press or repeat
+			handler(event);
+		}
+	}
+
+	// Key state as of the last consumed event
+	bool IsKeyDown(int key) const
+	{
+		return key >= 0 && key < MAX_KEYS && keysDown[key];
+	}
+
+private:
+	std::deque<InputEvent> events;
+	bool keysDown[MAX_KEYS];
+};
+
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+
+// Fixed pool of worker threads running data-parallel loops. The calling thread takes part in the work
+// and is thread index 0, workers are 1..NumThreads()-1, so per-thread data can be indexed directly.
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <string>
+#include <Profiler.h>
+
+class JobSystem
+{
+public:
+	// Runs one batch [begin, end) of a parallel loop on the given thread index
+	typedef std::function<void(unsigned int begin, unsigned int end, unsigned int threadIndex)> BatchFunction;
+
+	// numWorkers extra threads besides the caller; by default one less than the number of hardware threads
+	JobSystem(int numWorkers = -1)
+	{
+		if (numWorkers < 0)
+			numWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		for (int i = 0; i < numWorkers; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i + 1));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeCondition.notify_all();
+		for (unsigned int i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	unsigned int NumThreads() const { return workers.size() + 1; }
+
+	// Splits [0, count) into batches of batchSize and runs them on all threads. Returns when every batch is done.
+	void ParallelFor(unsigned int count, unsigned int batchSize, const BatchFunction& function)
+	{
+		if (count == 0)
+			return;
+		batchSize = std::max(1u, batchSize);
+		// Not worth waking the workers for a single batch
+		if (workers.empty() || count <= batchSize)
+		{
+			function(0, count, 0);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &function;
+			jobCount = count;
+			jobBatchSize = batchSize;
+			numBatches = (count + batchSize - 1) / batchSize;
+			nextBatch = 0;
+			finishedWorkers = 0;
+			generation++;
+		}
+		wakeCondition.notify_all();
+
+		runBatches(0);
+
+		// Wait until every worker has been through this loop, so none of them can touch the job once we return
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCondition.wait(lock, [this] { return finishedWorkers == workers.size(); });
+		job = NULL;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	bool stopping = false;
+	unsigned int generation = 0;
+	unsigned int finishedWorkers = 0;
+
+	// Current loop
+	const BatchFunction* job = NULL;
+	unsigned int jobCount = 0;
+	unsigned int jobBatchSize = 1;
+	unsigned int numBatches = 0;
+	std::atomic<unsigned int> nextBatch{ 0 };
+
+	void runBatches(unsigned int threadIndex)
+	{
+		unsigned int batch;
+		while ((batch = nextBatch++) < numBatches)
+		{
+			PROFILE_ZONE("JobSystem::Batch");
+			unsigned int begin = batch * jobBatchSize;
+			unsigned int end = std::min(begin + jobBatchSize, jobCount);
+			(*job)(begin, end, threadIndex);
+		}
+	}
+
+	void workerLoop(unsigned int threadIndex)
+	{
+		PROFILE_THREAD_NAME("Worker " + std::to_string(threadIndex));
+		unsigned int seenGeneration = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+				if (stopping)
+					return;
+				seenGeneration = generation;
+			}
+			runBatches(threadIndex);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finishedWorkers++;
+			}
+			doneCondition.notify_all();
+		}
+	}
+};
+
+#endif
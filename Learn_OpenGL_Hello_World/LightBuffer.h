@@ -0,0 +1,111 @@
+#pragma once
+
+// Point lights for the lit shaders, packed into a texture buffer (samplerBuffer pointLightData) so their
+// number isn't fixed at compile time. Four RGBA32F texels per light:
+//   0: position, radius    1: ambient, constant    2: diffuse, linear    3: specular, quadratic
+
+#ifndef LIGHT_BUFFER_H
+#define LIGHT_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <SceneComponents.h>
+
+// Distance at which a light's attenuated brightness drops below 5/256; lighting is cut off there, which is
+// what lets light volumes be finite. intensityScale is any extra factor the shader applies (the flashlight's).
+inline float lightAttenuationRadius(const LightComponent& light, float intensityScale = 1.0f)
+{
+	glm::vec3 diffuse = light.Color * light.DiffuseIntensity;
+	float brightest = std::max(std::max(diffuse.x, diffuse.y), diffuse.z);
+	brightest = std::max(brightest, std::max(std::max(light.SpecularIntensity.x, light.SpecularIntensity.y), light.SpecularIntensity.z));
+	brightest *= intensityScale;
+	// Solve quadratic * d^2 + linear * d + constant = brightest * 256 / 5
+	float c = light.Constant - brightest * 256.0f / 5.0f;
+	if (c >= 0.0f)
+		return 0.0f;
+	if (light.Quadratic > 0.0f)
+		return (-light.Linear + std::sqrt(light.Linear * light.Linear - 4.0f * light.Quadratic * c)) / (2.0f * light.Quadratic);
+	if (light.Linear > 0.0f)
+		return -c / light.Linear;
+	return 1000.0f;
+}
+
+class PointLightBuffer
+{
+public:
+	static const unsigned int TEXELS_PER_LIGHT = 4;
+
+	void Init()
+	{
+		glGenBuffers(1, &buffer);
+		glGenTextures(1, &texture);
+	}
+
+	void Release()
+	{
+		glDeleteBuffers(1, &buffer);
+		glDeleteTextures(1, &texture);
+		buffer = texture = 0;
+		capacity = 0;
+	}
+
+	void Clear()
+	{
+		texels.clear();
+		shadowedLight = -1;
+	}
+
+	void Add(const LightComponent& light)
+	{
+		if (light.CastsShadows && shadowedLight < 0)
+			shadowedLight = Count();
+		glm::vec3 diffuse = light.Color * light.DiffuseIntensity;
+		texels.push_back(glm::vec4(light.Position, lightAttenuationRadius(light)));
+		texels.push_back(glm::vec4(diffuse * light.AmbientIntensity, light.Constant));
+		texels.push_back(glm::vec4(diffuse, light.Linear));
+		texels.push_back(glm::vec4(light.SpecularIntensity, light.Quadratic));
+	}
+
+	unsigned int Count() const { return texels.size() / TEXELS_PER_LIGHT; }
+	// Index of the first light added that casts shadows (the one in the point shadow map), -1 for none
+	int ShadowedLight() const { return shadowedLight; }
+	// World space position and radius of light i
+	const glm::vec4& PositionRadius(unsigned int i) const { return texels[i * TEXELS_PER_LIGHT]; }
+
+	// Copies the lights added since Clear() to the GPU, growing the buffer if needed
+	void Upload()
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		unsigned int needed = std::max((unsigned int)texels.size(), (unsigned int)TEXELS_PER_LIGHT);
+		if (needed > capacity)
+		{
+			capacity = std::max(needed, capacity * 2);
+			glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, texture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+		if (!texels.empty())
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, texels.size() * sizeof(glm::vec4), texels.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void Bind(unsigned int unit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+private:
+	std::vector<glm::vec4> texels;
+	int shadowedLight = -1;
+	GLuint buffer = 0;
+	GLuint texture = 0;
+	unsigned int capacity = 0; // texels
+};
+
+#endif
@@ -0,0 +1,244 @@
+#pragma once
+
+// Clustered forward lighting: the view frustum is split into TILES_X x TILES_Y screen tiles and SLICES depth
+// slices spaced exponentially between the near and far planes. Each frame the point lights of a light buffer
+// are binned into the clusters their bounding sphere touches, and the lit shaders only loop over the lights
+// of their fragment's cluster. Two texture buffers hold the result:
+//   clusterLights (RG32UI):       offset into the index list and light count, per cluster
+//   clusterLightIndices (R32UI):  light buffer indices, grouped by cluster
+
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <LightBuffer.h>
+#include <JobSystem.h>
+#include <Shader.h>
+#include <Profiler.h>
+
+class LightClusterGrid
+{
+public:
+	static const unsigned int TILES_X = 16;
+	static const unsigned int TILES_Y = 9;
+	static const unsigned int SLICES = 24;
+	static const unsigned int NUM_CLUSTERS = TILES_X * TILES_Y * SLICES;
+	static const unsigned int LIGHT_BATCH_SIZE = 64; // lights binned per job batch
+
+	// Statistics of the last Build()
+	unsigned int NumIndices = 0;
+	unsigned int MaxLightsPerCluster = 0;
+
+	void Init()
+	{
+		glGenBuffers(1, &clusterBuffer);
+		glGenTextures(1, &clusterTexture);
+		glGenBuffers(1, &indexBuffer);
+		glGenTextures(1, &indexTexture);
+		glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, NUM_CLUSTERS * sizeof(glm::uvec2), NULL, GL_DYNAMIC_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, clusterBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void Release()
+	{
+		glDeleteBuffers(1, &clusterBuffer);
+		glDeleteTextures(1, &clusterTexture);
+		glDeleteBuffers(1, &indexBuffer);
+		glDeleteTextures(1, &indexTexture);
+		clusterBuffer = clusterTexture = indexBuffer = indexTexture = 0;
+		indexCapacity = 0;
+	}
+
+	// Bins the lights of the buffer for the given camera (a symmetric perspective projection). Batches of lights
+	// are binned in parallel, then merged in batch order so the lists are the same whatever the scheduling.
+	void Build(const PointLightBuffer& lights, const glm::mat4& view, const glm::mat4& projection, JobSystem& jobSystem)
+	{
+		PROFILE_ZONE("LightClusterGrid::Build");
+		updateBounds(projection);
+		unsigned int numLights = lights.Count();
+		unsigned int numBatches = (numLights + LIGHT_BATCH_SIZE - 1) / LIGHT_BATCH_SIZE;
+		if (batchEntries.size() < numBatches)
+			batchEntries.resize(numBatches);
+		jobSystem.ParallelFor(numLights, LIGHT_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int /*threadIndex*/) {
+			std::vector<Entry>& entries = batchEntries[begin / LIGHT_BATCH_SIZE];
+			entries.clear();
+			for (unsigned int i = begin; i < end; i++)
+				binLight(lights.PositionRadius(i), view, i, entries);
+		});
+
+		// Counting sort of the (cluster, light) entries into per-cluster lists
+		std::fill(counts.begin(), counts.end(), 0);
+		for (unsigned int b = 0; b < numBatches; b++)
+			for (unsigned int e = 0; e < batchEntries[b].size(); e++)
+				counts[batchEntries[b][e].Cluster]++;
+		NumIndices = 0;
+		MaxLightsPerCluster = 0;
+		for (unsigned int c = 0; c < NUM_CLUSTERS; c++)
+		{
+			clusters[c] = glm::uvec2(NumIndices, counts[c]);
+			NumIndices += counts[c];
+			MaxLightsPerCluster = std::max(MaxLightsPerCluster, counts[c]);
+		}
+		indices.resize(NumIndices);
+		for (unsigned int b = 0; b < numBatches; b++)
+			for (unsigned int e = 0; e < batchEntries[b].size(); e++)
+			{
+				const Entry& entry = batchEntries[b][e];
+				glm::uvec2& cluster = clusters[entry.Cluster];
+				indices[cluster.x + --counts[entry.Cluster]] = entry.Light;
+			}
+	}
+
+	void Upload()
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, NUM_CLUSTERS * sizeof(glm::uvec2), clusters.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+		unsigned int needed = std::max(NumIndices, 1u);
+		if (needed > indexCapacity)
+		{
+			indexCapacity = std::max(needed, indexCapacity * 2);
+			glBufferData(GL_TEXTURE_BUFFER, indexCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+		if (NumIndices > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, NumIndices * sizeof(unsigned int), indices.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// Binds the lists to two texture units and sets the lit shader's cluster uniforms. viewportWidth/Height
+	// is the size of the area rendered to (the tiles divide it evenly).
+	void Apply(Shader& shader, unsigned int clusterUnit, unsigned int indexUnit, int viewportWidth, int viewportHeight) const
+	{
+		glActiveTexture(GL_TEXTURE0 + clusterUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+		glActiveTexture(GL_TEXTURE0 + indexUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+		glActiveTexture(GL_TEXTURE0);
+		shader.setInt("clusterLights", clusterUnit);
+		shader.setInt("clusterLightIndices", indexUnit);
+		shader.setVec3("clusterGrid", glm::vec3(TILES_X, TILES_Y, SLICES));
+		shader.setVec2("clusterTileSize", glm::vec2((float)viewportWidth / TILES_X, (float)viewportHeight / TILES_Y));
+		// slice = log(depth / near) / log(far / near) * SLICES
+		float scale = SLICES / std::log(zFar / zNear);
+		shader.setVec2("clusterSliceScaleBias", glm::vec2(scale, -std::log(zNear) * scale));
+	}
+
+private:
+	struct Entry {
+		unsigned int Cluster;
+		unsigned int Light;
+	};
+
+	// View space bounds of every cluster, rebuilt when the projection changes
+	struct ClusterBounds {
+		glm::vec3 Min;
+		glm::vec3 Max;
+	};
+	std::vector<ClusterBounds> bounds = std::vector<ClusterBounds>(NUM_CLUSTERS);
+	glm::mat4 boundsProjection = glm::mat4(0.0f);
+	float zNear = 0.1f;
+	float zFar = 100.0f;
+	float sliceDepths[SLICES + 1];
+
+	std::vector<std::vector<Entry>> batchEntries;
+	std::vector<unsigned int> counts = std::vector<unsigned int>(NUM_CLUSTERS);
+	std::vector<glm::uvec2> clusters = std::vector<glm::uvec2>(NUM_CLUSTERS);
+	std::vector<unsigned int> indices;
+
+	GLuint clusterBuffer = 0;
+	GLuint clusterTexture = 0;
+	GLuint indexBuffer = 0;
+	GLuint indexTexture = 0;
+	unsigned int indexCapacity = 0;
+
+	void updateBounds(const glm::mat4& projection)
+	{
+		if (projection == boundsProjection)
+			return;
+		boundsProjection = projection;
+		zNear = projection[3][2] / (projection[2][2] - 1.0f);
+		zFar = projection[3][2] / (projection[2][2] + 1.0f);
+		for (unsigned int s = 0; s <= SLICES; s++)
+			sliceDepths[s] = zNear * std::pow(zFar / zNear, (float)s / SLICES);
+		for (unsigned int s = 0; s < SLICES; s++)
+			for (unsigned int y = 0; y < TILES_Y; y++)
+				for (unsigned int x = 0; x < TILES_X; x++)
+				{
+					// The tile's sides at the slice's near and far depth
+					glm::vec2 ndcMin(-1.0f + 2.0f * x / TILES_X, -1.0f + 2.0f * y / TILES_Y);
+					glm::vec2 ndcMax(-1.0f + 2.0f * (x + 1) / TILES_X, -1.0f + 2.0f * (y + 1) / TILES_Y);
+					glm::vec2 toView(1.0f / projection[0][0], 1.0f / projection[1][1]);
+					ClusterBounds& cluster = bounds[clusterIndex(x, y, s)];
+					cluster.Min = glm::vec3(glm::min(ndcMin * sliceDepths[s], ndcMin * sliceDepths[s + 1]) * toView, -sliceDepths[s + 1]);
+					cluster.Max = glm::vec3(glm::max(ndcMax * sliceDepths[s], ndcMax * sliceDepths[s + 1]) * toView, -sliceDepths[s]);
+				}
+	}
+
+	static unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int slice)
+	{
+		return (slice * TILES_Y + y) * TILES_X + x;
+	}
+
+	unsigned int sliceOf(float depth) const
+	{
+		if (depth <= zNear)
+			return 0;
+		int slice = (int)(std::log(depth / zNear) / std::log(zFar / zNear) * SLICES);
+		return (unsigned int)std::min(std::max(slice, 0), (int)SLICES - 1);
+	}
+
+	// Adds an entry for every cluster the light's sphere overlaps
+	void binLight(const glm::vec4& positionRadius, const glm::mat4& view, unsigned int light, std::vector<Entry>& entries) const
+	{
+		float radius = positionRadius.w;
+		if (radius <= 0.0f)
+			return;
+		glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(positionRadius), 1.0f));
+		float nearestDepth = -center.z - radius;
+		float furthestDepth = -center.z + radius;
+		if (furthestDepth < zNear || nearestDepth > zFar)
+			return;
+
+		// Screen tiles covered by the sphere's view space box, projected at its nearest depth (all tiles if
+		// it reaches past the near plane)
+		unsigned int minX = 0, maxX = TILES_X - 1, minY = 0, maxY = TILES_Y - 1;
+		if (nearestDepth > zNear)
+		{
+			glm::vec2 scale(boundsProjection[0][0], boundsProjection[1][1]);
+			glm::vec2 ndcMin = glm::min((glm::vec2(center) - radius) / nearestDepth, (glm::vec2(center) - radius) / furthestDepth) * scale;
+			glm::vec2 ndcMax = glm::max((glm::vec2(center) + radius) / nearestDepth, (glm::vec2(center) + radius) / furthestDepth) * scale;
+			if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+				return;
+			minX = (unsigned int)std::max(0, (int)std::floor((ndcMin.x * 0.5f + 0.5f) * TILES_X));
+			maxX = (unsigned int)std::min((int)TILES_X - 1, (int)std::floor((ndcMax.x * 0.5f + 0.5f) * TILES_X));
+			minY = (unsigned int)std::max(0, (int)std::floor((ndcMin.y * 0.5f + 0.5f) * TILES_Y));
+			maxY = (unsigned int)std::min((int)TILES_Y - 1, (int)std::floor((ndcMax.y * 0.5f + 0.5f) * TILES_Y));
+		}
+		unsigned int minSlice = sliceOf(nearestDepth), maxSlice = sliceOf(furthestDepth);
+		float radiusSquared = radius * radius;
+		for (unsigned int s = minSlice; s <= maxSlice; s++)
+			for (unsigned int y = minY; y <= maxY; y++)
+				for (unsigned int x = minX; x <= maxX; x++)
+				{
+					// Sphere against the cluster's box
+					unsigned int cluster = clusterIndex(x, y, s);
+					glm::vec3 closest = glm::clamp(center, bounds[cluster].Min, bounds[cluster].Max);
+					glm::vec3 offset = closest - center;
+					if (glm::dot(offset, offset) <= radiusSquared)
+						entries.push_back({ cluster, light });
+				}
+	}
+};
+
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+// Closed meshes bounding a light's reach, drawn for deferred shading: a unit sphere for point lights (scaled
+// by the radius) and a unit cone for spot lights (apex at the origin, opening along -z to a base of radius 1
+// at z = -1). Both are slightly larger than the shapes they stand for, so the flat faces never cut into them.
+
+#ifndef LIGHT_VOLUMES_H
+#define LIGHT_VOLUMES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+
+struct LightVolumeMesh {
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+	GLuint EBO = 0;
+	GLsizei Count = 0;
+
+	void Release()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+};
+
+// Positions at attribute 0, triangles wound counter-clockwise seen from outside
+inline LightVolumeMesh createLightVolumeMesh(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices)
+{
+	LightVolumeMesh mesh;
+	glGenVertexArrays(1, &mesh.VAO);
+	glGenBuffers(1, &mesh.VBO);
+	glGenBuffers(1, &mesh.EBO);
+	glBindVertexArray(mesh.VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mesh.Count = indices.size();
+	return mesh;
+}
+
+inline LightVolumeMesh createSphereVolume(unsigned int rings, unsigned int segments)
+{
+	const float PI = 3.14159265f;
+	// Pushed out so the faces between the vertices still enclose the unit sphere
+	float scale = 1.0f / (std::cos(PI / segments) * std::cos(PI / (2.0f * rings)));
+	std::vector<glm::vec3> vertices;
+	for (unsigned int r = 0; r <= rings; r++)
+	{
+		float theta = PI * r / rings;
+		for (unsigned int s = 0; s <= segments; s++)
+		{
+			float phi = 2.0f * PI * s / segments;
+			vertices.push_back(scale * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+		}
+	}
+	std::vector<unsigned int> indices;
+	for (unsigned int r = 0; r < rings; r++)
+	{
+		for (unsigned int s = 0; s < segments; s++)
+		{
+			unsigned int top = r * (segments + 1) + s;
+			unsigned int bottom = top + segments + 1;
+			indices.push_back(top);
+			indices.push_back(top + 1);
+			indices.push_back(bottom);
+			indices.push_back(top + 1);
+			indices.push_back(bottom + 1);
+			indices.push_back(bottom);
+		}
+	}
+	return createLightVolumeMesh(vertices, indices);
+}
+
+inline LightVolumeMesh createConeVolume(unsigned int segments)
+{
+	const float PI = 3.14159265f;
+	float scale = 1.0f / std::cos(PI / segments);
+	std::vector<glm::vec3> vertices;
+	vertices.push_back(glm::vec3(0.0f)); // apex
+	vertices.push_back(glm::vec3(0.0f, 0.0f, -1.0f)); // centre of the base
+	for (unsigned int s = 0; s < segments; s++)
+	{
+		float phi = 2.0f * PI * s / segments;
+		vertices.push_back(glm::vec3(scale * std::cos(phi), scale * std::sin(phi), -1.0f));
+	}
+	std::vector<unsigned int> indices;
+	for (unsigned int s = 0; s < segments; s++)
+	{
+		unsigned int current = 2 + s;
+		unsigned int next = 2 + (s + 1) % segments;
+		// Side
+		indices.push_back(0);
+		indices.push_back(current);
+		indices.push_back(next);
+		// Base
+		indices.push_back(1);
+		indices.push_back(next);
+		indices.push_back(current);
+	}
+	return createLightVolumeMesh(vertices, indices);
+}
+
+#endif
@@ -13,9 +13,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <assimp/scene.h>
 #include <string>
 #include <vector>
 #include <Shader.h>
+#include <Frustum.h>
+#include <RenderStats.h>
+#include <RenderQueue.h>
+#include <Profiler.h>
 using namespace std;
 
 struct Vertex {
@@ -40,20 +45,28 @@ public:
 	vector<Vertex> vertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
+	// Object space bounding box of the vertices, computed at import
+	AABB Bounds;
 
-	// Constructor: takes a vector of vertices and their corresponding indices and texture data vectors
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	// Constructor: takes a vector of vertices and their corresponding indices and texture data vectors.
+	// Without uploadToGpu only the CPU copy is kept (no GL context needed), for the software rasterizer.
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool uploadToGpu = true)
 	{
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
 
+		for (unsigned int i = 0; i < this->vertices.size(); i++)
+			Bounds.Expand(this->vertices[i].Position);
+
 		// Using the given parameters, set the OpenGL vertex buffers and attribute pointers
-		setupMesh();
+		if (uploadToGpu)
+			setupMesh();
 	}
 
 	void Draw(Shader shaderProgram) 
 	{
+		PROFILE_ZONE("Mesh::Draw");
 		unsigned int diffuseNum = 1;
 		unsigned int specularNum = 1;
 		for (unsigned int i = 0; i < textures.size(); i++)
@@ -76,13 +89,48 @@ public:
 		// draw mesh
 		glBindVertexArray(VAO);
 		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+		renderStats().CountDraw(indices.size());
 		glBindVertexArray(0);
 	}
 
+	// Records a draw of the mesh into the render queue instead of drawing it immediately
+	void Enqueue(RenderQueue& queue, unsigned int pass, GLuint program, const glm::mat4& modelMatrix, const glm::mat3& normalMatrix, bool outlined = false,
+		unsigned int layerMask = ~0u, unsigned int viewMask = ~0u)
+	{
+		// The mesh's textures are registered as a material the first time it is queued into each queue
+		if (materialId < 0 || materialQueue != &queue)
+		{
+			RenderMaterial material;
+			unsigned int diffuseNum = 1;
+			unsigned int specularNum = 1;
+			for (unsigned int i = 0; i < textures.size(); i++)
+			{
+				string name = textures[i].type;
+				string number;
+				if (name == "texture_diffuse")
+					number = to_string(diffuseNum++);
+				else if (name == "texture_specular")
+					number = to_string(specularNum++);
+				material.AddTexture(textures[i].id, i, name + number);
+			}
+			materialId = queue.RegisterMaterial(material);
+			materialQueue = &queue;
+		}
+		DrawCommand command = { program, VAO, (unsigned int)materialId, GL_TRIANGLES, (GLsizei)indices.size(), true, modelMatrix, normalMatrix };
+		command.Outlined = outlined;
+		command.LayerMask = layerMask;
+		command.ViewMask = viewMask;
+		queue.Enqueue(pass, command, glm::vec3(modelMatrix * glm::vec4(Bounds.Center(), 1.0f)));
+	}
+
 private:
 
+	// Material id in the render queue it was last queued into, -1 until first queued
+	int materialId = -1;
+	const RenderQueue* materialQueue = NULL;
+
 	// Render data
-	unsigned int VAO, VBO, EBO;
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
 
 	// Functions
 	void setupMesh() 
@@ -21,18 +21,33 @@
 #include <vector>
 #include <Shader.h>
 #include <Mesh.h>
+#include <Frustum.h>
+#include <RenderQueue.h>
+#include <SceneGraph.h>
+#include <Profiler.h>
 using namespace std;
 
 class Model
 {
 public:
 
-	// Constructor
-	Model(char* path)
+	// Object space bounding box enclosing all of the model's meshes
+	AABB Bounds;
+
+	// Constructor. Without uploadToGpu the meshes and textures stay on the CPU and no GL context is needed:
+	// texture ids are 0, the software rasterizer loads the images from TexturePath().
+	Model(char* path, bool uploadToGpu = true) : uploadToGpu(uploadToGpu)
 	{
 		loadModel(path);
 	}
 
+	unsigned int NumMeshes() const { return meshes.size(); }
+	const Mesh& GetMesh(unsigned int i) const { return meshes[i]; }
+	// Transform of a mesh relative to the model's root
+	const glm::mat4& MeshTransform(unsigned int i) const { return meshTransforms[i]; }
+	// File of one of the meshes' textures
+	string TexturePath(const Texture& texture) const { return directory + '/' + texture.path.C_Str(); }
+
 	// Draw all the model's meshes
 	void Draw(Shader shaderProgram)
 	{
@@ -40,16 +55,79 @@ public:
 			meshes[i].Draw(shaderProgram);
 	}
 
+	// Adds the model's node hierarchy under the given scene node, returns the scene node of the model's root.
+	// The model's nodes are added contiguously, in import order.
+	unsigned int Instantiate(SceneGraph& sceneGraph, unsigned int parent) const
+	{
+		unsigned int firstNode = sceneGraph.Size();
+		for (unsigned int i = 0; i < this->nodes.size(); i++)
+		{
+			unsigned int nodeParent = nodes[i].Parent < 0 ? parent : firstNode + nodes[i].Parent;
+			sceneGraph.AddNode(nodes[i].Transform, nodeParent, nodes[i].Name);
+		}
+		return firstNode;
+	}
+
+	// Adds every mesh's world space bounding box to the culling batch, returns the batch index of the first mesh
+	unsigned int AddToCullingBatch(CullingBatch& batch, const SceneGraph& sceneGraph, unsigned int firstNode) const
+	{
+		unsigned int firstIndex = batch.Size();
+		for (unsigned int i = 0; i < this->meshes.size(); i++)
+			batch.Add(meshes[i].Bounds.Transform(sceneGraph.GetWorldTransform(firstNode + meshNodes[i])));
+		return firstIndex;
+	}
+
+	// Queue draws of only the meshes that passed the batch's last Cull(), marked for the outline if outlined and
+	// tagged with the views each mesh is visible in
+	void Enqueue(RenderQueue& queue, unsigned int pass, GLuint program, const SceneGraph& sceneGraph, unsigned int firstNode,
+		const CullingBatch& batch, unsigned int firstIndex, bool outlined = false)
+	{
+		for (unsigned int i = 0; i < this->meshes.size(); i++)
+		{
+			if (!batch.IsVisible(firstIndex + i))
+				continue;
+			const glm::mat4& modelMatrix = sceneGraph.GetWorldTransform(firstNode + meshNodes[i]);
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+			meshes[i].Enqueue(queue, pass, program, modelMatrix, normalMatrix, outlined, ~0u, batch.ViewMask(firstIndex + i));
+		}
+	}
+
+	// Same for drawing into a layered target: layerMasks has the layers each culling batch entry touches, 0 if culled
+	void EnqueueLayered(RenderQueue& queue, unsigned int pass, GLuint program, const SceneGraph& sceneGraph, unsigned int firstNode,
+		const std::vector<unsigned char>& layerMasks, unsigned int firstIndex)
+	{
+		for (unsigned int i = 0; i < this->meshes.size(); i++)
+		{
+			unsigned int layerMask = layerMasks[firstIndex + i];
+			if (layerMask == 0)
+				continue;
+			const glm::mat4& modelMatrix = sceneGraph.GetWorldTransform(firstNode + meshNodes[i]);
+			meshes[i].Enqueue(queue, pass, program, modelMatrix, glm::mat3(1.0f), false, layerMask);
+		}
+	}
+
 private:
 
+	// Node of the imported hierarchy, parents come before their children
+	struct ModelNode {
+		string Name;
+		glm::mat4 Transform; // relative to the parent node
+		int Parent; // -1 for the root
+	};
+
 	// Model Data 
 	vector<Mesh> meshes; 
+	vector<unsigned int> meshNodes; // node each mesh belongs to
+	vector<glm::mat4> meshTransforms; // relative to the root
+	vector<ModelNode> nodes;
 	string directory;
 	vector<Texture> textures_loaded;
+	bool uploadToGpu;
 
 	// Import model into memory using assimp
 	void loadModel(string path)
 	{
+		PROFILE_ZONE("Model::loadModel");
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 		
@@ -59,22 +137,40 @@ private:
 			return;
 		}
 		directory = path.substr(0, path.find_last_of('/'));
-		processNode(scene->mRootNode, scene);
+		processNode(scene->mRootNode, scene, -1);
+
+		// Bounds in model space: each mesh's bounds moved by its node's transform relative to the root
+		vector<glm::mat4> modelSpaceTransforms(nodes.size());
+		for (unsigned int i = 0; i < nodes.size(); i++)
+			modelSpaceTransforms[i] = nodes[i].Parent < 0 ? nodes[i].Transform : modelSpaceTransforms[nodes[i].Parent] * nodes[i].Transform;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			meshTransforms.push_back(modelSpaceTransforms[meshNodes[i]]);
+			Bounds.Expand(meshes[i].Bounds.Transform(meshTransforms[i]));
+		}
 	}
 
 	// Recursively process assimp mesh nodes, then their children
-	void processNode(aiNode* node, const aiScene* scene)
+	void processNode(aiNode* node, const aiScene* scene, int parent)
 	{
+		// keep the node's transform relative to its parent (aiMatrix4x4 is row-major)
+		ModelNode modelNode;
+		modelNode.Name = node->mName.C_Str();
+		modelNode.Transform = glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+		modelNode.Parent = parent;
+		int nodeIndex = nodes.size();
+		nodes.push_back(modelNode);
 		// process all of this nodes meshes
 		for (unsigned int i = 0; i < node->mNumMeshes; i++)
 		{
 			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
 			meshes.push_back(processMesh(mesh, scene));
+			meshNodes.push_back(nodeIndex);
 		}
 		// then do the same for each of its children
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
 		{
-			processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, nodeIndex);
 		}
 	}
 
@@ -134,7 +230,7 @@ private:
 			vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
 			meshTextures.insert(meshTextures.end(), specularMaps.begin(), specularMaps.end());
 		}
-		return Mesh(meshVertices, meshIndices, meshTextures);
+		return Mesh(meshVertices, meshIndices, meshTextures, uploadToGpu);
 	}
 
 	// Loads textures if they're not loaded yet. Data is returned as a Texture struct.
@@ -158,7 +254,7 @@ private:
 			if (!skip)
 			{ // Only load if texture hasnt been loaded already
 				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), directory);
+				texture.id = uploadToGpu ? TextureFromFile(str.C_Str(), directory) : 0;
 				texture.type = typeName;
 				texture.path = str;
 				textures.push_back(texture);
@@ -170,6 +266,7 @@ private:
 
 	unsigned int TextureFromFile(const char* path, const string& directory)
 	{
+		PROFILE_ZONE("Model::TextureFromFile");
 		string filepath = string(path);
 		filepath = directory + '/' + filepath;
 
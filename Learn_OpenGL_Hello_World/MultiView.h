@@ -0,0 +1,196 @@
+#pragma once
+
+// Several viewpoints of the scene rendered in one frame, side by side in the scene target: split-screen with an
+// overview camera, a stereo pair, or a large detail view next to an overview strip.
+//
+// Culling and draw recording run once for all of them. Cull() tests the shared culling batch against every view
+// and leaves the views each object is in as a bit mask (CullingBatch::ViewMasks), which the render queue's draws
+// carry; each view's submission then skips the draws it can't see (RenderQueue::SetViews()).
+//
+// A stereo pair can be drawn in a single pass instead: every draw is instanced twice, and the vertex shaders use
+// gl_InstanceID to pick the eye's matrices and squeeze the eye into its half of the target, clipping at the middle
+// with gl_ClipDistance[0]. Both eyes are culled together against one frustum holding both of theirs.
+
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <camera.h>
+#include <Frustum.h>
+#include <FrameContext.h>
+#include <StreamBuffer.h>
+
+enum ViewLayout {
+	VIEW_LAYOUT_SINGLE, // the camera, full size
+	VIEW_LAYOUT_SPLIT, // the camera and the overview camera, a half each
+	VIEW_LAYOUT_STEREO, // left and right eye of the camera, a half each
+	VIEW_LAYOUT_OVERVIEW // the camera on two thirds, the overview camera on the last third
+};
+
+// Parses "single", "split", "stereo" or "overview", leaving the layout unchanged otherwise
+inline bool parseViewLayout(const std::string& text, ViewLayout& layout)
+{
+	if (text == "single")
+		layout = VIEW_LAYOUT_SINGLE;
+	else if (text == "split")
+		layout = VIEW_LAYOUT_SPLIT;
+	else if (text == "stereo")
+		layout = VIEW_LAYOUT_STEREO;
+	else if (text == "overview")
+		layout = VIEW_LAYOUT_OVERVIEW;
+	else
+		return false;
+	return true;
+}
+
+// A viewpoint of the frame
+struct RenderView {
+	std::string Name;
+	// Placement in the scene target as fractions of its size: x, y, width, height
+	glm::vec4 Rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	FrameContext Frame;
+	// The view's ViewUniforms block, streamed by the caller each frame
+	StreamBuffer::Allocation Uniforms;
+	// Counted by the caller over the frame's scene passes: CPU time spent submitting the view's draws, and the draws
+	double SubmitMilliseconds = 0.0;
+	unsigned int Draws = 0;
+
+	// Camera the frame is taken from
+	Camera ViewCamera;
+};
+
+class ViewSet
+{
+public:
+	// View mask bits per culling batch entry
+	static const unsigned int MAX_VIEWS = 8;
+
+	// Settings, read by Init() and Update()
+	ViewLayout Layout = VIEW_LAYOUT_SINGLE;
+	// Distance between the eyes of the stereo pair
+	float EyeSeparation = 0.065f;
+	// Draw the stereo pair in one instanced pass, instead of one pass per eye
+	bool InstancedStereo = true;
+	// Fixed camera looking down over the scene
+	glm::vec3 OverviewPosition = glm::vec3(0.0f, 45.0f, -12.0f);
+	float OverviewZoom = 60.0f;
+
+	std::vector<RenderView> Views;
+
+	void Init()
+	{
+		Views.clear();
+		switch (Layout)
+		{
+		case VIEW_LAYOUT_SINGLE:
+			addView("View", glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+			break;
+		case VIEW_LAYOUT_SPLIT:
+			addView("View Camera", glm::vec4(0.0f, 0.0f, 0.5f, 1.0f));
+			addView("View Overview", glm::vec4(0.5f, 0.0f, 0.5f, 1.0f));
+			break;
+		case VIEW_LAYOUT_STEREO:
+			addView("View Left", glm::vec4(0.0f, 0.0f, 0.5f, 1.0f));
+			addView("View Right", glm::vec4(0.5f, 0.0f, 0.5f, 1.0f));
+			break;
+		case VIEW_LAYOUT_OVERVIEW:
+			addView("View Detail", glm::vec4(0.0f, 0.0f, 2.0f / 3.0f, 1.0f));
+			addView("View Overview", glm::vec4(2.0f / 3.0f, 0.0f, 1.0f / 3.0f, 1.0f));
+			break;
+		}
+	}
+
+	unsigned int Count() const { return Views.size(); }
+	bool MultipleViews() const { return Views.size() > 1; }
+	// Both eyes drawn by one instanced submission
+	bool SinglePassStereo() const { return Layout == VIEW_LAYOUT_STEREO && InstancedStereo; }
+	// Submissions of each scene pass: one per view, or one for both eyes with single-pass stereo. Their cost is
+	// counted in the first view of each.
+	unsigned int Submissions() const { return SinglePassStereo() ? 1 : Views.size(); }
+	// Name of a submission in the frame stats and GPU profile
+	std::string SubmissionName(unsigned int index) const { return SinglePassStereo() ? "View Stereo" : Views[index].Name; }
+	// View mask with every view's bit
+	unsigned int AllViews() const { return (1u << Views.size()) - 1; }
+
+	// Places the views for this frame from the camera; targetWidth x targetHeight is the size the views share
+	void Update(const Camera& camera, float time, float deltaTime, unsigned int targetWidth, unsigned int targetHeight)
+	{
+		for (unsigned int v = 0; v < Views.size(); v++)
+		{
+			RenderView& view = Views[v];
+			glm::vec3 position = camera.Position;
+			float yaw = camera.Yaw, pitch = camera.Pitch, zoom = camera.Zoom;
+			if (Layout == VIEW_LAYOUT_STEREO)
+				position += camera.Right * EyeSeparation * (v == 0 ? -0.5f : 0.5f);
+			else if (v > 0)
+			{
+				// Straight down (just short of it, so the camera's right vector stays defined)
+				position = OverviewPosition;
+				yaw = -90.0f;
+				pitch = -89.5f;
+				zoom = OverviewZoom;
+			}
+			view.ViewCamera.SetPose(position, yaw, pitch, zoom);
+			unsigned int width = std::max(1u, (unsigned int)(view.Rect.z * targetWidth));
+			unsigned int height = std::max(1u, (unsigned int)(view.Rect.w * targetHeight));
+			view.Frame.Update(view.ViewCamera, time, deltaTime, width, height);
+			view.SubmitMilliseconds = 0.0;
+			view.Draws = 0;
+		}
+	}
+
+	// Culls the batch for every view, leaving the views each object is in in its ViewMasks. The stereo pair is
+	// culled once, against the frustum holding both eyes'.
+	void Cull(CullingBatch& batch, float minPixelSize)
+	{
+		if (Layout == VIEW_LAYOUT_STEREO)
+		{
+			const FrameContext& left = Views[0].Frame;
+			batch.Cull(StereoFrustum(), left.CameraPosition, left.Projection[1][1], (float)left.ViewportHeight, minPixelSize);
+			batch.StoreView(0);
+			batch.StoreView(1);
+			return;
+		}
+		for (unsigned int v = 0; v < Views.size(); v++)
+		{
+			const FrameContext& frame = Views[v].Frame;
+			batch.Cull(frame.ViewFrustum, frame.CameraPosition, frame.Projection[1][1], (float)frame.ViewportHeight, minPixelSize);
+			batch.StoreView(v);
+		}
+		batch.MergeViews();
+	}
+
+	// Frustum around both eyes of the stereo pair: the eyes look the same way and are offset along their right
+	// vector, so their top, bottom, near and far planes are the same planes. The left eye's left plane and the
+	// right eye's right plane close it (taking in a sliver in front of the eyes that neither sees).
+	Frustum StereoFrustum() const
+	{
+		Frustum frustum = Views[0].Frame.ViewFrustum;
+		frustum.Planes[1] = Views[1].Frame.ViewFrustum.Planes[1];
+		return frustum;
+	}
+
+	// Sets the viewport to the view's part of a targetWidth x targetHeight target
+	static void SetViewport(const RenderView& view, int targetWidth, int targetHeight)
+	{
+		glViewport((GLint)(view.Rect.x * targetWidth), (GLint)(view.Rect.y * targetHeight),
+			std::max(1, (int)(view.Rect.z * targetWidth)), std::max(1, (int)(view.Rect.w * targetHeight)));
+	}
+
+private:
+	void addView(const std::string& name, const glm::vec4& rect)
+	{
+		if (Views.size() >= MAX_VIEWS)
+			return;
+		RenderView view;
+		view.Name = name;
+		view.Rect = rect;
+		Views.push_back(view);
+	}
+};
+
+#endif
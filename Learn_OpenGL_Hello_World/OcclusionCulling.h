@@ -0,0 +1,359 @@
+#pragma once
+
+// Software occlusion culling. A few simplified occluders (boxes placed inside solid objects) are rasterized
+// on the CPU into a small depth buffer, and each 8x8 tile of it also keeps the farthest depth it holds (a
+// one-level hierarchical depth buffer). Objects that survived frustum culling are then tested with the screen
+// rectangle and nearest depth of their world space box: an object is hidden when every tile under the
+// rectangle, or failing that every pixel, holds an occluder nearer than the box. Each worker thread
+// rasterizes one row of tiles at a time, 8 pixels at once with AVX2 (4 with SSE, otherwise 1).
+//
+// Occluders are sampled at pixel centres, so an object peeking out less than a buffer pixel past an
+// occluder's silhouette can be culled.
+
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <Frustum.h>
+#include <JobSystem.h>
+#include <Profiler.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_SIMD_WIDTH 8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SIMD_WIDTH 4
+#else
+#define OCCLUSION_SIMD_WIDTH 1
+#endif
+
+class OcclusionCuller
+{
+public:
+	// Depth buffer size, whatever the viewport's (a multiple of TILE_SIZE and of the SIMD width)
+	static const int WIDTH = 320;
+	static const int HEIGHT = 192;
+	static const int TILE_SIZE = 8;
+	static const int TILES_X = WIDTH / TILE_SIZE;
+	static const int TILES_Y = HEIGHT / TILE_SIZE;
+
+	// Occluders rasterized per frame: the ones that look largest from the camera
+	unsigned int MaxOccluders = 64;
+	// Depth tolerance of the visibility test, so an occluder never hides its own bounds
+	float DepthBias = 1.0e-5f;
+
+	// Statistics of the last frame
+	unsigned int NumOccluders = 0;
+	unsigned int NumTriangles = 0;
+	unsigned int NumOccluded = 0;
+
+	OcclusionCuller() : depth(WIDTH * HEIGHT, 1.0f), tileMax(TILES_X * TILES_Y, 1.0f) {}
+
+	// Starts a frame: forgets the last frame's occluders
+	void Begin(const glm::mat4& viewProj, const glm::vec3& cameraPosition)
+	{
+		this->viewProj = viewProj;
+		this->cameraPosition = cameraPosition;
+		occluders.clear();
+	}
+
+	// Adds a box occluder in object space with its object's world transform. The box must lie entirely inside
+	// the object's solid geometry, or objects seen past it would be culled.
+	void AddOccluder(const AABB& box, const glm::mat4& world)
+	{
+		Occluder occluder;
+		occluder.Box = box;
+		occluder.World = world;
+		AABB worldBox = box.Transform(world);
+		glm::vec3 toCamera = worldBox.Center() - cameraPosition;
+		// Squared size on screen, roughly
+		occluder.Score = glm::dot(worldBox.Extents(), worldBox.Extents()) / std::max(glm::dot(toCamera, toCamera), 1.0e-4f);
+		occluders.push_back(occluder);
+	}
+
+	// Rasterizes the largest MaxOccluders occluders into the depth buffer, a row of tiles per job
+	void Rasterize(JobSystem& jobSystem)
+	{
+		PROFILE_ZONE("OcclusionCuller::Rasterize");
+		if (occluders.size() > MaxOccluders)
+		{
+			std::nth_element(occluders.begin(), occluders.begin() + MaxOccluders, occluders.end(),
+				[](const Occluder& a, const Occluder& b) { return a.Score > b.Score; });
+			occluders.resize(MaxOccluders);
+		}
+		NumOccluders = occluders.size();
+		triangles.clear();
+		for (unsigned int i = 0; i < occluders.size(); i++)
+			setupBox(occluders[i]);
+		NumTriangles = triangles.size();
+
+		jobSystem.ParallelFor(TILES_Y, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int tileRow = begin; tileRow < end; tileRow++)
+				rasterizeTileRow(tileRow);
+		});
+	}
+
+	// Hides the objects of the batch that passed frustum culling but are behind the occluders
+	void Cull(CullingBatch& batch, JobSystem& jobSystem)
+	{
+		PROFILE_ZONE("OcclusionCuller::Cull");
+		unsigned int visibleBefore = batch.NumVisible;
+		jobSystem.ParallelFor(batch.Size(), 256, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int i = begin; i < end; i++)
+			{
+				if (batch.Visible[i] && !IsVisible(batch.Box(i)))
+					batch.Visible[i] = 0;
+			}
+		});
+		batch.NumVisible = 0;
+		for (unsigned int i = 0; i < batch.Size(); i++)
+			batch.NumVisible += batch.Visible[i];
+		batch.NumCulled = batch.Size() - batch.NumVisible;
+		NumOccluded = visibleBefore - batch.NumVisible;
+	}
+
+	// Tests a world space box against the depth buffer of the last Rasterize()
+	bool IsVisible(const AABB& box) const
+	{
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 position((corner & 1) ? box.Max.x : box.Min.x, (corner & 2) ? box.Max.y : box.Min.y, (corner & 4) ? box.Max.z : box.Min.z);
+			glm::vec4 clip = viewProj * glm::vec4(position, 1.0f);
+			// Reaches the camera plane: can't be behind anything
+			if (clip.w <= NEAR_W)
+				return true;
+			glm::vec3 screen = toScreen(clip);
+			minX = std::min(minX, screen.x);
+			maxX = std::max(maxX, screen.x);
+			minY = std::min(minY, screen.y);
+			maxY = std::max(maxY, screen.y);
+			minZ = std::min(minZ, screen.z);
+		}
+		// Every pixel the rectangle touches
+		int x0 = (int)std::max(std::floor(minX), 0.0f), x1 = (int)std::min(std::floor(maxX), (float)(WIDTH - 1));
+		int y0 = (int)std::max(std::floor(minY), 0.0f), y1 = (int)std::min(std::floor(maxY), (float)(HEIGHT - 1));
+		if (x0 > x1 || y0 > y1)
+			return true;
+		float nearest = minZ - DepthBias;
+		for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++)
+		{
+			for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++)
+			{
+				// The whole tile is in front of the box
+				if (tileMax[ty * TILES_X + tx] < nearest)
+					continue;
+				int px0 = std::max(x0, tx * TILE_SIZE), px1 = std::min(x1, tx * TILE_SIZE + TILE_SIZE - 1);
+				int py0 = std::max(y0, ty * TILE_SIZE), py1 = std::min(y1, ty * TILE_SIZE + TILE_SIZE - 1);
+				for (int y = py0; y <= py1; y++)
+				{
+					for (int x = px0; x <= px1; x++)
+					{
+						if (depth[y * WIDTH + x] >= nearest)
+							return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	// Depth at a buffer pixel (0 near, 1 far or empty), row 0 at the bottom
+	float Depth(int x, int y) const { return depth[y * WIDTH + x]; }
+
+private:
+	// Boxes reaching closer to the camera plane than this w are treated as visible
+	static constexpr float NEAR_W = 1.0e-3f;
+
+	struct Occluder {
+		AABB Box;
+		glm::mat4 World;
+		float Score;
+	};
+
+	// Screen space triangle: inside where all three edge functions A * x + B * y + C are >= 0, depth is
+	// ZA * x + ZB * y + ZC
+	struct Triangle {
+		float EdgeA[3], EdgeB[3], EdgeC[3];
+		float ZA, ZB, ZC;
+		int MinX, MaxX, MinY, MaxY; // pixels whose centres may be covered
+	};
+
+	glm::mat4 viewProj = glm::mat4(1.0f);
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	std::vector<Occluder> occluders;
+	std::vector<Triangle> triangles;
+	std::vector<float> depth;
+	std::vector<float> tileMax;
+
+	// Pixel coordinates and [0, 1] depth of a clip space position
+	static glm::vec3 toScreen(const glm::vec4& clip)
+	{
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		return glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+	}
+
+	// Clips the box's front facing triangles against the near plane and sets them up for rasterizing
+	void setupBox(const Occluder& occluder)
+	{
+		// Corner i has x from bit 0, y from bit 1, z from bit 2; triangles wind counterclockwise seen from outside
+		static const int BOX_INDICES[36] = {
+			0, 4, 6, 0, 6, 2,  1, 3, 7, 1, 7, 5, // -x, +x
+			0, 1, 5, 0, 5, 4,  2, 6, 7, 2, 7, 3, // -y, +y
+			0, 2, 3, 0, 3, 1,  4, 5, 7, 4, 7, 6  // -z, +z
+		};
+		glm::mat4 toClip = viewProj * occluder.World;
+		// A mirroring transform turns the winding around
+		bool mirrored = glm::determinant(glm::mat3(occluder.World)) < 0.0f;
+		glm::vec4 corners[8];
+		for (int corner = 0; corner < 8; corner++)
+		{
+			const AABB& box = occluder.Box;
+			glm::vec3 position((corner & 1) ? box.Max.x : box.Min.x, (corner & 2) ? box.Max.y : box.Min.y, (corner & 4) ? box.Max.z : box.Min.z);
+			corners[corner] = toClip * glm::vec4(position, 1.0f);
+		}
+		for (int i = 0; i < 36; i += 3)
+		{
+			glm::vec4 polygon[4];
+			int count = clipNear(corners[BOX_INDICES[i]], corners[BOX_INDICES[i + (mirrored ? 2 : 1)]], corners[BOX_INDICES[i + (mirrored ? 1 : 2)]], polygon);
+			for (int v = 1; v + 1 < count; v++)
+				setupTriangle(toScreen(polygon[0]), toScreen(polygon[v]), toScreen(polygon[v + 1]));
+		}
+	}
+
+	// Clips a triangle to z >= -w (the near plane). Returns the polygon's vertex count.
+	static int clipNear(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, glm::vec4* out)
+	{
+		const glm::vec4 input[3] = { a, b, c };
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& current = input[i];
+			const glm::vec4& next = input[(i + 1) % 3];
+			float currentDistance = current.z + current.w;
+			float nextDistance = next.z + next.w;
+			if (currentDistance >= 0.0f)
+				out[count++] = current;
+			if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+				out[count++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+		}
+		return count;
+	}
+
+	void setupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+	{
+		// Twice the signed area, positive for front faces (counterclockwise with y up)
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (!(area > 0.0f))
+			return;
+		Triangle triangle;
+		const glm::vec3* vertices[3] = { &v0, &v1, &v2 };
+		for (int e = 0; e < 3; e++)
+		{
+			const glm::vec3& from = *vertices[e];
+			const glm::vec3& to = *vertices[(e + 1) % 3];
+			triangle.EdgeA[e] = from.y - to.y;
+			triangle.EdgeB[e] = to.x - from.x;
+			triangle.EdgeC[e] = -(triangle.EdgeA[e] * from.x + triangle.EdgeB[e] * from.y);
+		}
+		triangle.ZA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+		triangle.ZB = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+		triangle.ZC = v0.z - triangle.ZA * v0.x - triangle.ZB * v0.y;
+		// Pixel centres are at + 0.5
+		float minX = std::min(std::min(v0.x, v1.x), v2.x) - 0.5f, maxX = std::max(std::max(v0.x, v1.x), v2.x) - 0.5f;
+		float minY = std::min(std::min(v0.y, v1.y), v2.y) - 0.5f, maxY = std::max(std::max(v0.y, v1.y), v2.y) - 0.5f;
+		triangle.MinX = (int)std::ceil(glm::clamp(minX, 0.0f, (float)WIDTH));
+		triangle.MaxX = (int)std::floor(glm::clamp(maxX, -1.0f, (float)(WIDTH - 1)));
+		triangle.MinY = (int)std::ceil(glm::clamp(minY, 0.0f, (float)HEIGHT));
+		triangle.MaxY = (int)std::floor(glm::clamp(maxY, -1.0f, (float)(HEIGHT - 1)));
+		if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+			return;
+		triangles.push_back(triangle);
+	}
+
+	// Clears, rasterizes and reduces one row of tiles
+	void rasterizeTileRow(unsigned int tileRow)
+	{
+		int rowBegin = tileRow * TILE_SIZE, rowEnd = rowBegin + TILE_SIZE;
+		std::fill(depth.begin() + rowBegin * WIDTH, depth.begin() + rowEnd * WIDTH, 1.0f);
+		for (unsigned int t = 0; t < triangles.size(); t++)
+		{
+			const Triangle& triangle = triangles[t];
+			int y0 = std::max(triangle.MinY, rowBegin), y1 = std::min(triangle.MaxY, rowEnd - 1);
+			// SIMD batches start on a multiple of the width
+			int x0 = triangle.MinX / OCCLUSION_SIMD_WIDTH * OCCLUSION_SIMD_WIDTH;
+			for (int y = y0; y <= y1; y++)
+				rasterizeSpan(triangle, y, x0, triangle.MaxX);
+		}
+		for (int tx = 0; tx < TILES_X; tx++)
+		{
+			float farthest = 0.0f;
+			for (int y = rowBegin; y < rowEnd; y++)
+			{
+				for (int x = tx * TILE_SIZE; x < (tx + 1) * TILE_SIZE; x++)
+					farthest = std::max(farthest, depth[y * WIDTH + x]);
+			}
+			tileMax[tileRow * TILES_X + tx] = farthest;
+		}
+	}
+
+	// Keeps the nearer depth at the covered pixel centres of row y from x0 to x1
+	void rasterizeSpan(const Triangle& triangle, int y, int x0, int x1)
+	{
+		float centerY = y + 0.5f;
+		float rowEdge[3];
+		for (int e = 0; e < 3; e++)
+			rowEdge[e] = triangle.EdgeB[e] * centerY + triangle.EdgeC[e];
+		float rowZ = triangle.ZB * centerY + triangle.ZC;
+		float* row = &depth[y * WIDTH];
+#if OCCLUSION_SIMD_WIDTH == 8
+		__m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256 zero = _mm256_setzero_ps();
+		__m256 a0 = _mm256_set1_ps(triangle.EdgeA[0]), a1 = _mm256_set1_ps(triangle.EdgeA[1]), a2 = _mm256_set1_ps(triangle.EdgeA[2]);
+		__m256 c0 = _mm256_set1_ps(rowEdge[0]), c1 = _mm256_set1_ps(rowEdge[1]), c2 = _mm256_set1_ps(rowEdge[2]);
+		__m256 za = _mm256_set1_ps(triangle.ZA), zc = _mm256_set1_ps(rowZ);
+		for (int x = x0; x <= x1; x += 8)
+		{
+			__m256 centerX = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+			__m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, centerX), c0), zero, _CMP_GE_OQ);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, centerX), c1), zero, _CMP_GE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, centerX), c2), zero, _CMP_GE_OQ));
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(za, centerX), zc);
+			__m256 current = _mm256_loadu_ps(row + x);
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, z), inside));
+		}
+#elif OCCLUSION_SIMD_WIDTH == 4
+		__m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 zero = _mm_setzero_ps();
+		__m128 a0 = _mm_set1_ps(triangle.EdgeA[0]), a1 = _mm_set1_ps(triangle.EdgeA[1]), a2 = _mm_set1_ps(triangle.EdgeA[2]);
+		__m128 c0 = _mm_set1_ps(rowEdge[0]), c1 = _mm_set1_ps(rowEdge[1]), c2 = _mm_set1_ps(rowEdge[2]);
+		__m128 za = _mm_set1_ps(triangle.ZA), zc = _mm_set1_ps(rowZ);
+		for (int x = x0; x <= x1; x += 4)
+		{
+			__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, centerX), c0), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, centerX), c1), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, centerX), c2), zero));
+			__m128 z = _mm_add_ps(_mm_mul_ps(za, centerX), zc);
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 nearer = _mm_min_ps(current, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+		}
+#else
+		for (int x = x0; x <= x1; x++)
+		{
+			float centerX = x + 0.5f;
+			if (triangle.EdgeA[0] * centerX + rowEdge[0] >= 0.0f && triangle.EdgeA[1] * centerX + rowEdge[1] >= 0.0f &&
+				triangle.EdgeA[2] * centerX + rowEdge[2] >= 0.0f)
+				row[x] = std::min(row[x], triangle.ZA * centerX + rowZ);
+		}
+#endif
+	}
+};
+
+#endif
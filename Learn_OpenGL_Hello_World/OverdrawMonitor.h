@@ -0,0 +1,222 @@
+#pragma once
+
+// Depth pre-pass control and shaded fragment counts of the forward scene passes. Each pass's draws are
+// wrapped in GL_SAMPLES_PASSED queries: with early depth testing the fragments passing the main pass's
+// depth test are the ones shaded, and when the pass has a depth pre-pass, the fragments passing the
+// pre-pass's depth test are the ones that would have been shaded without it. Their ratio is the pass's
+// overdraw, which the auto mode uses to decide whether the pre-pass pays for itself. Results are read back
+// NUM_FRAMES frames later, like the GPU profiler's.
+
+#ifndef OVERDRAW_MONITOR_H
+#define OVERDRAW_MONITOR_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+enum DepthPrepassMode {
+	DEPTH_PREPASS_OFF,
+	DEPTH_PREPASS_ON,
+	DEPTH_PREPASS_AUTO // on while the measured overdraw is above OverdrawMonitor::OverdrawThreshold
+};
+
+// "off", "on" or "auto"; returns false for anything else
+inline bool parseDepthPrepassMode(const std::string& text, DepthPrepassMode& mode)
+{
+	if (text == "off")
+		mode = DEPTH_PREPASS_OFF;
+	else if (text == "on")
+		mode = DEPTH_PREPASS_ON;
+	else if (text == "auto")
+		mode = DEPTH_PREPASS_AUTO;
+	else
+		return false;
+	return true;
+}
+
+class OverdrawMonitor
+{
+public:
+	static const unsigned int NUM_FRAMES = 3;
+
+	// Auto mode uses the pre-pass above this many depth-passing fragments per shaded one, and drops it again
+	// below OverdrawThreshold * OffHysteresis
+	float OverdrawThreshold = 1.5f;
+	float OffHysteresis = 0.9f;
+	// While the auto pre-pass is off, one frame in this many still uses it to measure the overdraw
+	unsigned int ProbeInterval = 60;
+
+	struct PassResult {
+		bool Measured = false; // a frame that drew the pass has been read back
+		bool Prepass = false; // it had a depth pre-pass
+		GLuint64 PrepassFragments = 0; // fragments passing the pre-pass's depth test (shaded without the pre-pass)
+		GLuint64 ShadedFragments = 0; // fragments passing the main pass's depth test
+	};
+
+	// Passes are indexed by the render queue pass they draw. Call before Init().
+	void SetPass(unsigned int pass, const std::string& name, DepthPrepassMode mode)
+	{
+		if (pass >= passes.size())
+			passes.resize(pass + 1);
+		passes[pass].Name = name;
+		passes[pass].Mode = mode;
+		passes[pass].Registered = true;
+	}
+
+	void Init()
+	{
+		for (unsigned int i = 0; i < NUM_FRAMES; i++)
+		{
+			slots[i].Queries.resize(passes.size() * 2);
+			slots[i].Used.assign(passes.size() * 2, false);
+			if (!slots[i].Queries.empty())
+				glGenQueries(slots[i].Queries.size(), slots[i].Queries.data());
+		}
+		enabled = true;
+	}
+
+	void Release()
+	{
+		for (unsigned int i = 0; i < NUM_FRAMES; i++)
+		{
+			if (!slots[i].Queries.empty())
+				glDeleteQueries(slots[i].Queries.size(), slots[i].Queries.data());
+			slots[i] = FrameSlot();
+		}
+		enabled = false;
+	}
+
+	bool Enabled() const { return enabled; }
+	unsigned int NumPasses() const { return passes.size(); }
+	bool HasPass(unsigned int pass) const { return pass < passes.size() && passes[pass].Registered; }
+	const std::string& Name(unsigned int pass) const { return passes[pass].Name; }
+	DepthPrepassMode Mode(unsigned int pass) const { return passes[pass].Mode; }
+	// Result of the most recently read back frame that drew the pass
+	const PassResult& Result(unsigned int pass) const { return passes[pass].Last; }
+	// Pre-pass fragments per shaded fragment, from the last frame the pass had a pre-pass (0 if never measured)
+	float Overdraw(unsigned int pass) const { return passes[pass].Overdraw; }
+
+	// Whether the pass gets a depth pre-pass this frame (decided in BeginFrame())
+	bool UsePrepass(unsigned int pass) const { return HasPass(pass) && passes[pass].UsePrepass; }
+
+	// Reads back the frame that last used this frame's slot and decides this frame's pre-passes. Returns true
+	// if results were updated.
+	bool BeginFrame()
+	{
+		if (!enabled)
+			return false;
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		bool updated = slot.Pending && readBack(slot);
+		slot.Used.assign(slot.Used.size(), false);
+		slot.Pending = false;
+
+		for (unsigned int i = 0; i < passes.size(); i++)
+		{
+			Pass& pass = passes[i];
+			if (pass.Mode != DEPTH_PREPASS_AUTO)
+				pass.UsePrepass = pass.Mode == DEPTH_PREPASS_ON;
+			else if (pass.Overdraw > OverdrawThreshold * (pass.AutoOn ? OffHysteresis : 1.0f))
+				pass.UsePrepass = pass.AutoOn = true;
+			else
+			{
+				// Off, except for a probe frame now and then in case the overdraw has grown
+				pass.AutoOn = false;
+				pass.UsePrepass = !pass.Probed || frame - pass.LastPrepassFrame >= ProbeInterval;
+			}
+			if (pass.UsePrepass)
+			{
+				pass.LastPrepassFrame = frame;
+				pass.Probed = true;
+			}
+		}
+		return updated;
+	}
+
+	void EndFrame()
+	{
+		if (!enabled)
+			return;
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		for (unsigned int i = 0; i < slot.Used.size(); i++)
+			slot.Pending = slot.Pending || slot.Used[i];
+		frame++;
+	}
+
+	// Counts the fragments of the pass's pre-pass or main pass until EndQuery(). Queries can't nest.
+	void BeginQuery(unsigned int pass, bool prepass)
+	{
+		if (!enabled || !HasPass(pass))
+			return;
+		FrameSlot& slot = slots[frame % NUM_FRAMES];
+		unsigned int index = pass * 2 + (prepass ? 0 : 1);
+		glBeginQuery(GL_SAMPLES_PASSED, slot.Queries[index]);
+		slot.Used[index] = true;
+		active = true;
+	}
+
+	void EndQuery()
+	{
+		if (!active)
+			return;
+		glEndQuery(GL_SAMPLES_PASSED);
+		active = false;
+	}
+
+private:
+	struct Pass {
+		std::string Name;
+		DepthPrepassMode Mode = DEPTH_PREPASS_OFF;
+		bool Registered = false;
+		bool UsePrepass = false;
+		bool AutoOn = false;
+		bool Probed = false;
+		unsigned int LastPrepassFrame = 0;
+		float Overdraw = 0.0f;
+		PassResult Last;
+	};
+
+	// Pre-pass and main pass query of every pass for one frame in flight
+	struct FrameSlot {
+		std::vector<GLuint> Queries;
+		std::vector<bool> Used;
+		bool Pending = false;
+	};
+
+	std::vector<Pass> passes;
+	FrameSlot slots[NUM_FRAMES];
+	unsigned int frame = 0;
+	bool enabled = false;
+	bool active = false;
+
+	// Skips the frame if its results aren't in yet rather than waiting for the GPU
+	bool readBack(FrameSlot& slot)
+	{
+		for (unsigned int i = 0; i < slot.Queries.size(); i++)
+		{
+			GLint available = GL_TRUE;
+			if (slot.Used[i])
+				glGetQueryObjectiv(slot.Queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return false;
+		}
+		for (unsigned int i = 0; i < passes.size(); i++)
+		{
+			bool prepass = slot.Used[i * 2];
+			if (!slot.Used[i * 2 + 1])
+				continue;
+			PassResult& result = passes[i].Last;
+			result.Measured = true;
+			result.Prepass = prepass;
+			result.PrepassFragments = 0;
+			if (prepass)
+				glGetQueryObjectui64v(slot.Queries[i * 2], GL_QUERY_RESULT, &result.PrepassFragments);
+			glGetQueryObjectui64v(slot.Queries[i * 2 + 1], GL_QUERY_RESULT, &result.ShadedFragments);
+			if (prepass)
+				passes[i].Overdraw = (float)((double)result.PrepassFragments / (double)std::max<GLuint64>(result.ShadedFragments, 1));
+		}
+		return true;
+	}
+};
+
+#endif
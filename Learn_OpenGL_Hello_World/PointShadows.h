@@ -0,0 +1,263 @@
+#pragma once
+
+// Omnidirectional shadow map of a point light: a depth cube map storing each texel's distance from the light
+// (divided by the light's radius), so receivers compare their own distance whichever face they fall on.
+//
+// All six faces are rendered in one pass. Casters are culled against each face's frustum on the CPU, which
+// gives every draw a mask of the faces it can appear on (RenderQueue's DrawCommand::LayerMask); the geometry
+// shader sends each triangle to those faces with gl_Layer, skipping the faces the triangle itself is outside.
+//
+// The face size follows the light's influence on screen: the projected radius of the sphere it lights, rounded
+// up to a power of two between MinResolution and MaxResolution. Each size gets its own cube map the first time
+// it is used. The map is kept across frames and only re-rendered when the light moves, its size changes, or a
+// dynamic caster inside its radius moves (MarkMoved()), and then only while the sphere is in view.
+
+#ifndef POINT_SHADOWS_H
+#define POINT_SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <Frustum.h>
+#include <FrameContext.h>
+#include <FrameGraph.h>
+#include <Shader.h>
+
+class PointShadowMap
+{
+public:
+	static const unsigned int NUM_FACES = 6;
+	static const unsigned int MAX_SIZES = 8; // cube maps of MinResolution << 0..7
+	// Receivers are offset along their normal by this many texels at their distance before the depth compare
+	static constexpr float NORMAL_OFFSET_TEXELS = 1.5f;
+	// World distance subtracted from the receiver's distance before the compare
+	static constexpr float DEPTH_BIAS = 0.02f;
+
+	// Settings, read by Init() and Update()
+	int MinResolution = 128;
+	int MaxResolution = 1024;
+	// Face texels per pixel of the light's projected radius
+	float ResolutionScale = 1.0f;
+	// A smaller size is only used once the needed size is below this fraction of it, so the size doesn't flip
+	// back and forth while the light is near a boundary
+	float ShrinkMargin = 0.75f;
+	float NearPlane = 0.05f;
+	// false re-renders the map every frame the light is in view (for comparison)
+	bool Caching = true;
+	// Set each frame by Update(): a light casts point shadows. Apply() turns the shadows off in the shaders otherwise.
+	bool Enabled = false;
+
+	// This frame's placement
+	glm::vec3 Position = glm::vec3(0.0f);
+	float Radius = 0.0f; // far plane of the faces, where the light's influence ends
+	int Resolution = 0; // face size
+	glm::mat4 FaceMatrices[NUM_FACES]; // world to clip space of each face
+	Frustum FaceFrusta[NUM_FACES];
+	bool Dirty = false; // re-rendered this frame
+	// Faces each culling batch entry touches, from CullFaces() (0 = culled from every face)
+	std::vector<unsigned char> FaceMasks;
+	// Counted by the caller for the frame's re-render: draws, and the faces they go to
+	unsigned int Draws = 0;
+	unsigned int FaceDraws = 0;
+
+	void Init()
+	{
+		MinResolution = std::max(16, MinResolution);
+		MaxResolution = glm::clamp(MaxResolution, MinResolution, MinResolution << (MAX_SIZES - 1));
+		for (unsigned int i = 0; i < MAX_SIZES; i++)
+			textures[i] = 0;
+		// Filtering across face edges instead of clamping at them
+		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+		initialized = true;
+	}
+
+	void Release()
+	{
+		if (!initialized)
+			return;
+		for (unsigned int i = 0; i < MAX_SIZES; i++)
+		{
+			if (textures[i])
+				glDeleteTextures(1, &textures[i]);
+			textures[i] = 0;
+		}
+		initialized = false;
+	}
+
+	// Changes the largest face size (the quality governor's shadow knob). Cube maps over it are freed, and the
+	// map is re-rendered at the size picked next.
+	void SetMaxResolution(int resolution)
+	{
+		resolution = glm::clamp(resolution, MinResolution, MinResolution << (MAX_SIZES - 1));
+		if (resolution == MaxResolution)
+			return;
+		MaxResolution = resolution;
+		if (!initialized)
+			return;
+		for (unsigned int i = maxSizeIndex() + 1; i < MAX_SIZES; i++)
+		{
+			if (textures[i])
+				glDeleteTextures(1, &textures[i]);
+			textures[i] = 0;
+		}
+		pending = true;
+	}
+
+	bool Initialized() const { return initialized; }
+	// Cube map of the current size, for importing into the frame graph with every face attached
+	GLuint Texture() const { return textures[sizeIndex]; }
+	FrameGraphTextureDesc FaceDesc() const { return { Resolution, Resolution, GL_DEPTH_COMPONENT24 }; }
+
+	// Places the map at the light for this frame and picks its size from the light's projected radius. Marks
+	// it Dirty if the light moved or resized, or the map can't be reused; until the light is in view again a
+	// change is only remembered.
+	void Update(const FrameContext& frame, const glm::vec3& lightPosition, float lightRadius)
+	{
+		Enabled = initialized && lightRadius > NearPlane;
+		Dirty = false;
+		if (!Enabled)
+			return;
+
+		// Projected radius of the light's sphere in pixels; the camera inside it sees it from every side
+		glm::vec3 toLight = lightPosition - frame.CameraPosition;
+		float distanceSq = glm::dot(toLight, toLight);
+		float needed = (float)MaxResolution;
+		if (distanceSq > lightRadius * lightRadius)
+			needed = lightRadius / std::sqrt(distanceSq - lightRadius * lightRadius) * frame.Projection[1][1] * frame.ViewportHeight * 0.5f * ResolutionScale;
+		unsigned int index = 0;
+		while (index < maxSizeIndex() && (float)(MinResolution << index) < needed)
+			index++;
+		if (Resolution > 0 && index < sizeIndex && sizeIndex <= maxSizeIndex() && needed > (MinResolution << sizeIndex) * 0.5f * ShrinkMargin)
+			index = sizeIndex;
+		if (!textures[index])
+			textures[index] = createCubeMap(MinResolution << index);
+
+		if (lightPosition != Position || lightRadius != Radius || index != sizeIndex || Resolution == 0 || !Caching)
+		{
+			Position = lightPosition;
+			Radius = lightRadius;
+			sizeIndex = index;
+			Resolution = MinResolution << index;
+			// Faces in the cube map's order (+x, -x, +y, -y, +z, -z), oriented the way cube maps are sampled
+			static const glm::vec3 directions[NUM_FACES] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+				glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+			static const glm::vec3 ups[NUM_FACES] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+				glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+			glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NearPlane, Radius);
+			for (unsigned int f = 0; f < NUM_FACES; f++)
+			{
+				FaceMatrices[f] = projection * glm::lookAt(Position, Position + directions[f], ups[f]);
+				FaceFrusta[f].Extract(FaceMatrices[f]);
+			}
+			pending = true;
+		}
+		inView = frame.ViewFrustum.IsSphereVisible(BoundingSphere(Position, Radius));
+		Dirty = pending && inView;
+		if (Dirty)
+			pending = false;
+	}
+
+	// A dynamic caster with the given world bounds (covering where it was and where it is) moved this frame:
+	// the map is re-rendered if the caster is inside the light's radius
+	void MarkMoved(const AABB& bounds)
+	{
+		if (!Enabled || Dirty)
+			return;
+		glm::vec3 closest = glm::clamp(Position, bounds.Min, bounds.Max);
+		if (glm::dot(closest - Position, closest - Position) > Radius * Radius)
+			return;
+		if (inView)
+			Dirty = true;
+		else
+			pending = true;
+	}
+
+	// Culls the batch against every face, leaving the faces each entry touches in FaceMasks
+	void CullFaces(CullingBatch& batch)
+	{
+		FaceMasks.assign(batch.Size(), 0);
+		for (unsigned int f = 0; f < NUM_FACES; f++)
+		{
+			batch.Cull(FaceFrusta[f], Position, 1.0f, 1.0f);
+			for (unsigned int i = 0; i < batch.Size(); i++)
+				if (batch.IsVisible(i))
+					FaceMasks[i] |= 1 << f;
+		}
+	}
+
+	// Number of faces in a face mask
+	static unsigned int FaceCount(unsigned int mask)
+	{
+		unsigned int count = 0;
+		for (; mask != 0; mask &= mask - 1)
+			count++;
+		return count;
+	}
+
+	// Uniforms of the caster programs (the depth-only programs with the cube shadow geometry shader)
+	void ApplyCaster(Shader& shader) const
+	{
+		for (unsigned int f = 0; f < NUM_FACES; f++)
+			shader.setMatrix4("faceMatrices[" + std::to_string(f) + "]", FaceMatrices[f]);
+		shader.setVec3("lightPos", Position);
+		shader.setFloat("farPlane", Radius);
+	}
+
+	// Binds the cube map and sets the lit shader's point shadow uniforms; the shader's shadowedPointLight picks
+	// the light. The sampler is always given its own unit, since a samplerCubeShadow left on unit 0 would clash
+	// with the diffuse map.
+	void Apply(Shader& shader, unsigned int unit) const
+	{
+		shader.setInt("pointShadowMap", unit);
+		if (!initialized || !Enabled)
+			return;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, textures[sizeIndex]);
+		glActiveTexture(GL_TEXTURE0);
+		shader.setFloat("pointShadowFar", Radius);
+		shader.setFloat("pointShadowBias", DEPTH_BIAS);
+		// A face texel at distance d is 2d / Resolution wide
+		shader.setFloat("pointShadowNormalOffset", 2.0f / Resolution * NORMAL_OFFSET_TEXELS);
+	}
+
+private:
+	GLuint textures[MAX_SIZES];
+	unsigned int sizeIndex = 0;
+	bool pending = true; // a change not rendered yet, because the light was out of view
+	bool inView = false;
+	bool initialized = false;
+
+	// Index of the smallest size reaching MaxResolution
+	unsigned int maxSizeIndex() const
+	{
+		unsigned int index = 0;
+		while ((MinResolution << index) < MaxResolution)
+			index++;
+		return index;
+	}
+
+	// Depth cube map filtered by hardware depth comparison when sampled
+	GLuint createCubeMap(int size)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		for (unsigned int f = 0; f < NUM_FACES; f++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		return texture;
+	}
+};
+
+#endif
@@ -0,0 +1,306 @@
+#pragma once
+
+// Scoped CPU profiler zones written as a Chrome trace (open in Perfetto or chrome://tracing).
+//
+//   PROFILE_ZONE("Model::loadModel"); // times the rest of the enclosing scope
+//
+// Zone names must be string literals; only the pointer is stored. Each thread records into its own ring
+// buffer without locks, and a background thread flushes the buffers to the trace file while the program runs.
+// Timestamps come from RDTSC on x86 (steady_clock elsewhere), so a zone costs tens of nanoseconds.
+// Everything compiles out unless PROFILER_ENABLED is defined to 1.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+#endif
+
+#if PROFILER_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_RDTSC 1
+#else
+#define PROFILER_RDTSC 0
+#endif
+
+namespace Profiler
+{
+	struct ZoneEvent {
+		const char* Name;
+		unsigned long long Start;
+		unsigned long long End;
+	};
+
+	// Raw timestamp (TSC ticks, or steady_clock nanoseconds)
+	inline unsigned long long Now()
+	{
+#if PROFILER_RDTSC
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// Zones of one thread. Written only by that thread and read only by the flusher (single producer, single consumer).
+	struct ThreadBuffer {
+		static const unsigned int CAPACITY = 1 << 16;
+
+		ZoneEvent Events[CAPACITY];
+		// Head and Tail on separate cache lines so the flusher doesn't slow down the thread it reads from
+		alignas(64) std::atomic<unsigned int> Head{ 0 }; // next event written, advanced by the owning thread
+		unsigned int CachedTail = 0; // owning thread's last look at Tail
+		std::atomic<unsigned int> Dropped{ 0 }; // events lost because the flusher fell behind
+		alignas(64) std::atomic<unsigned int> Tail{ 0 }; // next event flushed, advanced by the flusher
+		unsigned int ThreadId = 0;
+		std::string Name; // guarded by the trace writer's mutex
+		bool NameWritten = false; // flusher only
+	};
+
+	class TraceWriter
+	{
+	public:
+		static const unsigned int FLUSH_INTERVAL_MS = 50;
+
+		std::atomic<bool> Active{ false };
+
+		~TraceWriter()
+		{
+			Stop();
+			for (unsigned int i = 0; i < buffers.size(); i++)
+				delete buffers[i];
+		}
+
+		// Opens the trace file and starts the flusher thread
+		bool Start(const std::string& path)
+		{
+			if (Active)
+				return true;
+			file.open(path.c_str());
+			if (!file)
+			{
+				std::cout << "ERROR::PROFILER::FILE_NOT_WRITTEN " << path << std::endl;
+				return false;
+			}
+			calibrate();
+			file.setf(std::ios::fixed);
+			file.precision(3);
+			file << "[\n";
+			firstEvent = true;
+			stopping = false;
+			flusher = std::thread(&TraceWriter::flushLoop, this);
+			Active = true;
+			std::cout << "Writing profiler trace to " << path << std::endl;
+			return true;
+		}
+
+		// Flushes what is left and closes the trace
+		void Stop()
+		{
+			if (!Active)
+				return;
+			Active = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wakeCondition.notify_all();
+			flusher.join();
+			flush();
+			file << "\n]\n";
+			file.close();
+			unsigned int dropped = 0;
+			for (unsigned int i = 0; i < buffers.size(); i++)
+				dropped += buffers[i]->Dropped;
+			if (dropped > 0)
+				std::cout << "ERROR::PROFILER::EVENTS_DROPPED " << dropped << std::endl;
+		}
+
+		ThreadBuffer* Register()
+		{
+			ThreadBuffer* buffer = new ThreadBuffer();
+			std::lock_guard<std::mutex> lock(mutex);
+			buffer->ThreadId = buffers.size() + 1;
+			buffers.push_back(buffer);
+			return buffer;
+		}
+
+		void SetThreadName(ThreadBuffer& buffer, const std::string& name)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			buffer.Name = name;
+		}
+
+	private:
+		std::vector<ThreadBuffer*> buffers;
+		std::mutex mutex;
+		std::condition_variable wakeCondition;
+		std::thread flusher;
+		bool stopping = false;
+		std::ofstream file;
+		bool firstEvent = true;
+		unsigned long long baseTicks = 0;
+		double ticksPerMicrosecond = 1000.0;
+
+		// Relates raw timestamps to microseconds
+		void calibrate()
+		{
+#if PROFILER_RDTSC
+			std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+			unsigned long long ticksStart = Now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			unsigned long long ticksEnd = Now();
+			double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - clockStart).count();
+			ticksPerMicrosecond = (ticksEnd - ticksStart) / microseconds;
+			baseTicks = ticksStart;
+#else
+			ticksPerMicrosecond = 1000.0;
+			baseTicks = Now();
+#endif
+		}
+
+		double toMicroseconds(unsigned long long ticks) const
+		{
+			return ticks >= baseTicks ? (ticks - baseTicks) / ticksPerMicrosecond : -((baseTicks - ticks) / ticksPerMicrosecond);
+		}
+
+		void flushLoop()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping)
+			{
+				wakeCondition.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+				lock.unlock();
+				flush();
+				lock.lock();
+			}
+		}
+
+		// Writes every buffer's pending events (flusher thread, or Stop() after it has exited)
+		void flush()
+		{
+			std::vector<ThreadBuffer*> snapshot;
+			std::vector<std::string> names;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				snapshot = buffers;
+				for (unsigned int i = 0; i < buffers.size(); i++)
+					names.push_back(buffers[i]->Name);
+			}
+			for (unsigned int b = 0; b < snapshot.size(); b++)
+			{
+				ThreadBuffer& buffer = *snapshot[b];
+				if (!buffer.NameWritten && !names[b].empty())
+				{
+					separator();
+					file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.ThreadId
+						<< ",\"args\":{\"name\":\"" << names[b] << "\"}}";
+					buffer.NameWritten = true;
+				}
+				unsigned int tail = buffer.Tail.load(std::memory_order_relaxed);
+				unsigned int head = buffer.Head.load(std::memory_order_acquire);
+				for (; tail != head; tail++)
+				{
+					const ZoneEvent& event = buffer.Events[tail % ThreadBuffer::CAPACITY];
+					separator();
+					file << "{\"name\":\"" << event.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.ThreadId
+						<< ",\"ts\":" << toMicroseconds(event.Start) << ",\"dur\":" << (event.End - event.Start) / ticksPerMicrosecond << "}";
+				}
+				buffer.Tail.store(tail, std::memory_order_release);
+			}
+			file.flush();
+		}
+
+		void separator()
+		{
+			if (!firstEvent)
+				file << ",\n";
+			firstEvent = false;
+		}
+	};
+
+	inline TraceWriter& traceWriter()
+	{
+		static TraceWriter writer;
+		return writer;
+	}
+
+	inline ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = traceWriter().Register();
+		return *buffer;
+	}
+
+	inline void Record(const char* name, unsigned long long start, unsigned long long end)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		unsigned int head = buffer.Head.load(std::memory_order_relaxed);
+		if (head - buffer.CachedTail >= ThreadBuffer::CAPACITY)
+		{
+			buffer.CachedTail = buffer.Tail.load(std::memory_order_acquire);
+			if (head - buffer.CachedTail >= ThreadBuffer::CAPACITY)
+			{
+				buffer.Dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		}
+		ZoneEvent& event = buffer.Events[head % ThreadBuffer::CAPACITY];
+		event.Name = name;
+		event.Start = start;
+		event.End = end;
+		buffer.Head.store(head + 1, std::memory_order_release);
+	}
+
+	// Times its scope. Does nothing while no trace is being written.
+	class Zone
+	{
+	public:
+		Zone(const char* name) : name(traceWriter().Active.load(std::memory_order_relaxed) ? name : NULL), start(this->name ? Now() : 0) {}
+		~Zone()
+		{
+			if (name)
+				Record(name, start, Now());
+		}
+
+	private:
+		const char* name;
+		unsigned long long start;
+	};
+
+	inline bool Start(const std::string& path) { return traceWriter().Start(path); }
+	inline void Stop() { traceWriter().Stop(); }
+	inline void SetThreadName(const std::string& name) { traceWriter().SetThreadName(threadBuffer(), name); }
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// "" name only compiles for string literals
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)("" name)
+#define PROFILE_THREAD_NAME(name) Profiler::SetThreadName(name)
+#define PROFILE_START(path) Profiler::Start(path)
+#define PROFILE_STOP() Profiler::Stop()
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD_NAME(name)
+#define PROFILE_START(path) false
+#define PROFILE_STOP()
+
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+// Keeps the frame time under a target budget. The resolution the scene renders at scales continuously with
+// the smoothed frame time (cost is assumed proportional to the pixel count); once the scale is pinned at
+// its minimum or maximum for a while, secondary knobs step down or up a quality level. Stepping up needs a
+// much larger margin than stepping down, so levels don't flip back and forth.
+
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+#include <algorithm>
+#include <cmath>
+
+// Secondary knobs of one quality level
+struct QualityKnobs {
+	float LodBias; // texture mip bias of the lit shaders
+	unsigned int MaxLights; // point lights shaded, and lights per object
+	float ShadowResolutionScale; // fraction of the configured shadow map sizes
+
+	// Point lights that fit under MaxLights next to a receiver group's other lights (its directional lights and
+	// the flashlight), which are always applied: the limit is only ever taken out of the point lights
+	unsigned int PointLightBudget(unsigned int otherLights) const
+	{
+		return MaxLights > otherLights ? MaxLights - otherLights : 0;
+	}
+};
+
+class QualityGovernor
+{
+public:
+	static const unsigned int NUM_LEVELS = 4;
+
+	float TargetMilliseconds = 1000.0f / 60.0f;
+	float MinScale = 0.5f;
+	float MaxScale = 1.0f;
+	float Headroom = 0.9f; // fraction of the budget the resolution scale aims for
+	float Smoothing = 0.1f; // weight of the newest frame in the moving average
+	float MaxScaleStep = 0.02f; // per frame
+	// Level hysteresis: over budget (with the scale at its minimum) for StepDownFrames lowers the level, under
+	// StepUpBudget (with the scale at its maximum) for StepUpFrames raises it
+	float StepDownBudget = 1.05f;
+	float StepUpBudget = 0.7f;
+	unsigned int StepDownFrames = 30;
+	unsigned int StepUpFrames = 120;
+
+	void SetTargetFps(float fps)
+	{
+		TargetMilliseconds = 1000.0f / std::max(1.0f, fps);
+	}
+
+	// Feeds the time of the last frame (the larger of CPU and GPU time). Returns true if the quality level changed.
+	bool Update(double frameMilliseconds)
+	{
+		smoothed = smoothed > 0.0 ? smoothed + Smoothing * (frameMilliseconds - smoothed) : frameMilliseconds;
+
+		// Pixel count scales with scale^2, so the scale that would hit the budget goes with the square root
+		double desired = scale * std::sqrt(TargetMilliseconds * Headroom / std::max(smoothed, 0.001));
+		double step = std::min(std::max(desired - scale, -(double)MaxScaleStep), (double)MaxScaleStep);
+		scale = (float)std::min(std::max(scale + step, (double)MinScale), (double)MaxScale);
+
+		bool atMinimum = scale <= MinScale + 0.001f;
+		bool atMaximum = scale >= MaxScale - 0.001f;
+		overBudgetFrames = atMinimum && smoothed > TargetMilliseconds * StepDownBudget ? overBudgetFrames + 1 : 0;
+		underBudgetFrames = atMaximum && smoothed < TargetMilliseconds * StepUpBudget ? underBudgetFrames + 1 : 0;
+		if (overBudgetFrames >= StepDownFrames && level + 1 < NUM_LEVELS)
+		{
+			level++;
+			overBudgetFrames = 0;
+			return true;
+		}
+		if (underBudgetFrames >= StepUpFrames && level > 0)
+		{
+			level--;
+			underBudgetFrames = 0;
+			return true;
+		}
+		return false;
+	}
+
+	float RenderScale() const { return scale; }
+	double SmoothedMilliseconds() const { return smoothed; }
+	// 0 is full quality
+	unsigned int Level() const { return level; }
+
+	const QualityKnobs& Knobs() const { return LevelKnobs(level); }
+
+	static const QualityKnobs& LevelKnobs(unsigned int level)
+	{
+		static const QualityKnobs levels[NUM_LEVELS] = {
+			{ 0.0f, 0xFFFFFFFF, 1.0f },
+			{ 0.5f, 0xFFFFFFFF, 0.5f },
+			{ 1.0f, 256, 0.5f },
+			{ 1.5f, 32, 0.25f }
+		};
+		return levels[std::min(level, NUM_LEVELS - 1)];
+	}
+
+private:
+	float scale = 1.0f;
+	double smoothed = 0.0;
+	unsigned int level = 0;
+	unsigned int overBudgetFrames = 0;
+	unsigned int underBudgetFrames = 0;
+};
+
+#endif
@@ -0,0 +1,427 @@
+#pragma once
+
+// Render queue: draws are recorded as packets with a 64-bit sort key, radix sorted, and submitted with
+// GL state only changed where the key changes. Packets can be recorded from several threads at once,
+// each into its own command list.
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <RenderStats.h>
+#include <Profiler.h>
+#include <GpuProfiler.h>
+
+// Textures bound together for a draw, and the sampler uniforms that select their units
+struct RenderMaterial {
+	static const unsigned int MAX_TEXTURES = 4;
+
+	unsigned int NumTextures = 0;
+	GLuint Textures[MAX_TEXTURES];
+	GLint Units[MAX_TEXTURES];
+	std::string SamplerNames[MAX_TEXTURES];
+
+	void AddTexture(GLuint texture, GLint unit, const std::string& samplerName)
+	{
+		if (NumTextures >= MAX_TEXTURES)
+			return;
+		Textures[NumTextures] = texture;
+		Units[NumTextures] = unit;
+		SamplerNames[NumTextures] = samplerName;
+		NumTextures++;
+	}
+
+	bool operator==(const RenderMaterial& other) const
+	{
+		if (NumTextures != other.NumTextures)
+			return false;
+		for (unsigned int i = 0; i < NumTextures; i++)
+			if (Textures[i] != other.Textures[i] || Units[i] != other.Units[i] || SamplerNames[i] != other.SamplerNames[i])
+				return false;
+		return true;
+	}
+};
+
+// Everything needed to issue one draw call
+struct DrawCommand {
+	GLuint Program;
+	GLuint VAO;
+	unsigned int Material; // id from RenderQueue::RegisterMaterial(), RenderQueue::NO_MATERIAL for none
+	GLenum Mode;
+	GLsizei Count;
+	bool Indexed; // glDrawElements (GL_UNSIGNED_INT indices from offset 0) or glDrawArrays from vertex 0
+	glm::mat4 Model;
+	glm::mat3 NormalMatrix; // transpose(inverse(mat3(Model))), precomputed so shaders don't invert per vertex
+	GLsizei Instances = 1; // > 1 draws instanced, per-instance data comes from the VAO
+	bool Outlined = false; // marks its pixels with RenderQueue::OutlineStencilBit
+	// Layers of a layered target the draw is sent to, one bit each, for programs with a layerMask uniform
+	// (the cube map faces of a point light shadow)
+	unsigned int LayerMask = ~0u;
+	// Views of a multi-view frame the draw is visible in, one bit each (see MultiView.h)
+	unsigned int ViewMask = ~0u;
+};
+
+// Sort key and the command it orders
+struct RenderPacket {
+	unsigned long long Key;
+	unsigned int Command; // command list index in the top 8 bits, command index within the list below
+};
+
+class RenderQueue;
+
+// Packets recorded by one thread
+class RenderCommandList
+{
+public:
+	// Records a draw into the given pass. worldPosition is used for depth sorting.
+	void Enqueue(unsigned int pass, const DrawCommand& command, const glm::vec3& worldPosition);
+
+	unsigned int Size() const { return packets.size(); }
+
+private:
+	friend class RenderQueue;
+	const RenderQueue* queue = NULL;
+	unsigned int index = 0;
+	std::vector<RenderPacket> packets;
+	std::vector<DrawCommand> commands;
+};
+
+class RenderQueue
+{
+public:
+	static const unsigned int NO_MATERIAL = 0;
+
+	// Sort key layout, most significant first: pass | program | material | VAO | depth
+	static const unsigned int PASS_BITS = 4;
+	static const unsigned int PROGRAM_BITS = 8;
+	static const unsigned int MATERIAL_BITS = 16;
+	static const unsigned int VAO_BITS = 12;
+	static const unsigned int DEPTH_BITS = 24;
+
+	static const unsigned int MAX_COMMAND_LISTS = 256;
+	static const unsigned int MAX_DEPTH_PROGRAM_SETS = 4;
+
+	// Number of state changes during the last submitted passes (reset with Clear())
+	unsigned int ProgramChanges = 0;
+	unsigned int MaterialChanges = 0;
+	unsigned int VAOChanges = 0;
+
+	RenderQueue()
+	{
+		// Material 0 binds no textures
+		materials.push_back(RenderMaterial());
+		SetThreadCount(1);
+	}
+
+	// One command list per recording thread; list 0 belongs to the GL thread
+	void SetThreadCount(unsigned int count)
+	{
+		count = glm::clamp(count, 1u, MAX_COMMAND_LISTS);
+		lists.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			lists[i].queue = this;
+			lists[i].index = i;
+		}
+	}
+
+	RenderCommandList& CommandList(unsigned int threadIndex) { return lists[threadIndex]; }
+
+	// Materials persist across frames, and registering the same textures again returns the existing id. Must not
+	// be called while other threads are recording.
+	unsigned int RegisterMaterial(const RenderMaterial& material)
+	{
+		for (unsigned int i = 0; i < materials.size(); i++)
+			if (materials[i] == material)
+				return i;
+		materials.push_back(material);
+		return materials.size() - 1;
+	}
+
+	// Stencil bit written for draws marked Outlined, 0 for none. Passes submitted with it set run with stencil
+	// func GL_ALWAYS, ref 0 and the bit in the write mask (op REPLACE); outlined draws switch the ref to the bit.
+	GLuint OutlineStencilBit = 0;
+
+	// Depth-only program drawn instead of the given one by SubmitDepth(): same vertex transform, no shading.
+	// Draws whose program has none keep their own program (with whatever colour writes the pass allows).
+	// Passes needing different depth-only variants (e.g. rendering to every face of a cube map) use another set.
+	void SetDepthProgram(GLuint program, GLuint depthProgram, unsigned int set = 0)
+	{
+		depthPrograms[set][program] = depthProgram;
+	}
+
+	// Views the following submissions are for: draws visible in none of them are skipped. viewInstances > 1
+	// draws every instance that many times (instanced stereo). SetViews() with no arguments submits everything.
+	void SetViews(unsigned int viewMask = ~0u, GLsizei viewInstances = 1)
+	{
+		this->viewMask = viewMask;
+		this->viewInstances = std::max(1, viewInstances);
+	}
+
+	// Camera used to compute the depth part of the keys (front to back within equal state)
+	void SetCamera(const glm::vec3& position, float farPlane)
+	{
+		cameraPosition = position;
+		this->farPlane = farPlane;
+	}
+
+	// Records a draw from the GL thread (command list 0)
+	void Enqueue(unsigned int pass, const DrawCommand& command, const glm::vec3& worldPosition)
+	{
+		lists[0].Enqueue(pass, command, worldPosition);
+		sorted = false;
+	}
+
+	// Removes all packets (call at the start of each frame)
+	void Clear()
+	{
+		for (unsigned int i = 0; i < lists.size(); i++)
+		{
+			lists[i].packets.clear();
+			lists[i].commands.clear();
+		}
+		packets.clear();
+		ProgramChanges = MaterialChanges = VAOChanges = 0;
+		sorted = false;
+	}
+
+	unsigned int Size() const { return packets.size(); }
+
+	// Merges the command lists and orders the packets by key. Call once recording on all threads has finished.
+	void Sort()
+	{
+		PROFILE_ZONE("RenderQueue::Sort");
+		packets.clear();
+		for (unsigned int i = 0; i < lists.size(); i++)
+			packets.insert(packets.end(), lists[i].packets.begin(), lists[i].packets.end());
+		radixSort();
+		sorted = true;
+	}
+
+	// Sort key of a draw. Thread safe.
+	unsigned long long MakeKey(unsigned int pass, const DrawCommand& command, const glm::vec3& worldPosition) const
+	{
+		// GL names are small sequential integers in practice; a collision only costs a redundant state change
+		unsigned long long program = command.Program & ((1u << PROGRAM_BITS) - 1);
+		unsigned long long vao = command.VAO & ((1u << VAO_BITS) - 1);
+		unsigned long long material = command.Material & ((1u << MATERIAL_BITS) - 1);
+		float normalizedDepth = glm::clamp(glm::length(worldPosition - cameraPosition) / farPlane, 0.0f, 1.0f);
+		unsigned long long depth = (unsigned long long)(normalizedDepth * ((1u << DEPTH_BITS) - 1));
+
+		unsigned long long key = (unsigned long long)(pass & ((1u << PASS_BITS) - 1));
+		key = (key << PROGRAM_BITS) | program;
+		key = (key << MATERIAL_BITS) | material;
+		key = (key << VAO_BITS) | vao;
+		key = (key << DEPTH_BITS) | depth;
+		return key;
+	}
+
+	// Issues the draws of one pass in key order
+	void Submit(unsigned int pass)
+	{
+		PROFILE_ZONE("RenderQueue::Submit");
+		submit(pass, false);
+	}
+
+	// Issues the draws of one pass in key order with their depth-only programs from the given set, for a depth
+	// pre-pass or shadow map. Materials and normal matrices aren't set, and draws don't mark the outline stencil bit.
+	void SubmitDepth(unsigned int pass, unsigned int set = 0)
+	{
+		PROFILE_ZONE("RenderQueue::SubmitDepth");
+		submit(pass, true, set);
+	}
+
+private:
+	friend class RenderCommandList;
+	static const unsigned int LIST_SHIFT = 24;
+	static const unsigned int COMMAND_MASK = (1u << LIST_SHIFT) - 1;
+
+	struct ProgramLocations {
+		GLint Model;
+		GLint NormalMatrix;
+		GLint LayerMask;
+	};
+
+	std::vector<RenderMaterial> materials;
+	std::vector<RenderCommandList> lists;
+	std::vector<RenderPacket> packets;
+	std::vector<RenderPacket> sortScratch;
+	std::map<GLuint, ProgramLocations> programLocations;
+	std::map<GLuint, GLuint> depthPrograms[MAX_DEPTH_PROGRAM_SETS];
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	float farPlane = 100.0f;
+	bool sorted = true;
+	unsigned int viewMask = ~0u;
+	GLsizei viewInstances = 1;
+
+	void submit(unsigned int pass, bool depthOnly, unsigned int depthSet = 0)
+	{
+		if (!sorted)
+			Sort();
+
+		// Packets of a pass are contiguous since the pass is the top of the key
+		unsigned long long passBits = (unsigned long long)pass << (64 - PASS_BITS);
+		unsigned int first = lowerBound(passBits);
+		unsigned int last = lowerBound(passBits + (1ULL << (64 - PASS_BITS)));
+		if (pass == (1u << PASS_BITS) - 1)
+			last = packets.size();
+
+		// State may have been changed outside the queue, so the first draw always sets everything
+		GLuint currentProgram = 0, currentVAO = 0;
+		unsigned int currentMaterial = 0;
+		GLint modelLocation = -1, normalMatrixLocation = -1, layerMaskLocation = -1;
+		bool firstDraw = true;
+		bool outlined = false;
+		for (unsigned int i = first; i < last; i++)
+		{
+			unsigned int commandIndex = packets[i].Command;
+			const DrawCommand& command = lists[commandIndex >> LIST_SHIFT].commands[commandIndex & COMMAND_MASK];
+			if (!(command.ViewMask & viewMask))
+				continue;
+			GLuint program = command.Program;
+			if (depthOnly)
+			{
+				const std::map<GLuint, GLuint>& programs = depthPrograms[depthSet < MAX_DEPTH_PROGRAM_SETS ? depthSet : 0];
+				std::map<GLuint, GLuint>::const_iterator it = programs.find(program);
+				if (it != programs.end())
+					program = it->second;
+			}
+			bool programChanged = firstDraw || program != currentProgram;
+			if (programChanged)
+			{
+				glUseProgram(program);
+				currentProgram = program;
+				const ProgramLocations& locations = getLocations(program);
+				modelLocation = locations.Model;
+				normalMatrixLocation = locations.NormalMatrix;
+				layerMaskLocation = locations.LayerMask;
+				ProgramChanges++;
+			}
+			// Sampler uniforms belong to the program, so a new program also needs its material set again
+			if (!depthOnly && (programChanged || command.Material != currentMaterial))
+			{
+				bindMaterial(command.Program, command.Material);
+				currentMaterial = command.Material;
+				MaterialChanges++;
+			}
+			if (firstDraw || command.VAO != currentVAO)
+			{
+				glBindVertexArray(command.VAO);
+				currentVAO = command.VAO;
+				VAOChanges++;
+			}
+			firstDraw = false;
+			if (!depthOnly && OutlineStencilBit != 0 && command.Outlined != outlined)
+			{
+				glStencilFunc(GL_ALWAYS, command.Outlined ? OutlineStencilBit : 0, 0xFF);
+				outlined = command.Outlined;
+			}
+
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(command.Model));
+			if (normalMatrixLocation >= 0 && !depthOnly)
+				glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(command.NormalMatrix));
+			if (layerMaskLocation >= 0)
+				glUniform1i(layerMaskLocation, (GLint)command.LayerMask);
+			gpuProfiler().BeginDrawScope(i - first);
+			GLsizei instances = command.Instances * viewInstances;
+			if (instances > 1)
+			{
+				if (command.Indexed)
+					glDrawElementsInstanced(command.Mode, command.Count, GL_UNSIGNED_INT, 0, instances);
+				else
+					glDrawArraysInstanced(command.Mode, 0, command.Count, instances);
+			}
+			else if (command.Indexed)
+				glDrawElements(command.Mode, command.Count, GL_UNSIGNED_INT, 0);
+			else
+				glDrawArrays(command.Mode, 0, command.Count);
+			gpuProfiler().EndDrawScope();
+			renderStats().CountDraw(command.Count, instances);
+		}
+		// Back to the pass's stencil state
+		if (outlined)
+			glStencilFunc(GL_ALWAYS, 0, 0xFF);
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// LSD radix sort on 8-bit digits; digits that are the same in every key are skipped
+	void radixSort()
+	{
+		unsigned int count = packets.size();
+		if (count < 2)
+			return;
+		sortScratch.resize(count);
+		for (unsigned int shift = 0; shift < 64; shift += 8)
+		{
+			unsigned int histogram[256] = { 0 };
+			for (unsigned int i = 0; i < count; i++)
+				histogram[(packets[i].Key >> shift) & 0xFF]++;
+			if (histogram[(packets[0].Key >> shift) & 0xFF] == count)
+				continue;
+			unsigned int offset = 0;
+			for (unsigned int d = 0; d < 256; d++)
+			{
+				unsigned int digitCount = histogram[d];
+				histogram[d] = offset;
+				offset += digitCount;
+			}
+			for (unsigned int i = 0; i < count; i++)
+				sortScratch[histogram[(packets[i].Key >> shift) & 0xFF]++] = packets[i];
+			packets.swap(sortScratch);
+		}
+	}
+
+	// Index of the first packet with a key >= the given key
+	unsigned int lowerBound(unsigned long long key) const
+	{
+		unsigned int low = 0, high = packets.size();
+		while (low < high)
+		{
+			unsigned int mid = (low + high) / 2;
+			if (packets[mid].Key < key)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		return low;
+	}
+
+	const ProgramLocations& getLocations(GLuint program)
+	{
+		std::map<GLuint, ProgramLocations>::iterator it = programLocations.find(program);
+		if (it != programLocations.end())
+			return it->second;
+		ProgramLocations locations = { glGetUniformLocation(program, "model"), glGetUniformLocation(program, "normalMatrix"),
+			glGetUniformLocation(program, "layerMask") };
+		return programLocations[program] = locations;
+	}
+
+	void bindMaterial(GLuint program, unsigned int materialId)
+	{
+		const RenderMaterial& material = materials[materialId < materials.size() ? materialId : NO_MATERIAL];
+		for (unsigned int t = 0; t < material.NumTextures; t++)
+		{
+			glActiveTexture(GL_TEXTURE0 + material.Units[t]);
+			glBindTexture(GL_TEXTURE_2D, material.Textures[t]);
+			glUniform1i(glGetUniformLocation(program, material.SamplerNames[t].c_str()), material.Units[t]);
+		}
+	}
+};
+
+inline void RenderCommandList::Enqueue(unsigned int pass, const DrawCommand& command, const glm::vec3& worldPosition)
+{
+	RenderPacket packet;
+	packet.Key = queue->MakeKey(pass, command, worldPosition);
+	packet.Command = (index << RenderQueue::LIST_SHIFT) | (unsigned int)commands.size();
+	commands.push_back(command);
+	packets.push_back(packet);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+// Per-frame rendering counters (draw calls, triangles)
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+struct RenderStats {
+	unsigned int DrawCalls = 0;
+	unsigned int Triangles = 0;
+
+	void Reset()
+	{
+		DrawCalls = 0;
+		Triangles = 0;
+	}
+
+	// Record one draw call of the given number of indices/vertices (triangle lists)
+	void CountDraw(unsigned int numIndices, unsigned int instances = 1)
+	{
+		DrawCalls++;
+		Triangles += numIndices / 3 * instances;
+	}
+};
+
+// Counters for the frame currently being rendered
+inline RenderStats& renderStats()
+{
+	static RenderStats stats;
+	return stats;
+}
+
+#endif
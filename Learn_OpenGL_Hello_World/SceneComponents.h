@@ -0,0 +1,130 @@
+#pragma once
+
+// Components of the scene's entities (see ECS.h). Plain data only, the systems that update them live in main.cpp.
+
+#ifndef SCENE_COMPONENTS_H
+#define SCENE_COMPONENTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <Frustum.h>
+
+class Model;
+
+// Placement relative to the parent scene graph node
+struct TransformComponent {
+	glm::vec3 Position = glm::vec3(0.0f);
+	glm::vec3 Scale = glm::vec3(1.0f);
+	glm::vec3 RotationAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+	float RotationAngle = 0.0f; // radians
+	unsigned int SceneNode = 0xFFFFFFFF; // SceneGraph::NO_PARENT if the entity isn't in the scene graph
+	bool Changed = true; // set when modified, cleared once written to the scene graph
+
+	glm::mat4 LocalMatrix() const
+	{
+		glm::mat4 matrix = glm::translate(glm::mat4(1.0f), Position);
+		if (RotationAngle != 0.0f)
+			matrix = glm::rotate(matrix, RotationAngle, RotationAxis);
+		return glm::scale(matrix, Scale);
+	}
+};
+
+enum AnimationType {
+	ANIMATION_CUBE_TWIST, // moves out from the origin to BasePosition and back while twisting
+	ANIMATION_ORBIT // circles around the origin through BasePosition (the moving lamp)
+};
+
+struct AnimationComponent {
+	AnimationType Type = ANIMATION_CUBE_TWIST;
+	glm::vec3 BasePosition = glm::vec3(0.0f);
+	float Speed = 1.0f; // twist angle at full extension
+	bool Enabled = true; // stays at BasePosition when disabled
+};
+
+// How a renderable is drawn into the directional light's shadow cascades (see CascadedShadows.h)
+enum ShadowCasterType {
+	SHADOW_CASTER_NONE,
+	SHADOW_CASTER_STATIC, // never moves, kept in the cascades' cached static layers
+	SHADOW_CASTER_DYNAMIC, // redrawn into the cascades it touches when its world bounds change
+	SHADOW_CASTER_ANIMATED // animated in the vertex shader, so treated as moving every frame
+};
+
+enum RenderableKind {
+	RENDERABLE_MESH, // a single (possibly instanced) draw of a VAO
+	RENDERABLE_MODEL // every mesh of a loaded model, culled per mesh
+};
+
+struct RenderableComponent {
+	RenderableKind Kind = RENDERABLE_MESH;
+	unsigned int Pass = 0;
+	GLuint Program = 0;
+	bool Enabled = true;
+	// Drawn with a screen-space outline around its visible pixels
+	bool Outlined = false;
+	ShadowCasterType ShadowCaster = SHADOW_CASTER_NONE;
+	// RENDERABLE_MESH
+	GLuint VAO = 0;
+	unsigned int Material = 0;
+	GLsizei Count = 0;
+	bool Indexed = false;
+	GLsizei Instances = 1;
+	// RENDERABLE_MODEL: the model and the scene node of its instantiated root
+	Model* SourceModel = NULL;
+	unsigned int ModelNode = 0;
+	// Culling batch index of this frame (first mesh for models)
+	unsigned int CullIndex = 0;
+};
+
+// Bounding box in the entity's local space, and in world space as of the last bounds update and the one before
+// (different if the entity moved)
+struct BoundsComponent {
+	AABB Local;
+	AABB World;
+	AABB PreviousWorld;
+};
+
+// Box in the entity's local space that lies inside its solid geometry, rasterized by the occlusion culler to
+// hide what is behind the entity
+struct OccluderComponent {
+	AABB Box;
+};
+
+enum LightType {
+	LIGHT_POINT,
+	LIGHT_SPOT,
+	LIGHT_DIRECTIONAL
+};
+
+// Which shaders a light is applied to
+const unsigned int LIGHT_RECEIVER_CUBES = 1;
+const unsigned int LIGHT_RECEIVER_MODELS = 2;
+const unsigned int LIGHT_RECEIVER_ALL = LIGHT_RECEIVER_CUBES | LIGHT_RECEIVER_MODELS;
+
+struct LightComponent {
+	LightType Type = LIGHT_POINT;
+	bool Enabled = true;
+	unsigned int Receivers = LIGHT_RECEIVER_ALL;
+	// diffuse = Color * DiffuseIntensity, ambient = diffuse * AmbientIntensity
+	glm::vec3 Color = glm::vec3(1.0f);
+	glm::vec3 AmbientIntensity = glm::vec3(0.2f);
+	glm::vec3 DiffuseIntensity = glm::vec3(0.5f);
+	glm::vec3 SpecularIntensity = glm::vec3(1.0f);
+	// Attenuation (point and spot)
+	float Constant = 1.0f;
+	float Linear = 0.09f;
+	float Quadratic = 0.032f;
+	// Point and spot lights take their position from the entity's transform, or the camera for FollowCamera
+	glm::vec3 Position = glm::vec3(0.0f);
+	glm::vec3 Direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	// Spot cone angles in degrees
+	float CutOff = 5.0f;
+	float OuterCutOff = 20.0f;
+	bool FollowCamera = false;
+	bool CycleColor = false; // colour slowly cycles over time (the lamp)
+	// Shadowed by the cascaded shadow map (directional) or the point shadow map (point), the first enabled light
+	// of each type with it set
+	bool CastsShadows = false;
+};
+
+#endif
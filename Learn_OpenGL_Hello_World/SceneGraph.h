@@ -0,0 +1,150 @@
+#pragma once
+
+// Scene graph: node hierarchy with local and world transforms in contiguous arrays. Nodes are stored
+// parent-before-child, so world transforms are propagated in one linear pass and only nodes below a
+// changed transform are recomputed.
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <Profiler.h>
+
+// 4x4 matrix multiply with SSE on x86/x64
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_GRAPH_SSE 1
+#else
+#define SCENE_GRAPH_SSE 0
+#endif
+
+class SceneGraph
+{
+public:
+	static const unsigned int NO_PARENT = 0xFFFFFFFF;
+
+	// Number of world transforms recomputed by the last Update()
+	unsigned int NumUpdated = 0;
+
+	SceneGraph() : firstDirty(NO_PARENT) {}
+
+	// Adds a node under the given parent (which must already exist, keeping the parent-before-child order)
+	unsigned int AddNode(const glm::mat4& localTransform, unsigned int parent = NO_PARENT, const std::string& name = "")
+	{
+		unsigned int node = parents.size();
+		parents.push_back(parent);
+		localTransforms.push_back(localTransform);
+		worldTransforms.push_back(localTransform);
+		dirty.push_back(1);
+		names.push_back(name);
+		markDirty(node);
+		return node;
+	}
+
+	// Thread safe as long as each node is only set by one thread
+	void SetLocalTransform(unsigned int node, const glm::mat4& localTransform)
+	{
+		localTransforms[node] = localTransform;
+		dirty[node] = 1;
+		markDirty(node);
+	}
+
+	const glm::mat4& GetLocalTransform(unsigned int node) const { return localTransforms[node]; }
+	// World transform as of the last Update()
+	const glm::mat4& GetWorldTransform(unsigned int node) const { return worldTransforms[node]; }
+	unsigned int GetParent(unsigned int node) const { return parents[node]; }
+	const std::string& GetName(unsigned int node) const { return names[node]; }
+	unsigned int Size() const { return parents.size(); }
+
+	// First node with the given name, NO_PARENT if there is none
+	unsigned int Find(const std::string& name) const
+	{
+		for (unsigned int i = 0; i < names.size(); i++)
+			if (names[i] == name)
+				return i;
+		return NO_PARENT;
+	}
+
+	// Recomputes the world transforms of changed nodes and their descendants
+	void Update()
+	{
+		PROFILE_ZONE("SceneGraph::Update");
+		NumUpdated = 0;
+		unsigned int first = firstDirty.load();
+		unsigned int count = parents.size();
+		if (first >= count)
+			return;
+
+		// A node is recomputed if it changed or its parent was recomputed earlier in this pass;
+		// its flag then stays set so its own children follow
+		for (unsigned int i = first; i < count; i++)
+		{
+			unsigned int parent = parents[i];
+			if (parent == NO_PARENT)
+			{
+				if (dirty[i])
+				{
+					worldTransforms[i] = localTransforms[i];
+					NumUpdated++;
+				}
+			}
+			else if (dirty[i] || dirty[parent])
+			{
+				multiply(worldTransforms[parent], localTransforms[i], worldTransforms[i]);
+				dirty[i] = 1;
+				NumUpdated++;
+			}
+		}
+		memset(&dirty[first], 0, count - first);
+		firstDirty = NO_PARENT;
+	}
+
+private:
+	std::vector<unsigned int> parents;
+	std::vector<glm::mat4> localTransforms;
+	std::vector<glm::mat4> worldTransforms;
+	std::vector<unsigned char> dirty;
+	std::vector<std::string> names;
+	// Lowest dirty node, where Update() starts
+	std::atomic<unsigned int> firstDirty;
+
+	void markDirty(unsigned int node)
+	{
+		unsigned int current = firstDirty.load(std::memory_order_relaxed);
+		while (node < current && !firstDirty.compare_exchange_weak(current, node))
+		{
+		}
+	}
+
+	// result = a * b (column-major)
+	static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+	{
+#if SCENE_GRAPH_SSE
+		const float* pa = &a[0][0];
+		const float* pb = &b[0][0];
+		float* pr = &result[0][0];
+		__m128 a0 = _mm_loadu_ps(pa);
+		__m128 a1 = _mm_loadu_ps(pa + 4);
+		__m128 a2 = _mm_loadu_ps(pa + 8);
+		__m128 a3 = _mm_loadu_ps(pa + 12);
+		for (int column = 0; column < 4; column++)
+		{
+			// Column of the result is a's columns weighted by b's column
+			const float* bc = pb + column * 4;
+			__m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+			r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+			r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+			r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+			_mm_storeu_ps(pr + column * 4, r);
+		}
+#else
+		result = a * b;
+#endif
+	}
+};
+
+#endif
@@ -0,0 +1,707 @@
+#pragma once
+
+// CPU renderer drawing the same meshes, textures and Phong lights as the GL path, without a GL context.
+// Vertices are transformed and triangles set up (near clipped, back faces culled) in parallel batches, each
+// batch binning its triangles to the TILE_SIZE x TILE_SIZE screen tiles they touch. Tiles are then rendered
+// by the job system's threads, each walking the bins in submission order so the image doesn't depend on the
+// thread count: coverage and depth are tested 8 pixels at once with AVX2 (4 with SSE, otherwise 1), and every
+// covered pixel is shaded with perspective-correct varyings, trilinear texture sampling and the light math of
+// fragment_shader_model_src.glsl.
+
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <Mesh.h>
+#include <SceneComponents.h>
+#include <LightBuffer.h>
+#include <JobSystem.h>
+#include <Profiler.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SOFTWARE_RASTERIZER_SIMD_WIDTH 8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SOFTWARE_RASTERIZER_SIMD_WIDTH 4
+#else
+#define SOFTWARE_RASTERIZER_SIMD_WIDTH 1
+#endif
+
+// RGB8 texture with a full mip chain, sampled like GL_LINEAR_MIPMAP_LINEAR with GL_REPEAT wrapping
+class SoftwareTexture
+{
+public:
+	// Loads an image file (rows in the order stb_image returns them, as the GL loaders upload them) and
+	// builds its mip chain with a 2x2 box filter
+	bool Load(const std::string& path)
+	{
+		PROFILE_ZONE("SoftwareTexture::Load");
+		int width, height, numComponents;
+		unsigned char* data = stbi_load(path.c_str(), &width, &height, &numComponents, 3);
+		if (!data)
+		{
+			std::cout << "Texture failed to load at path: " << path << std::endl;
+			return false;
+		}
+		levels.clear();
+		Level base;
+		base.Width = width;
+		base.Height = height;
+		base.Texels.assign(data, data + width * height * 3);
+		stbi_image_free(data);
+		levels.push_back(base);
+		while (levels.back().Width > 1 || levels.back().Height > 1)
+			levels.push_back(downsample(levels.back()));
+		return true;
+	}
+
+	bool Empty() const { return levels.empty(); }
+	int Width() const { return levels.empty() ? 0 : levels[0].Width; }
+	int Height() const { return levels.empty() ? 0 : levels[0].Height; }
+
+	// Colour at uv, lod levels down the mip chain (blending the two nearest levels)
+	glm::vec3 Sample(const glm::vec2& uv, float lod) const
+	{
+		if (levels.empty())
+			return glm::vec3(1.0f);
+		lod = glm::clamp(lod, 0.0f, (float)(levels.size() - 1));
+		int level = (int)lod;
+		float blend = lod - level;
+		glm::vec3 color = bilinear(levels[level], uv);
+		if (blend > 0.0f)
+			color = glm::mix(color, bilinear(levels[level + 1], uv), blend);
+		return color;
+	}
+
+private:
+	struct Level {
+		int Width, Height;
+		std::vector<unsigned char> Texels;
+	};
+	std::vector<Level> levels;
+
+	static Level downsample(const Level& source)
+	{
+		Level level;
+		level.Width = std::max(1, source.Width / 2);
+		level.Height = std::max(1, source.Height / 2);
+		level.Texels.resize(level.Width * level.Height * 3);
+		for (int y = 0; y < level.Height; y++)
+		{
+			int y0 = std::min(y * 2, source.Height - 1), y1 = std::min(y * 2 + 1, source.Height - 1);
+			for (int x = 0; x < level.Width; x++)
+			{
+				int x0 = std::min(x * 2, source.Width - 1), x1 = std::min(x * 2 + 1, source.Width - 1);
+				for (int c = 0; c < 3; c++)
+				{
+					int sum = source.Texels[(y0 * source.Width + x0) * 3 + c] + source.Texels[(y0 * source.Width + x1) * 3 + c] +
+						source.Texels[(y1 * source.Width + x0) * 3 + c] + source.Texels[(y1 * source.Width + x1) * 3 + c];
+					level.Texels[(y * level.Width + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		return level;
+	}
+
+	static int wrap(int coordinate, int size)
+	{
+		coordinate %= size;
+		return coordinate < 0 ? coordinate + size : coordinate;
+	}
+
+	static glm::vec3 bilinear(const Level& level, const glm::vec2& uv)
+	{
+		// Texel centres are at + 0.5
+		float s = uv.x * level.Width - 0.5f, t = uv.y * level.Height - 0.5f;
+		float floorS = std::floor(s), floorT = std::floor(t);
+		float fx = s - floorS, fy = t - floorT;
+		int x0 = wrap((int)floorS, level.Width), x1 = wrap((int)floorS + 1, level.Width);
+		int y0 = wrap((int)floorT, level.Height), y1 = wrap((int)floorT + 1, level.Height);
+		const unsigned char* t00 = &level.Texels[(y0 * level.Width + x0) * 3];
+		const unsigned char* t10 = &level.Texels[(y0 * level.Width + x1) * 3];
+		const unsigned char* t01 = &level.Texels[(y1 * level.Width + x0) * 3];
+		const unsigned char* t11 = &level.Texels[(y1 * level.Width + x1) * 3];
+		glm::vec3 color;
+		for (int c = 0; c < 3; c++)
+		{
+			float bottom = t00[c] + (t10[c] - t00[c]) * fx;
+			float top = t01[c] + (t11[c] - t01[c]) * fx;
+			color[c] = (bottom + (top - bottom) * fy) * (1.0f / 255.0f);
+		}
+		return color;
+	}
+};
+
+class SoftwareRasterizer
+{
+public:
+	static const int TILE_SIZE = 64;
+	// Triangles per vertex and setup job batch (each batch keeps its own tile bins)
+	static const unsigned int BATCH_SIZE = 1024;
+
+	// Material of the model shader
+	glm::vec3 MaterialSpecular = glm::vec3(0.5f);
+	float MaterialShininess = 16.0f;
+	glm::vec3 ClearColor = glm::vec3(0.0f);
+
+	struct Stats {
+		unsigned int Triangles = 0; // submitted
+		unsigned int RasterizedTriangles = 0; // left after clipping and back face culling
+		unsigned long long Pixels = 0; // shaded (passed the depth test)
+		double Milliseconds = 0.0;
+
+		double MTrianglesPerSecond() const { return Milliseconds > 0.0 ? Triangles / (Milliseconds * 1000.0) : 0.0; }
+		double MPixelsPerSecond() const { return Milliseconds > 0.0 ? Pixels / (Milliseconds * 1000.0) : 0.0; }
+	};
+
+	void Resize(int width, int height)
+	{
+		this->width = width;
+		this->height = height;
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		// Rows are padded to whole tiles so SIMD batches never run off the end
+		stride = tilesX * TILE_SIZE;
+		color.assign(stride * tilesY * TILE_SIZE * 3, 0);
+		depth.assign(stride * tilesY * TILE_SIZE, 1.0f);
+	}
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+	// Starts a frame with the camera's matrices: forgets the last frame's draws and lights
+	void Begin(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition)
+	{
+		viewProj = projection * view;
+		this->cameraPosition = cameraPosition;
+		draws.clear();
+		dirLights.clear();
+		pointLights.clear();
+		flashlight.On = false;
+	}
+
+	// Adds an enabled light the way applyLights() hands it to the model shader: directional lights up to
+	// maxDirLights, point lights cut off at their attenuation radius, the first spot light as the flashlight
+	void AddLight(const LightComponent& light, unsigned int maxDirLights = 1)
+	{
+		if (!light.Enabled)
+			return;
+		glm::vec3 diffuse = light.Color * light.DiffuseIntensity;
+		if (light.Type == LIGHT_DIRECTIONAL)
+		{
+			if (dirLights.size() >= maxDirLights)
+				return;
+			DirLight dirLight = { glm::normalize(-light.Direction), diffuse * light.AmbientIntensity, diffuse, light.SpecularIntensity };
+			dirLights.push_back(dirLight);
+		}
+		else if (light.Type == LIGHT_POINT)
+		{
+			PointLight pointLight = { light.Position, diffuse * light.AmbientIntensity, diffuse, light.SpecularIntensity,
+				light.Constant, light.Linear, light.Quadratic, lightAttenuationRadius(light) };
+			pointLights.push_back(pointLight);
+		}
+		else if (!flashlight.On)
+		{
+			flashlight.On = true;
+			flashlight.Position = light.Position;
+			flashlight.Direction = glm::normalize(-light.Direction);
+			flashlight.Ambient = diffuse * light.AmbientIntensity;
+			flashlight.Diffuse = diffuse;
+			flashlight.Specular = light.SpecularIntensity;
+			flashlight.Constant = light.Constant;
+			flashlight.Linear = light.Linear;
+			flashlight.Quadratic = light.Quadratic;
+			flashlight.CutOff = glm::cos(glm::radians(light.CutOff));
+			flashlight.OuterCutOff = glm::cos(glm::radians(light.OuterCutOff));
+		}
+	}
+
+	// Queues the mesh's triangles with its model matrix and diffuse texture (NULL for white). The mesh and
+	// texture must outlive Render().
+	void Draw(const Mesh& mesh, const glm::mat4& modelMatrix, const SoftwareTexture* diffuse)
+	{
+		DrawItem draw;
+		draw.Source = &mesh;
+		draw.ModelMatrix = modelMatrix;
+		draw.NormalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+		draw.Diffuse = diffuse && !diffuse->Empty() ? diffuse : NULL;
+		draws.push_back(draw);
+	}
+
+	// Clears the framebuffer and renders the queued draws
+	void Render(JobSystem& jobSystem)
+	{
+		PROFILE_ZONE("SoftwareRasterizer::Render");
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		stats = Stats();
+
+		// Vertex and triangle offsets of each draw in the frame's arrays
+		unsigned int numVertices = 0, numTriangles = 0;
+		for (unsigned int i = 0; i < draws.size(); i++)
+		{
+			draws[i].FirstVertex = numVertices;
+			draws[i].FirstTriangle = numTriangles;
+			numVertices += draws[i].Source->vertices.size();
+			numTriangles += draws[i].Source->indices.size() / 3;
+		}
+		stats.Triangles = numTriangles;
+
+		// Vertex stage
+		vertices.resize(numVertices);
+		jobSystem.ParallelFor(numVertices, BATCH_SIZE * 2, [&](unsigned int begin, unsigned int end, unsigned int) {
+			unsigned int drawIndex = findDraw(begin, true);
+			for (unsigned int i = begin; i < end; i++)
+			{
+				while (drawIndex + 1 < draws.size() && i >= draws[drawIndex + 1].FirstVertex)
+					drawIndex++;
+				const DrawItem& draw = draws[drawIndex];
+				const Vertex& vertex = draw.Source->vertices[i - draw.FirstVertex];
+				ShadedVertex& out = vertices[i];
+				glm::vec4 world = draw.ModelMatrix * glm::vec4(vertex.Position, 1.0f);
+				out.Clip = viewProj * world;
+				out.World = glm::vec3(world);
+				out.Normal = draw.NormalMatrix * vertex.Normal;
+				out.TexCoords = vertex.TexCoords;
+			}
+		});
+
+		// Setup and binning, each batch into its own triangles and bins
+		unsigned int numBatches = (numTriangles + BATCH_SIZE - 1) / BATCH_SIZE;
+		if (batches.size() < numBatches)
+			batches.resize(numBatches);
+		jobSystem.ParallelFor(numTriangles, BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int) {
+			// A single-threaded job system runs the whole range at once
+			for (unsigned int first = begin; first < end; first += BATCH_SIZE)
+				setupBatch(batches[first / BATCH_SIZE], first, std::min(first + BATCH_SIZE, end));
+		});
+		for (unsigned int i = 0; i < numBatches; i++)
+			stats.RasterizedTriangles += batches[i].Triangles.size();
+
+		// Tiles
+		std::vector<unsigned long long> threadPixels(jobSystem.NumThreads(), 0);
+		jobSystem.ParallelFor(tilesX * tilesY, 1, [&](unsigned int begin, unsigned int end, unsigned int threadIndex) {
+			for (unsigned int tile = begin; tile < end; tile++)
+				threadPixels[threadIndex] += renderTile(tile, numBatches);
+		});
+		for (unsigned int i = 0; i < threadPixels.size(); i++)
+			stats.Pixels += threadPixels[i];
+
+		stats.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Statistics of the last Render()
+	const Stats& LastStats() const { return stats; }
+
+	// Colour at a pixel, row 0 at the bottom
+	glm::vec3 Pixel(int x, int y) const
+	{
+		const unsigned char* pixel = &color[(y * stride + x) * 3];
+		return glm::vec3(pixel[0], pixel[1], pixel[2]) / 255.0f;
+	}
+
+	// Writes the colour buffer to a binary PPM image
+	bool SaveImage(const std::string& path) const
+	{
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (!file)
+		{
+			std::cout << "ERROR::SOFTWARE_RASTERIZER::IMAGE_NOT_WRITTEN " << path << std::endl;
+			return false;
+		}
+		file << "P6\n" << width << " " << height << "\n255\n";
+		// Rows start at the bottom, like GL's
+		for (int row = height - 1; row >= 0; row--)
+			file.write((const char*)&color[row * stride * 3], width * 3);
+		return true;
+	}
+
+private:
+	// Varyings of the model shader: world position, normal, texture coordinates
+	static const int NUM_VARYINGS = 8;
+
+	struct DrawItem {
+		const Mesh* Source;
+		glm::mat4 ModelMatrix;
+		glm::mat3 NormalMatrix;
+		const SoftwareTexture* Diffuse;
+		unsigned int FirstVertex, FirstTriangle;
+	};
+
+	struct ShadedVertex {
+		glm::vec4 Clip;
+		glm::vec3 World;
+		glm::vec3 Normal;
+		glm::vec2 TexCoords;
+
+		float Varying(int i) const { return i < 3 ? World[i] : i < 6 ? Normal[i - 3] : TexCoords[i - 6]; }
+	};
+
+	// Screen space triangle: inside where all three edge functions A * x + B * y + C are >= EdgeMin (0 on top
+	// and left edges, just above 0 on the others so pixels on shared edges are drawn once). Depth, 1 / w and
+	// every varying divided by w are planes A * x + B * y + C over the screen.
+	struct Triangle {
+		float EdgeA[3], EdgeB[3], EdgeC[3], EdgeMin[3];
+		float Z[3];
+		float InvW[3];
+		float Varyings[NUM_VARYINGS][3];
+		int MinX, MaxX, MinY, MaxY; // pixels whose centres may be covered
+		unsigned int Draw;
+	};
+
+	struct Batch {
+		std::vector<Triangle> Triangles;
+		std::vector<std::vector<unsigned int> > Bins; // triangles touching each tile, in submission order
+	};
+
+	struct DirLight {
+		glm::vec3 ToLight, Ambient, Diffuse, Specular;
+	};
+	struct PointLight {
+		glm::vec3 Position, Ambient, Diffuse, Specular;
+		float Constant, Linear, Quadratic, Radius;
+	};
+	struct SpotLight {
+		bool On = false;
+		glm::vec3 Position, Direction, Ambient, Diffuse, Specular; // Direction points back towards the light
+		float Constant, Linear, Quadratic, CutOff, OuterCutOff;
+	};
+
+	int width = 0, height = 0, stride = 0, tilesX = 0, tilesY = 0;
+	std::vector<unsigned char> color;
+	std::vector<float> depth;
+	glm::mat4 viewProj = glm::mat4(1.0f);
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	std::vector<DrawItem> draws;
+	std::vector<DirLight> dirLights;
+	std::vector<PointLight> pointLights;
+	SpotLight flashlight;
+	std::vector<ShadedVertex> vertices;
+	std::vector<Batch> batches;
+	Stats stats;
+
+	// Draw holding the given vertex or triangle
+	unsigned int findDraw(unsigned int index, bool vertex) const
+	{
+		unsigned int drawIndex = 0;
+		while (drawIndex + 1 < draws.size() && index >= (vertex ? draws[drawIndex + 1].FirstVertex : draws[drawIndex + 1].FirstTriangle))
+			drawIndex++;
+		return drawIndex;
+	}
+
+	void setupBatch(Batch& batch, unsigned int begin, unsigned int end)
+	{
+		batch.Triangles.clear();
+		batch.Bins.resize(tilesX * tilesY);
+		for (unsigned int i = 0; i < batch.Bins.size(); i++)
+			batch.Bins[i].clear();
+		unsigned int drawIndex = findDraw(begin, false);
+		for (unsigned int i = begin; i < end; i++)
+		{
+			while (drawIndex + 1 < draws.size() && i >= draws[drawIndex + 1].FirstTriangle)
+				drawIndex++;
+			const DrawItem& draw = draws[drawIndex];
+			const unsigned int* indices = &draw.Source->indices[(i - draw.FirstTriangle) * 3];
+			ShadedVertex polygon[4];
+			int count = clipNear(vertices[draw.FirstVertex + indices[0]], vertices[draw.FirstVertex + indices[1]],
+				vertices[draw.FirstVertex + indices[2]], polygon);
+			for (int v = 1; v + 1 < count; v++)
+				setupTriangle(batch, polygon[0], polygon[v], polygon[v + 1], drawIndex);
+		}
+	}
+
+	// Clips a triangle to z >= -w (the near plane). Returns the polygon's vertex count.
+	static int clipNear(const ShadedVertex& a, const ShadedVertex& b, const ShadedVertex& c, ShadedVertex* out)
+	{
+		const ShadedVertex* input[3] = { &a, &b, &c };
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const ShadedVertex& current = *input[i];
+			const ShadedVertex& next = *input[(i + 1) % 3];
+			float currentDistance = current.Clip.z + current.Clip.w;
+			float nextDistance = next.Clip.z + next.Clip.w;
+			if (currentDistance >= 0.0f)
+				out[count++] = current;
+			if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			{
+				float t = currentDistance / (currentDistance - nextDistance);
+				ShadedVertex& split = out[count++];
+				split.Clip = glm::mix(current.Clip, next.Clip, t);
+				split.World = glm::mix(current.World, next.World, t);
+				split.Normal = glm::mix(current.Normal, next.Normal, t);
+				split.TexCoords = glm::mix(current.TexCoords, next.TexCoords, t);
+			}
+		}
+		return count;
+	}
+
+	// Plane through three screen space points with values f0, f1, f2, as A, B, C of A * x + B * y + C
+	static void setupPlane(const glm::vec2* screen, float area, float f0, float f1, float f2, float* plane)
+	{
+		plane[0] = ((f1 - f0) * (screen[2].y - screen[0].y) - (f2 - f0) * (screen[1].y - screen[0].y)) / area;
+		plane[1] = ((f2 - f0) * (screen[1].x - screen[0].x) - (f1 - f0) * (screen[2].x - screen[0].x)) / area;
+		plane[2] = f0 - plane[0] * screen[0].x - plane[1] * screen[0].y;
+	}
+
+	void setupTriangle(Batch& batch, const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2, unsigned int drawIndex)
+	{
+		const ShadedVertex* vertex[3] = { &v0, &v1, &v2 };
+		glm::vec2 screen[3];
+		float invW[3], z[3];
+		for (int i = 0; i < 3; i++)
+		{
+			invW[i] = 1.0f / vertex[i]->Clip.w;
+			screen[i] = glm::vec2((vertex[i]->Clip.x * invW[i] * 0.5f + 0.5f) * width, (vertex[i]->Clip.y * invW[i] * 0.5f + 0.5f) * height);
+			z[i] = vertex[i]->Clip.z * invW[i] * 0.5f + 0.5f;
+		}
+		// Twice the signed area, positive for front faces (counterclockwise with y up); back faces are culled
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (!(area > 0.0f))
+			return;
+		// Pixel centres are at + 0.5
+		float minX = std::min(std::min(screen[0].x, screen[1].x), screen[2].x) - 0.5f, maxX = std::max(std::max(screen[0].x, screen[1].x), screen[2].x) - 0.5f;
+		float minY = std::min(std::min(screen[0].y, screen[1].y), screen[2].y) - 0.5f, maxY = std::max(std::max(screen[0].y, screen[1].y), screen[2].y) - 0.5f;
+		Triangle triangle;
+		triangle.MinX = (int)std::ceil(glm::clamp(minX, 0.0f, (float)width));
+		triangle.MaxX = (int)std::floor(glm::clamp(maxX, -1.0f, (float)(width - 1)));
+		triangle.MinY = (int)std::ceil(glm::clamp(minY, 0.0f, (float)height));
+		triangle.MaxY = (int)std::floor(glm::clamp(maxY, -1.0f, (float)(height - 1)));
+		if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+			return;
+		for (int e = 0; e < 3; e++)
+		{
+			const glm::vec2& from = screen[e];
+			const glm::vec2& to = screen[(e + 1) % 3];
+			triangle.EdgeA[e] = from.y - to.y;
+			triangle.EdgeB[e] = to.x - from.x;
+			triangle.EdgeC[e] = -(triangle.EdgeA[e] * from.x + triangle.EdgeB[e] * from.y);
+			// Left edges run downwards, top edges leftwards
+			bool topLeft = triangle.EdgeA[e] > 0.0f || (triangle.EdgeA[e] == 0.0f && triangle.EdgeB[e] < 0.0f);
+			triangle.EdgeMin[e] = topLeft ? 0.0f : FLT_MIN;
+		}
+		setupPlane(screen, area, z[0], z[1], z[2], triangle.Z);
+		setupPlane(screen, area, invW[0], invW[1], invW[2], triangle.InvW);
+		for (int i = 0; i < NUM_VARYINGS; i++)
+			setupPlane(screen, area, v0.Varying(i) * invW[0], v1.Varying(i) * invW[1], v2.Varying(i) * invW[2], triangle.Varyings[i]);
+		triangle.Draw = drawIndex;
+
+		unsigned int index = batch.Triangles.size();
+		batch.Triangles.push_back(triangle);
+		for (int ty = triangle.MinY / TILE_SIZE; ty <= triangle.MaxY / TILE_SIZE; ty++)
+		{
+			for (int tx = triangle.MinX / TILE_SIZE; tx <= triangle.MaxX / TILE_SIZE; tx++)
+				batch.Bins[ty * tilesX + tx].push_back(index);
+		}
+	}
+
+	// Clears the tile and draws every triangle binned to it. Returns the number of pixels shaded.
+	unsigned long long renderTile(unsigned int tile, unsigned int numBatches)
+	{
+		int tileX = (tile % tilesX) * TILE_SIZE, tileY = (tile / tilesX) * TILE_SIZE;
+		unsigned char clear[3];
+		for (int c = 0; c < 3; c++)
+			clear[c] = toByte(ClearColor[c]);
+		for (int y = tileY; y < tileY + TILE_SIZE; y++)
+		{
+			std::fill(depth.begin() + y * stride + tileX, depth.begin() + y * stride + tileX + TILE_SIZE, 1.0f);
+			for (int x = tileX; x < tileX + TILE_SIZE; x++)
+				std::copy(clear, clear + 3, &color[(y * stride + x) * 3]);
+		}
+		unsigned long long shaded = 0;
+		for (unsigned int b = 0; b < numBatches; b++)
+		{
+			const Batch& batch = batches[b];
+			const std::vector<unsigned int>& bin = batch.Bins[tile];
+			for (unsigned int i = 0; i < bin.size(); i++)
+			{
+				const Triangle& triangle = batch.Triangles[bin[i]];
+				int y0 = std::max(triangle.MinY, tileY), y1 = std::min(triangle.MaxY, tileY + TILE_SIZE - 1);
+				// SIMD batches start on a multiple of the width, inside the tile
+				int x0 = std::max(triangle.MinX, tileX) / SOFTWARE_RASTERIZER_SIMD_WIDTH * SOFTWARE_RASTERIZER_SIMD_WIDTH;
+				int x1 = std::min(triangle.MaxX, tileX + TILE_SIZE - 1);
+				for (int y = y0; y <= y1; y++)
+					shaded += rasterizeSpan(triangle, y, x0, x1);
+			}
+		}
+		return shaded;
+	}
+
+	// Depth tests the covered pixel centres of row y from x0 to x1, writes the depth of the ones that pass
+	// and shades them. Returns the number shaded.
+	unsigned int rasterizeSpan(const Triangle& triangle, int y, int x0, int x1)
+	{
+		float centerY = y + 0.5f;
+		float rowEdge[3];
+		for (int e = 0; e < 3; e++)
+			rowEdge[e] = triangle.EdgeB[e] * centerY + triangle.EdgeC[e];
+		float rowZ = triangle.Z[1] * centerY + triangle.Z[2];
+		float* depthRow = &depth[y * stride];
+		unsigned int shaded = 0;
+#if SOFTWARE_RASTERIZER_SIMD_WIDTH == 8
+		__m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256 a0 = _mm256_set1_ps(triangle.EdgeA[0]), a1 = _mm256_set1_ps(triangle.EdgeA[1]), a2 = _mm256_set1_ps(triangle.EdgeA[2]);
+		__m256 c0 = _mm256_set1_ps(rowEdge[0]), c1 = _mm256_set1_ps(rowEdge[1]), c2 = _mm256_set1_ps(rowEdge[2]);
+		__m256 m0 = _mm256_set1_ps(triangle.EdgeMin[0]), m1 = _mm256_set1_ps(triangle.EdgeMin[1]), m2 = _mm256_set1_ps(triangle.EdgeMin[2]);
+		__m256 za = _mm256_set1_ps(triangle.Z[0]), zc = _mm256_set1_ps(rowZ);
+		// Lanes past x1 may be inside a triangle that runs off the right of the screen
+		__m256 limit = _mm256_set1_ps((float)(x1 + 1));
+		for (int x = x0; x <= x1; x += 8)
+		{
+			__m256 centerX = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+			__m256 pass = _mm256_cmp_ps(centerX, limit, _CMP_LT_OQ);
+			pass = _mm256_and_ps(pass, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, centerX), c0), m0, _CMP_GE_OQ));
+			pass = _mm256_and_ps(pass, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, centerX), c1), m1, _CMP_GE_OQ));
+			pass = _mm256_and_ps(pass, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, centerX), c2), m2, _CMP_GE_OQ));
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(za, centerX), zc);
+			__m256 current = _mm256_loadu_ps(depthRow + x);
+			pass = _mm256_and_ps(pass, _mm256_cmp_ps(z, current, _CMP_LT_OQ));
+			int mask = _mm256_movemask_ps(pass);
+			if (!mask)
+				continue;
+			_mm256_storeu_ps(depthRow + x, _mm256_blendv_ps(current, z, pass));
+			shaded += shadeMask(triangle, x, y, mask);
+		}
+#elif SOFTWARE_RASTERIZER_SIMD_WIDTH == 4
+		__m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 a0 = _mm_set1_ps(triangle.EdgeA[0]), a1 = _mm_set1_ps(triangle.EdgeA[1]), a2 = _mm_set1_ps(triangle.EdgeA[2]);
+		__m128 c0 = _mm_set1_ps(rowEdge[0]), c1 = _mm_set1_ps(rowEdge[1]), c2 = _mm_set1_ps(rowEdge[2]);
+		__m128 m0 = _mm_set1_ps(triangle.EdgeMin[0]), m1 = _mm_set1_ps(triangle.EdgeMin[1]), m2 = _mm_set1_ps(triangle.EdgeMin[2]);
+		__m128 za = _mm_set1_ps(triangle.Z[0]), zc = _mm_set1_ps(rowZ);
+		// Lanes past x1 may be inside a triangle that runs off the right of the screen
+		__m128 limit = _mm_set1_ps((float)(x1 + 1));
+		for (int x = x0; x <= x1; x += 4)
+		{
+			__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			__m128 pass = _mm_cmplt_ps(centerX, limit);
+			pass = _mm_and_ps(pass, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, centerX), c0), m0));
+			pass = _mm_and_ps(pass, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, centerX), c1), m1));
+			pass = _mm_and_ps(pass, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, centerX), c2), m2));
+			__m128 z = _mm_add_ps(_mm_mul_ps(za, centerX), zc);
+			__m128 current = _mm_loadu_ps(depthRow + x);
+			pass = _mm_and_ps(pass, _mm_cmplt_ps(z, current));
+			int mask = _mm_movemask_ps(pass);
+			if (!mask)
+				continue;
+			_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, current)));
+			shaded += shadeMask(triangle, x, y, mask);
+		}
+#else
+		for (int x = x0; x <= x1; x++)
+		{
+			float centerX = x + 0.5f;
+			if (triangle.EdgeA[0] * centerX + rowEdge[0] < triangle.EdgeMin[0] || triangle.EdgeA[1] * centerX + rowEdge[1] < triangle.EdgeMin[1] ||
+				triangle.EdgeA[2] * centerX + rowEdge[2] < triangle.EdgeMin[2])
+				continue;
+			float z = triangle.Z[0] * centerX + rowZ;
+			if (!(z < depthRow[x]))
+				continue;
+			depthRow[x] = z;
+			shaded += shadeMask(triangle, x, y, 1);
+		}
+#endif
+		return shaded;
+	}
+
+	// Shades the pixels of row y starting at x whose bits are set in mask
+	unsigned int shadeMask(const Triangle& triangle, int x, int y, int mask)
+	{
+		const DrawItem& draw = draws[triangle.Draw];
+		const SoftwareTexture* texture = draw.Diffuse;
+		float centerY = y + 0.5f;
+		unsigned int shaded = 0;
+		for (int lane = 0; mask; lane++, mask >>= 1)
+		{
+			if (!(mask & 1))
+				continue;
+			float centerX = x + lane + 0.5f;
+			// Perspective-correct varyings: each divided by w is linear on screen
+			float invW = triangle.InvW[0] * centerX + triangle.InvW[1] * centerY + triangle.InvW[2];
+			float w = 1.0f / invW;
+			float varyings[NUM_VARYINGS];
+			for (int i = 0; i < NUM_VARYINGS; i++)
+				varyings[i] = (triangle.Varyings[i][0] * centerX + triangle.Varyings[i][1] * centerY + triangle.Varyings[i][2]) * w;
+			glm::vec3 fragPos(varyings[0], varyings[1], varyings[2]);
+			glm::vec3 normal(varyings[3], varyings[4], varyings[5]);
+			glm::vec2 texCoords(varyings[6], varyings[7]);
+
+			glm::vec3 albedo(1.0f);
+			if (texture)
+			{
+				// Screen space derivatives of the texture coordinates, d(u / w * w) = (dU - u * dW) * w, in texels
+				glm::vec2 dx((triangle.Varyings[6][0] - texCoords.x * triangle.InvW[0]) * w, (triangle.Varyings[7][0] - texCoords.y * triangle.InvW[0]) * w);
+				glm::vec2 dy((triangle.Varyings[6][1] - texCoords.x * triangle.InvW[1]) * w, (triangle.Varyings[7][1] - texCoords.y * triangle.InvW[1]) * w);
+				glm::vec2 size((float)texture->Width(), (float)texture->Height());
+				float footprint = std::max(glm::dot(dx * size, dx * size), glm::dot(dy * size, dy * size));
+				float lod = footprint > 0.0f ? 0.5f * std::log2(footprint) : 0.0f;
+				albedo = texture->Sample(texCoords, lod);
+			}
+			glm::vec3 result = shade(fragPos, glm::normalize(normal), albedo);
+
+			int pixel = (y * stride + x + lane) * 3;
+			color[pixel] = toByte(result.r);
+			color[pixel + 1] = toByte(result.g);
+			color[pixel + 2] = toByte(result.b);
+			shaded++;
+		}
+		return shaded;
+	}
+
+	// Phong lighting of fragment_shader_model_src.glsl
+	glm::vec3 shade(const glm::vec3& fragPos, const glm::vec3& normal, const glm::vec3& albedo) const
+	{
+		glm::vec3 viewDir = glm::normalize(cameraPosition - fragPos);
+		glm::vec3 result(0.0f);
+		for (unsigned int i = 0; i < dirLights.size(); i++)
+		{
+			const DirLight& light = dirLights[i];
+			float diff = std::max(0.0f, glm::dot(normal, light.ToLight));
+			float spec = std::pow(std::max(glm::dot(viewDir, glm::reflect(-light.ToLight, normal)), 0.0f), MaterialShininess);
+			result += light.Ambient * albedo + light.Diffuse * diff * albedo + light.Specular * spec * MaterialSpecular;
+		}
+		for (unsigned int i = 0; i < pointLights.size(); i++)
+		{
+			const PointLight& light = pointLights[i];
+			glm::vec3 toLight = light.Position - fragPos;
+			float distance = glm::length(toLight);
+			if (distance > light.Radius)
+				continue;
+			glm::vec3 lightDir = toLight / distance;
+			float diff = std::max(glm::dot(normal, lightDir), 0.0f);
+			float spec = std::pow(std::max(glm::dot(viewDir, glm::reflect(-lightDir, normal)), 0.0f), MaterialShininess);
+			float attenuation = 1.0f / (light.Constant + light.Linear * distance + light.Quadratic * (distance * distance));
+			result += (light.Ambient * albedo + light.Diffuse * diff * albedo + light.Specular * spec * MaterialSpecular) * attenuation;
+		}
+		if (flashlight.On)
+		{
+			glm::vec3 toLight = flashlight.Position - fragPos;
+			float distance = glm::length(toLight);
+			glm::vec3 lightDir = toLight / distance;
+			float diff = std::max(0.0f, glm::dot(normal, lightDir));
+			float spec = std::pow(std::max(glm::dot(viewDir, glm::reflect(-lightDir, normal)), 0.0f), MaterialShininess);
+			// The shader's flashlight is 2.6 times brighter than the attenuation alone
+			float attenuation = 2.6f / (flashlight.Constant + flashlight.Linear * distance + flashlight.Quadratic * (distance * distance));
+			// Smooth edge between the inner and outer cone
+			float theta = glm::dot(lightDir, flashlight.Direction);
+			float intensity = glm::clamp((theta - flashlight.OuterCutOff) / (flashlight.CutOff - flashlight.OuterCutOff), 0.0f, 1.0f);
+			result += (flashlight.Ambient * albedo + flashlight.Diffuse * diff * albedo + flashlight.Specular * spec * MaterialSpecular) * attenuation * intensity;
+		}
+		return result;
+	}
+
+	static unsigned char toByte(float value)
+	{
+		return (unsigned char)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+};
+
+#endif
@@ -0,0 +1,253 @@
+#pragma once
+
+// Ring buffer for data written by the CPU every frame (uniform blocks, and any per-frame instance or vertex
+// data), split into NUM_FRAMES regions. Each frame bump-allocates from its own region and the ranges are bound
+// with glBindBufferRange, so nothing is orphaned or re-specified. A fence is placed after each frame's commands,
+// and a region is only reused once the GPU has passed the fence of the frame that last used it.
+//
+// With ARB_buffer_storage (or GL 4.4) the buffer is mapped once, persistently and coherently, and allocations
+// are written in place. On plain GL 3.3 each allocation is mapped with GL_MAP_UNSYNCHRONIZED_BIT instead, which
+// the fences make safe.
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+class StreamBuffer
+{
+public:
+	static const unsigned int NUM_FRAMES = 3;
+
+	// Range of the buffer written this frame. Data is only valid until Commit().
+	struct Allocation {
+		GLintptr Offset = 0;
+		GLsizeiptr Size = 0;
+		void* Data = NULL;
+	};
+
+	// Statistics of the current frame, and the totals
+	double FenceWaitMilliseconds = 0.0; // spent in BeginFrame() waiting for the region to be free
+	GLsizeiptr BytesAllocated = 0;
+	unsigned int FailedAllocations = 0; // didn't fit in the region
+	double TotalFenceWaitMilliseconds = 0.0;
+	unsigned int FramesWaited = 0; // frames whose region wasn't free yet
+
+	// Creates the buffer with frameSize bytes per region. allowPersistent false uses the GL 3.3 path even
+	// when buffer storage is available (for comparison).
+	void Init(GLADloadproc loadProc, GLsizeiptr frameSize, bool allowPersistent = true)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		uniformAlignment = alignment;
+		// Regions start on the strictest alignment anything allocated from them needs
+		regionSize = align(frameSize, uniformAlignment);
+		GLsizeiptr size = regionSize * NUM_FRAMES;
+
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (allowPersistent && (major > 4 || (major == 4 && minor >= 4) || hasExtension("GL_ARB_buffer_storage")))
+			bufferStorage = (BufferStorageFunction)loadProc("glBufferStorage");
+		persistent = bufferStorage != NULL;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			bufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+			if (!mapped)
+			{
+				std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED" << std::endl;
+				// Buffer storage is immutable, so start over with a mutable buffer
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				glDeleteBuffers(1, &buffer);
+				glGenBuffers(1, &buffer);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				persistent = false;
+			}
+		}
+		if (!persistent)
+			glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		for (unsigned int i = 0; i < NUM_FRAMES; i++)
+			fences[i] = 0;
+		frame = 0;
+		head = 0;
+		overflowReported = false;
+	}
+
+	void Release()
+	{
+		if (!buffer)
+			return;
+		for (unsigned int i = 0; i < NUM_FRAMES; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		if (mapped)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			mapped = NULL;
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+
+	bool Initialized() const { return buffer != 0; }
+	bool Persistent() const { return persistent; }
+	GLuint Buffer() const { return buffer; }
+	GLsizeiptr FrameSize() const { return regionSize; }
+	// Alignment of uniform block ranges (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+	GLsizeiptr UniformAlignment() const { return uniformAlignment; }
+
+	// Starts allocating from the next region, waiting until the GPU has finished the frame that used it last
+	void BeginFrame()
+	{
+		FenceWaitMilliseconds = 0.0;
+		BytesAllocated = 0;
+		FailedAllocations = 0;
+		head = 0;
+		GLsync& fence = fences[frame % NUM_FRAMES];
+		if (!fence)
+			return;
+		// Already signalled unless the GPU is NUM_FRAMES - 1 frames behind
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			GLenum result;
+			do
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			while (result == GL_TIMEOUT_EXPIRED);
+			if (result == GL_WAIT_FAILED)
+				std::cout << "ERROR::STREAM_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+			FenceWaitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			TotalFenceWaitMilliseconds += FenceWaitMilliseconds;
+			FramesWaited++;
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	// Fences the commands that use this frame's region. Call after the frame's last draw.
+	void EndFrame()
+	{
+		GLsync& fence = fences[frame % NUM_FRAMES];
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		frame++;
+	}
+
+	// Reserves size bytes of this frame's region at the given alignment and maps them for writing. If the
+	// region is full the allocation fails (Size 0, no Data, and BindRange() skips it) rather than overwrite
+	// ranges already bound this frame; FailedAllocations counts them.
+	Allocation Allocate(GLsizeiptr size, GLsizeiptr alignment)
+	{
+		Allocation allocation;
+		GLsizeiptr offset = align(head, alignment);
+		if (offset + size > regionSize)
+		{
+			if (!overflowReported)
+				std::cout << "ERROR::STREAM_BUFFER::FRAME_REGION_FULL " << size << " bytes requested, " << regionSize << " per frame" << std::endl;
+			overflowReported = true;
+			FailedAllocations++;
+			return allocation;
+		}
+		head = offset + size;
+		BytesAllocated += size;
+		allocation.Offset = (frame % NUM_FRAMES) * regionSize + offset;
+		allocation.Size = size;
+		if (persistent)
+			allocation.Data = mapped + allocation.Offset;
+		else
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			allocation.Data = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.Offset, size,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		return allocation;
+	}
+
+	// Finishes writing an allocation (the persistent mapping is coherent, so only the GL 3.3 path unmaps)
+	void Commit(Allocation& allocation)
+	{
+		if (!persistent && allocation.Data)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		allocation.Data = NULL;
+	}
+
+	// Allocates, copies and commits in one go
+	Allocation Write(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+	{
+		Allocation allocation = Allocate(size, alignment);
+		if (allocation.Data)
+			memcpy(allocation.Data, data, size);
+		Commit(allocation);
+		return allocation;
+	}
+
+	// Binds an allocation to an indexed binding point (GL_UNIFORM_BUFFER for uniform blocks)
+	void BindRange(GLenum target, GLuint index, const Allocation& allocation) const
+	{
+		if (allocation.Size > 0)
+			glBindBufferRange(target, index, buffer, allocation.Offset, allocation.Size);
+	}
+
+private:
+	typedef void (APIENTRY* BufferStorageFunction)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+	BufferStorageFunction bufferStorage = NULL;
+	GLuint buffer = 0;
+	unsigned char* mapped = NULL;
+	bool persistent = false;
+	GLsizeiptr regionSize = 0;
+	GLsizeiptr uniformAlignment = 256;
+	GLsizeiptr head = 0; // next free byte of the current region
+	GLsync fences[NUM_FRAMES];
+	unsigned int frame = 0;
+	bool overflowReported = false;
+
+	static GLsizeiptr align(GLsizeiptr value, GLsizeiptr alignment)
+	{
+		return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+	}
+
+	static bool hasExtension(const char* name)
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+		for (GLint i = 0; i < numExtensions; i++)
+		{
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension && strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+};
+
+#endif
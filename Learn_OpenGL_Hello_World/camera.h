@@ -5,7 +5,6 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -65,11 +64,62 @@ public:
     }
 
     // Returns the view matrix calculated using Euler Angles and the LookAt Matrix
+    // The matrix is cached and only rebuilt after the camera has moved or turned
     glm::mat4 GetViewMatrix()
     {
-        return glm::lookAt(Position, Position + Front, Up);
+        if (viewDirty)
+        {
+            viewMatrix = glm::lookAt(Position, Position + Front, Up);
+            viewDirty = false;
+        }
+        return viewMatrix;
+    }
+
+    // Returns the perspective projection matrix for the current zoom (field of view)
+    // The matrix is cached and only rebuilt when the zoom, aspect ratio or clip planes change
+    glm::mat4 GetProjectionMatrix(float aspectRatio, float nearPlane = 0.1f, float farPlane = 100.0f)
+    {
+        if (projDirty || aspectRatio != projAspect || nearPlane != projNear || farPlane != projFar)
+        {
+            projMatrix = glm::perspective(glm::radians(Zoom), aspectRatio, nearPlane, farPlane);
+            projAspect = aspectRatio;
+            projNear = nearPlane;
+            projFar = farPlane;
+            projDirty = false;
+            ProjectionVersion++;
+        }
+        return projMatrix;
+    }
+
+    // Sets the whole camera pose at once (e.g. from an interpolated simulation state)
+    // Cached matrices are only invalidated when the pose actually changed
+    void SetPose(glm::vec3 position, float yaw, float pitch, float zoom)
+    {
+        if (position != Position || yaw != Yaw || pitch != Pitch)
+        {
+            Position = position;
+            Yaw = yaw;
+            Pitch = pitch;
+            updateCameraVectors();
+        }
+        if (zoom != Zoom)
+        {
+            Zoom = zoom;
+            projDirty = true;
+        }
     }
 
+    // Must be called after writing Position, Yaw, Pitch or Zoom directly
+    void Invalidate()
+    {
+        updateCameraVectors();
+        projDirty = true;
+    }
+
+    // Incremented whenever the view/projection changes, so dependent data (inverses, frustum planes) can be cached
+    unsigned int ViewVersion = 0;
+    unsigned int ProjectionVersion = 0;
+
     // Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -82,10 +132,11 @@ public:
             Position -= Right * velocity;
         if (direction == RIGHT)
             Position += Right * velocity;
+        markViewDirty();
     }
 
     // Processes input received from a mouse input system. Expects the offset value in both the x and y direction.
-    void ProcessMouseMovement(float xOffset, float yOffset, GLboolean constrainPitch = true)
+    void ProcessMouseMovement(float xOffset, float yOffset, bool constrainPitch = true)
     {
         xOffset *= MouseSensitivity;
         yOffset *= MouseSensitivity;
@@ -117,9 +168,25 @@ public:
             Zoom = fov_min;
         if (Zoom >= fov_max)
             Zoom = fov_max;
+        projDirty = true;
     }
 
 private:
+    // Cached matrices and their dirty flags
+    glm::mat4 viewMatrix;
+    glm::mat4 projMatrix;
+    bool viewDirty = true;
+    bool projDirty = true;
+    float projAspect = 0.0f;
+    float projNear = 0.0f;
+    float projFar = 0.0f;
+
+    void markViewDirty()
+    {
+        viewDirty = true;
+        ViewVersion++;
+    }
+
     // Calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
     {
@@ -132,6 +199,7 @@ private:
         // Also re-calculate the Right and Up vector
         Right = glm::normalize(glm::cross(Front, WorldUp));  // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
         Up = glm::normalize(glm::cross(Right, Front));
+        markViewDirty();
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#version 330 core
+
+	// First deferred lighting pass, full-screen: the directional light of each receiver group. Point and spot
+	// lights are added on top by the light volumes.
+	out vec4 FragColor;
+
+	uniform sampler2D gAlbedoSpecular;
+	uniform sampler2D gNormalReceiver;
+	uniform sampler2D gDepth;
+
+	uniform mat4 inverseViewProj;
+	uniform vec2 viewportSize;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+	uniform float shininess;
+
+	struct DirLight {
+		vec3 direction;
+		vec3 ambient;
+		vec3 diffuse;
+		vec3 specular;
+	};
+	// One per receiver group (cubes, models)
+	uniform DirLight dirLights[2];
+
+	// Cascaded shadow map of the directional light dirLights[shadowedDirLight] (-1 for none, see CascadedShadows.h). The
+	// first cascade whose layer covers the fragment is used, nearer cascades cover less at a higher resolution.
+	#define MAX_SHADOW_CASCADES 4
+	uniform sampler2DArrayShadow shadowMap;
+	uniform int numShadowCascades;
+	uniform int shadowedDirLight;
+	uniform mat4 shadowMatrices[MAX_SHADOW_CASCADES]; // world to shadow map coordinates and depth
+	uniform float shadowNormalOffsets[MAX_SHADOW_CASCADES]; // world distance the receiver is moved along its normal
+
+	vec3 CalcDirLight(DirLight light, vec3 albedo, float specularIntensity, vec3 normal, vec3 viewDir, float shadow);
+	float CalcCascadeShadow(vec3 fragPos, vec3 normal);
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 normalReceiver = texelFetch(gNormalReceiver, pixel, 0);
+	int receiver = int(normalReceiver.a * 3.0 + 0.5);
+	// Background and unlit objects (the lamp) keep what was drawn there
+	if (receiver == 0)
+		discard;
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+	vec3 norm = normalize(normalReceiver.xyz * 2.0 - 1.0);
+	// World position from the depth
+	vec4 ndc = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, texelFetch(gDepth, pixel, 0).r * 2.0 - 1.0, 1.0);
+	vec4 world = inverseViewProj * ndc;
+	vec3 fragPos = world.xyz / world.w;
+	vec3 viewDir = normalize(viewPos - fragPos);
+
+	float shadow = receiver - 1 == shadowedDirLight ? CalcCascadeShadow(fragPos, norm) : 1.0;
+	FragColor = vec4(CalcDirLight(dirLights[receiver - 1], albedoSpecular.rgb, albedoSpecular.a, norm, viewDir, shadow), 1.0);
+}
+
+vec3 CalcDirLight(DirLight light, vec3 albedo, float specularIntensity, vec3 normal, vec3 viewDir, float shadow)
+{
+	// Ambient 
+	vec3 ambient = light.ambient * albedo;
+	// Diffuse 
+	vec3 lightDir = normalize(-light.direction);
+	float diff = max(0.0, dot(normal, lightDir));
+	vec3 diffuse = light.diffuse * diff * albedo;
+	// Specular
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+	vec3 specular = light.specular * spec * specularIntensity;
+	// Combine, only the ambient reaches shadowed surfaces
+	return (ambient + shadow * (diffuse + specular));
+}
+
+float CalcCascadeShadow(vec3 fragPos, vec3 normal)
+{
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	for (int i = 0; i < numShadowCascades; i++) {
+		// Moved off the surface along the normal so it doesn't shadow itself
+		vec3 coord = (shadowMatrices[i] * vec4(fragPos + normal * shadowNormalOffsets[i], 1.0)).xyz;
+		// Inside this cascade with room for the filter
+		if (all(greaterThan(coord.xy, texel * 2.0)) && all(lessThan(coord.xy, 1.0 - texel * 2.0)) && coord.z < 1.0) {
+			// 3x3 PCF, each tap filtered bilinearly by the depth comparison
+			float lit = 0.0;
+			for (int x = -1; x <= 1; x++)
+				for (int y = -1; y <= 1; y++)
+					lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+			return lit / 9.0;
+		}
+	}
+	return 1.0;
+}
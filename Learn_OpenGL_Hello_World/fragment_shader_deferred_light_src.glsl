@@ -0,0 +1,170 @@
+#version 330 core
+
+	// Adds one point light or the flashlight to the pixels its volume covers, reading the surface back from the
+	// G-buffer. Same Phong model as fragment_shader_lighting_src.glsl.
+	flat in int LightIndex;
+
+	out vec4 FragColor;
+
+	uniform sampler2D gAlbedoSpecular;
+	uniform sampler2D gNormalReceiver;
+	uniform sampler2D gDepth;
+
+	uniform mat4 inverseViewProj;
+	uniform vec2 viewportSize;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+	uniform float shininess;
+
+	struct PointLight {
+		vec3 position;
+
+		vec3 ambient;
+		vec3 diffuse;
+		vec3 specular;
+
+		// Implementing attenuation: f_att = 1.0 / (constant + linear*distance + quadratic*distance^2)
+		float constant;
+		float linear;
+		float quadratic;
+		// No light beyond this distance
+		float radius;
+	};
+	uniform samplerBuffer pointLightData;
+
+	struct SpotLight {
+		bool on;
+		vec3 position;
+		vec3 direction;
+
+		vec3 ambient;
+		vec3 diffuse;
+		vec3 specular;
+
+		float constant;
+		float linear;
+		float quadratic;
+
+		// Angle of spotlight
+		float cutOff;
+		float outerCutOff;
+	};
+	uniform SpotLight flashlight;
+
+	// Cube shadow map of the point light shadowedPointLight (-1 for none, see PointShadows.h)
+	uniform samplerCubeShadow pointShadowMap;
+	uniform int shadowedPointLight;
+	uniform float pointShadowFar;
+	uniform float pointShadowBias;
+	uniform float pointShadowNormalOffset;
+
+	// Function prototypes
+	PointLight FetchPointLight(int index);
+	vec3 CalcPointLight(PointLight pointLight, vec3 albedo, float specularIntensity, vec3 normal, vec3 fragPos, vec3 viewDir, bool shadowed);
+	float CalcPointShadow(vec3 lightPos, vec3 fragPos, vec3 normal);
+	vec3 CalcSpotLight(vec3 albedo, float specularIntensity, vec3 norm, vec3 fragPos, vec3 viewDir);
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 normalReceiver = texelFetch(gNormalReceiver, pixel, 0);
+	// Unlit pixels (background, lamp)
+	if (normalReceiver.a < 0.1)
+		discard;
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+	vec3 norm = normalize(normalReceiver.xyz * 2.0 - 1.0);
+	// World position from the depth
+	vec4 ndc = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, texelFetch(gDepth, pixel, 0).r * 2.0 - 1.0, 1.0);
+	vec4 world = inverseViewProj * ndc;
+	vec3 fragPos = world.xyz / world.w;
+	vec3 viewDir = normalize(viewPos - fragPos);
+
+	vec3 result = LightIndex >= 0
+		? CalcPointLight(FetchPointLight(LightIndex), albedoSpecular.rgb, albedoSpecular.a, norm, fragPos, viewDir, LightIndex == shadowedPointLight)
+		: CalcSpotLight(albedoSpecular.rgb, albedoSpecular.a, norm, fragPos, viewDir);
+	FragColor = vec4(result, 1.0);
+}
+
+PointLight FetchPointLight(int index)
+{
+	vec4 positionRadius = texelFetch(pointLightData, index * 4);
+	vec4 ambientConstant = texelFetch(pointLightData, index * 4 + 1);
+	vec4 diffuseLinear = texelFetch(pointLightData, index * 4 + 2);
+	vec4 specularQuadratic = texelFetch(pointLightData, index * 4 + 3);
+	return PointLight(positionRadius.xyz, ambientConstant.rgb, diffuseLinear.rgb, specularQuadratic.rgb,
+		ambientConstant.w, diffuseLinear.w, specularQuadratic.w, positionRadius.w);
+}
+
+vec3 CalcPointLight(PointLight pointLight, vec3 albedo, float specularIntensity, vec3 normal, vec3 fragPos, vec3 viewDir, bool shadowed)
+{
+	float distance = length(pointLight.position - fragPos);
+	if (distance > pointLight.radius)
+		return vec3(0.0);
+	float shadow = shadowed ? CalcPointShadow(pointLight.position, fragPos, normal) : 1.0;
+	// Ambient
+	vec3 ambient = pointLight.ambient * albedo;
+	// Diffuse 
+	vec3 lightDir = normalize(pointLight.position - fragPos);
+	float diff = max(dot(normal, lightDir), 0.0);
+	vec3 diffuse = pointLight.diffuse * diff * albedo;
+	// Specular 
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+	vec3 specular = pointLight.specular * spec * specularIntensity;
+	// Attenuation
+	float attenuation = 1.0 / (pointLight.constant + pointLight.linear * distance + pointLight.quadratic * (distance * distance));
+	ambient *= attenuation;
+	diffuse *= attenuation;
+	specular *= attenuation;
+	// Combine, only the ambient reaches shadowed surfaces
+	return (ambient + shadow * (diffuse + specular));
+}
+
+float CalcPointShadow(vec3 lightPos, vec3 fragPos, vec3 normal)
+{
+	// Moved off the surface along the normal by a few texels at its distance so it doesn't shadow itself
+	vec3 fromLight = fragPos - lightPos;
+	fromLight += normal * (length(fromLight) * pointShadowNormalOffset);
+	float depth = (length(fromLight) - pointShadowBias) / pointShadowFar;
+	return texture(pointShadowMap, vec4(fromLight, depth));
+}
+
+vec3 CalcSpotLight(vec3 albedo, float specularIntensity, vec3 norm, vec3 fragPos, vec3 viewDir)
+{
+	if (!flashlight.on)
+		return vec3(0.0);
+	vec3 flashlightDir = normalize(flashlight.position - fragPos);
+	// flashlight ambient
+	vec3 fl_ambient = flashlight.ambient * albedo;
+	// flashlight diffuse 
+	float fl_diff = max(0.0, dot(norm, flashlightDir));
+	vec3 fl_diffuse = flashlight.diffuse * fl_diff * albedo;
+	// flashlight specular 
+	vec3 fl_reflectDir = reflect(-flashlightDir, norm);
+	float fl_spec = pow(max(dot(viewDir, fl_reflectDir), 0.0), shininess);
+	vec3 fl_specular = (fl_spec * specularIntensity) * flashlight.specular;
+	// Flashlight attenuation
+	float flashlightDistance = length(flashlight.position - fragPos);
+	float fl_attenuation = 2.6 / (flashlight.constant + flashlight.linear * flashlightDistance + flashlight.quadratic * (flashlightDistance * flashlightDistance));
+	fl_ambient *= fl_attenuation;
+	fl_diffuse *= fl_attenuation;
+	fl_specular *= fl_attenuation;
+	// Smooth flashlight edge transition
+	float theta = dot(flashlightDir, normalize(-flashlight.direction));
+	float epsilon = flashlight.cutOff - flashlight.outerCutOff;
+	float fl_intensity = clamp((theta - flashlight.outerCutOff) / epsilon, 0.0, 1.0);
+	fl_ambient *= fl_intensity;
+	fl_diffuse *= fl_intensity;
+	fl_specular *= fl_intensity;
+	// Combine 
+	return (fl_ambient + fl_diffuse + fl_specular);
+}
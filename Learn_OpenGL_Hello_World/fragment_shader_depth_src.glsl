@@ -0,0 +1,5 @@
+#version 330 core
+	// Depth pre-pass: only the depth is written, nothing is shaded
+
+void main() {
+}
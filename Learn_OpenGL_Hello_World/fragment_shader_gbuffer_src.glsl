@@ -0,0 +1,32 @@
+#version 330 core
+	in vec3 Normal;
+	in vec3 FragPos;
+	in vec2 TexCoords;
+
+	// G-buffer for deferred shading (see fragment_shader_deferred_light_src.glsl for how it's read back)
+	layout (location = 0) out vec4 AlbedoSpecular; // RGBA8: diffuse colour, specular intensity
+	layout (location = 1) out vec4 NormalReceiver; // RGB10_A2: normal packed to 0..1, receiver group / 3
+	layout (location = 2) out float Depth; // R32F: window space depth
+
+	struct Material {
+		sampler2D diffuse;
+		vec3 specular;
+		float shininess;
+	};
+	uniform Material material;
+	// Models bind their diffuse map as texture_diffuse1 rather than material.diffuse
+	uniform sampler2D texture_diffuse1;
+	uniform bool useModelTexture;
+
+	// Texture mip bias, raised by the quality governor under load
+	uniform float lodBias;
+
+	// Lights the surface receives: 1 = cubes, 2 = models (0 is left where nothing lit was drawn)
+	uniform int receiverGroup;
+
+void main() {
+	vec3 albedo = useModelTexture ? texture(texture_diffuse1, TexCoords, lodBias).rgb : texture(material.diffuse, TexCoords, lodBias).rgb;
+	AlbedoSpecular = vec4(albedo, material.specular.r);
+	NormalReceiver = vec4(normalize(Normal) * 0.5 + 0.5, receiverGroup / 3.0);
+	Depth = gl_FragCoord.z;
+}
@@ -1,11 +1,23 @@
 #version 330 core
 	in vec3 Normal;
 	in vec3 FragPos;
+	flat in vec3 EyePos;
 	in vec2 TexCoords;
 
 	out vec4 FragColor;
 
-	uniform vec3 viewPos;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
 
 	struct Material {
 		// Ambient not necessary when using a diffuse map
@@ -18,6 +30,9 @@
 	};
 	uniform Material material;
 
+	// Texture mip bias, raised by the quality governor under load
+	uniform float lodBias;
+
 	struct PointLight {
 		vec3 position;
 
@@ -29,9 +44,19 @@
 		float constant;
 		float linear;
 		float quadratic;
+		// No light beyond this distance
+		float radius;
 	};
-	#define NUM_POINT_LIGHTS 1
-	uniform PointLight pointLights[NUM_POINT_LIGHTS];
+	// Point lights come from a texture buffer, four texels each (see LightBuffer.h)
+	uniform samplerBuffer pointLightData;
+	uniform int numPointLights;
+	// Clustered light lists (see LightClusters.h): only the lights binned to the fragment's cluster are shaded
+	uniform bool useLightClusters;
+	uniform usamplerBuffer clusterLights; // offset into clusterLightIndices and count, per cluster
+	uniform usamplerBuffer clusterLightIndices;
+	uniform vec3 clusterGrid; // tiles x, tiles y, depth slices
+	uniform vec2 clusterTileSize; // pixels
+	uniform vec2 clusterSliceScaleBias; // slice = log(view depth) * scale + bias
 
 	struct SpotLight {
 		bool on;
@@ -61,9 +86,29 @@
 	#define NUM_DIR_LIGHTS 1
 	uniform DirLight dirLights[NUM_DIR_LIGHTS];
 
+	// Cascaded shadow map of the directional light shadowedDirLight (-1 for none, see CascadedShadows.h). The
+	// first cascade whose layer covers the fragment is used, nearer cascades cover less at a higher resolution.
+	#define MAX_SHADOW_CASCADES 4
+	uniform sampler2DArrayShadow shadowMap;
+	uniform int numShadowCascades;
+	uniform int shadowedDirLight;
+	uniform mat4 shadowMatrices[MAX_SHADOW_CASCADES]; // world to shadow map coordinates and depth
+	uniform float shadowNormalOffsets[MAX_SHADOW_CASCADES]; // world distance the receiver is moved along its normal
+
+	// Cube shadow map of the point light shadowedPointLight (-1 for none, see PointShadows.h), storing the
+	// distance from the light divided by pointShadowFar
+	uniform samplerCubeShadow pointShadowMap;
+	uniform int shadowedPointLight;
+	uniform float pointShadowFar;
+	uniform float pointShadowBias; // world distance
+	uniform float pointShadowNormalOffset; // world distance the receiver is moved along its normal, per unit from the light
+
 	// Function prototypes
-	vec3 CalcPointLight(PointLight pointLight, vec3 normal, vec3 fragPos, vec3 viewDir);
-	vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+	PointLight FetchPointLight(int index);
+	vec3 CalcPointLight(PointLight pointLight, vec3 normal, vec3 fragPos, vec3 viewDir, bool shadowed);
+	vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow);
+	float CalcCascadeShadow(vec3 fragPos, vec3 normal);
+	float CalcPointShadow(vec3 lightPos, vec3 fragPos, vec3 normal);
 	vec3 CalcSpotLight(SpotLight spotLight, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main() {
@@ -71,16 +116,29 @@ void main() {
 	// Phong lighting (using directional, point lights, spotlights)
 	//
 	vec3 norm = normalize(Normal);
-	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 viewDir = normalize(EyePos - FragPos);
 	vec3 result = vec3(0.0f);
 
 	// Directional lighting
 	for(int i = 0; i < NUM_DIR_LIGHTS; i++)
-		result += CalcDirLight(dirLights[i], norm, viewDir);
+		result += CalcDirLight(dirLights[i], norm, viewDir, i == shadowedDirLight ? CalcCascadeShadow(FragPos, norm) : 1.0);
 
 	// Point lights
-	for(int i = 0; i < NUM_POINT_LIGHTS; i++)
-		result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+	if (useLightClusters) {
+		float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+		ivec3 cell = ivec3(clamp(vec3(gl_FragCoord.xy / clusterTileSize, log(viewDepth) * clusterSliceScaleBias.x + clusterSliceScaleBias.y),
+			vec3(0.0), clusterGrid - 1.0));
+		int cluster = (cell.z * int(clusterGrid.y) + cell.y) * int(clusterGrid.x) + cell.x;
+		uvec2 lightList = texelFetch(clusterLights, cluster).rg;
+		for(uint i = 0u; i < lightList.y; i++) {
+			int index = int(texelFetch(clusterLightIndices, int(lightList.x + i)).r);
+			result += CalcPointLight(FetchPointLight(index), norm, FragPos, viewDir, index == shadowedPointLight);
+		}
+	}
+	else {
+		for(int i = 0; i < numPointLights; i++)
+			result += CalcPointLight(FetchPointLight(i), norm, FragPos, viewDir, i == shadowedPointLight);
+	}
 
 	// Spot light (flashlight)
 	result += CalcSpotLight(flashlight, norm, FragPos, viewDir);
@@ -90,42 +148,84 @@ void main() {
 	FragColor = vec4(result, 1.0);
 }
 
-vec3 CalcPointLight(PointLight pointLight, vec3 normal, vec3 fragPos, vec3 viewDir)
+PointLight FetchPointLight(int index)
 {
+	vec4 positionRadius = texelFetch(pointLightData, index * 4);
+	vec4 ambientConstant = texelFetch(pointLightData, index * 4 + 1);
+	vec4 diffuseLinear = texelFetch(pointLightData, index * 4 + 2);
+	vec4 specularQuadratic = texelFetch(pointLightData, index * 4 + 3);
+	return PointLight(positionRadius.xyz, ambientConstant.rgb, diffuseLinear.rgb, specularQuadratic.rgb,
+		ambientConstant.w, diffuseLinear.w, specularQuadratic.w, positionRadius.w);
+}
+
+vec3 CalcPointLight(PointLight pointLight, vec3 normal, vec3 fragPos, vec3 viewDir, bool shadowed)
+{
+	float distance = length(pointLight.position - fragPos);
+	if (distance > pointLight.radius)
+		return vec3(0.0);
+	float shadow = shadowed ? CalcPointShadow(pointLight.position, fragPos, normal) : 1.0;
 	// Ambient
-	vec3 ambient = pointLight.ambient * vec3(texture(material.diffuse, TexCoords));
+	vec3 ambient = pointLight.ambient * vec3(texture(material.diffuse, TexCoords, lodBias));
 	// Diffuse 
 	vec3 lightDir = normalize(pointLight.position - fragPos);
 	float diff = max(dot(normal, lightDir), 0.0);
-	vec3 diffuse = pointLight.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
+	vec3 diffuse = pointLight.diffuse * diff * vec3(texture(material.diffuse, TexCoords, lodBias));
 	// Specular 
 	vec3 reflectDir = reflect(-lightDir, normal);
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 	vec3 specular = pointLight.specular * spec * material.specular;
 	// Attenuation
-	float distance = length(pointLight.position - fragPos);
 	float attenuation = 1.0 / (pointLight.constant + pointLight.linear * distance + pointLight.quadratic * (distance * distance));
 	ambient *= attenuation;
 	diffuse *= attenuation;
 	specular *= attenuation;
-	// Combine 
-	return (ambient + diffuse + specular);
+	// Combine, only the ambient reaches shadowed surfaces
+	return (ambient + shadow * (diffuse + specular));
 }
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
 	// Ambient 
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
+	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords, lodBias));
 	// Diffuse 
 	vec3 lightDir = normalize(-light.direction);
 	float diff = max(0.0, dot(normal, lightDir));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
+	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords, lodBias));
 	// Specular
 	vec3 reflectDir = reflect(-lightDir, normal);
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 	vec3 specular = light.specular * spec * material.specular; // modified this line from tutorial
-	// Combine 
-	return (ambient + diffuse + specular);
+	// Combine, only the ambient reaches shadowed surfaces
+	return (ambient + shadow * (diffuse + specular));
+}
+
+float CalcCascadeShadow(vec3 fragPos, vec3 normal)
+{
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	for (int i = 0; i < numShadowCascades; i++) {
+		// Moved off the surface along the normal so it doesn't shadow itself
+		vec3 coord = (shadowMatrices[i] * vec4(fragPos + normal * shadowNormalOffsets[i], 1.0)).xyz;
+		// Inside this cascade with room for the filter
+		if (all(greaterThan(coord.xy, texel * 2.0)) && all(lessThan(coord.xy, 1.0 - texel * 2.0)) && coord.z < 1.0) {
+			// 3x3 PCF, each tap filtered bilinearly by the depth comparison
+			float lit = 0.0;
+			for (int x = -1; x <= 1; x++)
+				for (int y = -1; y <= 1; y++)
+					lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+			return lit / 9.0;
+		}
+	}
+	return 1.0;
+}
+
+float CalcPointShadow(vec3 lightPos, vec3 fragPos, vec3 normal)
+{
+	// Moved off the surface along the normal by a few texels at its distance so it doesn't shadow itself
+	vec3 fromLight = fragPos - lightPos;
+	fromLight += normal * (length(fromLight) * pointShadowNormalOffset);
+	float depth = (length(fromLight) - pointShadowBias) / pointShadowFar;
+	// Filtered bilinearly by the depth comparison
+	return texture(pointShadowMap, vec4(fromLight, depth));
 }
 
 vec3 CalcSpotLight(SpotLight spotLight, vec3 norm, vec3 fragPos, vec3 viewDir)
@@ -139,10 +239,10 @@ vec3 CalcSpotLight(SpotLight spotLight, vec3 norm, vec3 fragPos, vec3 viewDir)
 	if(flashlight.on) {
 		vec3 flashlightDir = normalize(flashlight.position - FragPos);
 		// flashlight ambient
-		fl_ambient = flashlight.ambient * vec3(texture(material.diffuse, TexCoords));
+		fl_ambient = flashlight.ambient * vec3(texture(material.diffuse, TexCoords, lodBias));
 		// flashlight diffuse 
 		float fl_diff = max(0.0, dot(norm, flashlightDir));
-		fl_diffuse = flashlight.diffuse * fl_diff * vec3(texture(material.diffuse, TexCoords));
+		fl_diffuse = flashlight.diffuse * fl_diff * vec3(texture(material.diffuse, TexCoords, lodBias));
 		// flashlight specular 
 		float fl_shininess = 16;
 		vec3 fl_reflectDir = reflect(-flashlightDir, norm);
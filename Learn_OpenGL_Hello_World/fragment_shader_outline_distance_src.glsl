@@ -0,0 +1,20 @@
+#version 330 core
+
+	// First half of the outline's distance transform: distance along the row to the nearest masked pixel,
+	// stored as distance / (outlineWidth + 1), so 1.0 means none within reach
+	out vec4 FragColor;
+
+	uniform sampler2D outlineMask;
+	uniform int outlineWidth; // pixels
+	uniform ivec2 viewportSize;
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	int nearest = outlineWidth + 1;
+	for (int dx = -outlineWidth; dx <= outlineWidth; dx++) {
+		int x = pixel.x + dx;
+		if (x >= 0 && x < viewportSize.x && texelFetch(outlineMask, ivec2(x, pixel.y), 0).r > 0.5)
+			nearest = min(nearest, abs(dx));
+	}
+	FragColor = vec4(float(nearest) / float(outlineWidth + 1));
+}
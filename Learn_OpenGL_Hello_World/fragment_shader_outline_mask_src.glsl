@@ -0,0 +1,8 @@
+#version 330 core
+
+	// Outline mask: drawn full-screen with the stencil test passing only on the outline stencil bit
+	out vec4 FragColor;
+
+void main() {
+	FragColor = vec4(1.0);
+}
@@ -0,0 +1,33 @@
+#version 330 core
+
+	// Second half of the outline's distance transform, drawn over the scene: the nearest masked pixel is the
+	// closest of the row distances above and below, and pixels outside the mask within outlineWidth of it
+	// get the outline colour
+	out vec4 FragColor;
+
+	uniform sampler2D outlineMask;
+	uniform sampler2D outlineDistanceX;
+	uniform int outlineWidth; // pixels
+	uniform ivec2 viewportSize;
+	uniform vec3 outlineColor;
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	// Inside an outlined object
+	if (texelFetch(outlineMask, pixel, 0).r > 0.5)
+		discard;
+	float reach = float(outlineWidth + 1);
+	float nearestSquared = reach * reach;
+	for (int dy = -outlineWidth; dy <= outlineWidth; dy++) {
+		int y = pixel.y + dy;
+		if (y < 0 || y >= viewportSize.y)
+			continue;
+		float dx = round(texelFetch(outlineDistanceX, ivec2(pixel.x, y), 0).r * reach);
+		nearestSquared = min(nearestSquared, dx * dx + float(dy * dy));
+	}
+	// Coverage falls off over the last pixel, antialiasing the outer edge
+	float alpha = clamp(float(outlineWidth) + 0.5 - sqrt(nearestSquared), 0.0, 1.0);
+	if (alpha <= 0.0)
+		discard;
+	FragColor = vec4(outlineColor, alpha);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+	// Point light shadows: the depth stored is the distance from the light divided by its radius, which
+	// receivers can compare against whichever face they fall on
+	in vec3 WorldPos;
+
+	uniform vec3 lightPos;
+	uniform float farPlane;
+
+void main() {
+	gl_FragDepth = length(WorldPos - lightPos) / farPlane;
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+	in vec2 ScreenUV;
+
+	out vec4 FragColor;
+
+	// Scene rendered at a lower resolution into the bottom left corner of sceneTexture
+	uniform sampler2D sceneTexture;
+	uniform vec2 uvScale; // rendered size / texture size
+	uniform vec2 texelSize; // 1 / texture size
+	uniform float sharpness; // 0 = plain bilinear upscale
+
+void main()
+{
+	vec2 uv = ScreenUV * uvScale;
+	// Clamp the taps to the rendered area so the unrendered part of the texture never bleeds in
+	vec2 maxUV = uvScale - 0.5 * texelSize;
+	vec3 center = texture(sceneTexture, min(uv, maxUV)).rgb;
+	vec3 left = texture(sceneTexture, min(uv - vec2(texelSize.x, 0.0), maxUV)).rgb;
+	vec3 right = texture(sceneTexture, min(uv + vec2(texelSize.x, 0.0), maxUV)).rgb;
+	vec3 down = texture(sceneTexture, min(uv - vec2(0.0, texelSize.y), maxUV)).rgb;
+	vec3 up = texture(sceneTexture, min(uv + vec2(0.0, texelSize.y), maxUV)).rgb;
+
+	// Unsharp mask, limited to the local contrast range so edges don't ring
+	vec3 sharpened = center + sharpness * (4.0 * center - left - right - down - up);
+	vec3 minimum = min(center, min(min(left, right), min(down, up)));
+	vec3 maximum = max(center, max(max(left, right), max(down, up)));
+	FragColor = vec4(clamp(sharpened, minimum, maximum), 1.0);
+}
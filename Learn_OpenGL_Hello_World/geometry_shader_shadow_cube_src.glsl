@@ -0,0 +1,34 @@
+#version 330 core
+	// Point light shadows: every face of the cube map in one draw. The vertex shader (a depth-only one with
+	// identity view and projection) outputs world positions; each triangle is sent to the faces in the draw's
+	// layerMask, skipping the faces it is entirely outside of.
+	layout (triangles) in;
+	layout (triangle_strip, max_vertices = 18) out;
+
+	out vec3 WorldPos;
+
+	uniform mat4 faceMatrices[6]; // world to clip space, in the cube map's face order
+	uniform int layerMask; // faces the draw's bounds touch, culled on the CPU
+
+void main() {
+	for (int face = 0; face < 6; face++) {
+		if ((layerMask & (1 << face)) == 0)
+			continue;
+		vec4 clip[3];
+		for (int i = 0; i < 3; i++)
+			clip[i] = faceMatrices[face] * gl_in[i].gl_Position;
+		// Outside if all three vertices are beyond the same side plane
+		vec3 x = vec3(clip[0].x, clip[1].x, clip[2].x);
+		vec3 y = vec3(clip[0].y, clip[1].y, clip[2].y);
+		vec3 w = vec3(clip[0].w, clip[1].w, clip[2].w);
+		if (all(greaterThan(x, w)) || all(lessThan(x, -w)) || all(greaterThan(y, w)) || all(lessThan(y, -w)))
+			continue;
+		for (int i = 0; i < 3; i++) {
+			gl_Layer = face;
+			gl_Position = clip[i];
+			WorldPos = gl_in[i].gl_Position.xyz;
+			EmitVertex();
+		}
+		EndPrimitive();
+	}
+}
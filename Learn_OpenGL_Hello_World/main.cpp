@@ -5,6 +5,37 @@
 #include <camera.h>
 #include <Model.h>
 #include <Mesh.h>
+#include <Frustum.h>
+#include <FrameContext.h>
+#include <FixedTimestep.h>
+#include <InputQueue.h>
+#include <CameraPath.h>
+#include <Benchmark.h>
+#include <RenderStats.h>
+#include <FrameStats.h>
+#include <FrameGraph.h>
+#include <RenderQueue.h>
+#include <JobSystem.h>
+#include <SceneGraph.h>
+#include <ECS.h>
+#include <SceneComponents.h>
+#include <HeadlessContext.h>
+#include <Profiler.h>
+#include <GpuProfiler.h>
+#include <QualityGovernor.h>
+#include <LightBuffer.h>
+#include <LightVolumes.h>
+#include <LightClusters.h>
+#include <OverdrawMonitor.h>
+#include <OcclusionCulling.h>
+#include <CascadedShadows.h>
+#include <PointShadows.h>
+#include <SoftwareRasterizer.h>
+#include <StreamBuffer.h>
+#include <MultiView.h>
+#include <vector>
+#include <string>
+#include <chrono>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <glm/glm.hpp>
@@ -16,84 +47,440 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void simulationTick(float tickDelta, double tickEndTime);
+void applyInputEvent(const InputEvent& event);
 void processInput(GLFWwindow* window);
 unsigned int loadTexture(const char* path);
-void setupMovingCubes(glm::vec3(&cubePositions)[12], Shader lightingShader);
+double getTime();
+void animationSystem(const FrameContext& frame, JobSystem& jobSystem);
+void transformSystem(JobSystem& jobSystem);
+void boundsSystem(JobSystem& jobSystem);
+void lightSystem(const FrameContext& frame);
+void lightBufferSystem(const FrameContext& frame, JobSystem& jobSystem);
+void cullingSystem(const FrameContext& frame, JobSystem& jobSystem);
+void renderSystem(JobSystem& jobSystem);
+void shadowSystem(const FrameContext& frame);
+void pointShadowSystem(const FrameContext& frame);
 void setupLampObject(Shader lampShader, glm::vec3 lightColor);
-void setupCubeObjects(Shader lightingShader, glm::vec3 lightColor, glm::vec3 pl_ambientIntensity, glm::vec3 pl_diffuseIntensity, glm::vec3 pl_specularIntensity, glm::vec3 fl_ambientIntensity, glm::vec3 fl_diffuseIntensity, glm::vec3 fl_specularIntensity, glm::vec3 dl_ambientIntensity, glm::vec3 dl_diffuseIntensity, glm::vec3 dl_specularIntensity);
-void setupModelObject(Shader modelShader, glm::vec3 lightColor, glm::vec3 pl_ambientIntensity, glm::vec3 pl_diffuseIntensity, glm::vec3 pl_specularIntensity, glm::vec3 fl_ambientIntensity, glm::vec3 fl_diffuseIntensity, glm::vec3 fl_specularIntensity, glm::vec3 dl_ambientIntensity, glm::vec3 dl_diffuseIntensity, glm::vec3 dl_specularIntensity);
+void setupLitShader(Shader& shader, unsigned int receivers, int sceneWidth, int sceneHeight);
+StreamBuffer::Allocation streamViewUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition, float time);
+StreamBuffer::Allocation streamStereoViewUniforms(const FrameContext& left, const FrameContext& right, float time);
+void bindViewUniforms(const StreamBuffer::Allocation& viewUniforms);
+void applyLights(Shader& shader, unsigned int receivers);
+unsigned int countNonPointLights(unsigned int receivers);
+void setLightUniforms(Shader& shader, const std::string& name, const LightComponent& light);
+void setupGBufferShader(Shader& shader, int receiverGroup);
+void setupDeferredLightShader(Shader& shader, const FrameContext& frame, int sceneWidth, int sceneHeight);
+bool& movingLightEnabled();
+bool& flashlightEnabled();
+bool& outlineEnabled();
+glm::vec3 lampColor(float time);
+LightComponent createLampLight();
+LightComponent createFlashlight();
+LightComponent createDirLight(glm::vec3 direction, unsigned int receivers);
+LightComponent createExtraPointLight();
+int runSoftwareRenderer();
 
 // Global variables
 const unsigned int SCREEN_WIDTH = 800 * 1.4;
 const unsigned int SCREEN_HEIGHT = 600 * 1.4;
+// Size of the rendered image: the window's framebuffer, or the offscreen backbuffer in headless mode (--width/--height)
+unsigned int renderWidth = SCREEN_WIDTH;
+unsigned int renderHeight = SCREEN_HEIGHT;
 
 glm::vec3 cameraPos   = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 cameraUp    = glm::vec3(0.0f, 1.0f, 0.0f);
 
 // Create camera object with starting position
+// camera is advanced by the fixed-rate simulation, renderCamera is interpolated from it for each rendered frame
 Camera camera(cameraPos);
+Camera renderCamera(cameraPos);
 float lastCursorX = SCREEN_WIDTH/2.0f;
 float lastCursorY = SCREEN_HEIGHT/2.0f;
 float yaw   = 0.0f;
 float pitch = 0.0f;
 bool firstMouseCapture = true;
-bool isMovingLight = false;
 
-// Positions
-glm::vec3 pointLightPos(1.2f, 1.0f, 2.0f);
-glm::vec3 movingLightPos = pointLightPos;
-glm::vec3 backpackPos = glm::vec3(-1.8f, 0.0f, 2.0f);
-
-bool isFlashlightOn = false;
-bool isOutlineOn = false;
+// Scene objects and lights are entities, updated each frame by the systems at the end of this file.
+// The mode toggles (moving light, flashlight, outline) are stored on the entities they affect.
+EntityWorld world;
+Entity lampEntity, flashlightEntity, backpackEntity;
+// --ecs-entities N adds N animated entities that are never drawn, to measure iterating the component arrays
+unsigned int extraEntityCount = 0;
+const unsigned int ENTITY_BATCH_SIZE = 4096; // entities per job batch for the cheap per-entity systems
+
+// Scene graph holding the placement of every entity with a TransformComponent
+SceneGraph sceneGraph;
+
+// Directional lights the lit fragment shaders have room for (NUM_DIR_LIGHTS). Point lights have no fixed
+// limit: they are packed into texture buffers each frame, one per receiver group for forward shading and one
+// holding every point light for the light volumes of deferred shading.
+const unsigned int MAX_DIR_LIGHTS = 1;
+PointLightBuffer cubePointLights, modelPointLights, volumePointLights;
+const unsigned int POINT_LIGHT_TEXTURE_UNIT = 8;
+// Forward shading bins the point lights of each light buffer into view frustum clusters, so each fragment only
+// loops over the lights near it. --no-light-clusters loops over every light instead.
+LightClusterGrid cubeLightClusters, modelLightClusters;
+bool useLightClusters = true;
+const unsigned int CLUSTER_TEXTURE_UNIT = 9;
+const unsigned int CLUSTER_INDEX_TEXTURE_UNIT = 10;
+// --point-lights N: the lamp plus N - 1 extra point lights scattered through the cube field
+unsigned int pointLightCount = 1;
+
+// Frustum culling
+CullingBatch cullingBatch;
+// Object space bounds of the procedural cube (lamp and moving cubes)
+const AABB cubeBounds(glm::vec3(-0.5f, -0.5f, 0.0f), glm::vec3(0.5f, 0.5f, 1.0f));
+// Objects smaller than this many pixels on screen are culled (0 disables the test)
+float minCullPixelSize = 0.0f;
+const float SMALL_OBJECT_PIXEL_SIZE = 2.0f;
+// Occlusion culling (--occlusion-culling): objects that pass frustum culling are tested against a CPU-rasterized
+// depth buffer of the entities' occluder boxes. The per-cube entities are exact boxes; the backpack's occluder
+// is its bounds shrunk to a core that the bag's body fills.
+bool occlusionCulling = false;
+OcclusionCuller occlusionCuller;
+const float BACKPACK_OCCLUDER_SCALE = 0.4f;
+
+// Cascaded shadow maps of the directional light marked CastsShadows (--shadow-cascades N, 0 for none;
+// --shadow-split-lambda, --shadow-distance, --shadow-resolution). The cascades are cached across frames: each
+// is only re-rendered when the light or its fitted placement changes, or a dynamic caster inside it moves.
+// --no-shadow-cache re-renders every caster into every cascade each frame instead. Each cascade's passes are
+// GPU profiled, and its draws and re-render rate are added to the frame stats.
+CascadedShadowMap shadowMap;
+CullingBatch shadowCullingBatches[CascadedShadowMap::MAX_CASCADES];
+const unsigned int SHADOW_MAP_TEXTURE_UNIT = 11;
+const float SHADOW_SLOPE_BIAS = 2.0f;
+const float SHADOW_CONSTANT_BIAS = 4.0f;
+// Cube shadow map of the point light marked CastsShadows (the lamp), all six faces rendered in one pass with a
+// geometry shader (--no-point-shadows to turn off). Its face size follows the light's radius on screen, up to
+// --point-shadow-resolution. Like the cascades it is cached until the light or a dynamic caster near it moves;
+// --no-shadow-cache re-renders it every frame the light is in view.
+bool pointShadows = true;
+PointShadowMap pointShadowMap;
+CullingBatch pointShadowCullingBatch;
+const unsigned int POINT_SHADOW_TEXTURE_UNIT = 12;
+// Render queue depth program set of the cube shadow casters
+const unsigned int DEPTH_PROGRAMS_POINT_SHADOW = 1;
+
+// Per-frame uniform data is bump-allocated from a ring buffer of StreamBuffer::NUM_FRAMES regions, persistently
+// mapped where GL_ARB_buffer_storage is available (--no-persistent-mapping maps each allocation instead, as on
+// GL 3.3). The camera's ViewUniforms block is streamed once per frame and every other view (shadow cascades,
+// the point shadow) streams its own; the time spent waiting for a region to be free is added to the frame stats.
+StreamBuffer streamBuffer;
+bool persistentMapping = true;
+const GLsizeiptr STREAM_BUFFER_FRAME_SIZE = 64 * 1024;
+// Binding point of the ViewUniforms block in every program that declares it
+const unsigned int VIEW_UNIFORM_BINDING = 0;
+// The camera's ViewUniforms of the current frame
+StreamBuffer::Allocation cameraViewUniforms;
+// std140 layout of the shaders' ViewUniforms block
+struct ViewUniforms {
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::vec3 ViewPosition;
+	float Time;
+	// Right eye of single-pass stereo (NumEyes 2)
+	glm::mat4 RightView;
+	glm::mat4 RightProjection;
+	glm::vec3 RightViewPosition;
+	int NumEyes;
+};
+
+// Multi-view rendering (--views split|stereo|overview, default single): several viewpoints side by side in the
+// scene target, culled and recorded once and each submitted with only the draws it can see (see MultiView.h).
+// The stereo pair is drawn in one instanced pass unless --no-instanced-stereo; --eye-separation sets its width.
+// The views other than the camera's have no light clusters, occlusion buffer or G-buffer of their own, so
+// several views turn those off. Each view's submission time and draws (and with --gpu-profile its GPU time in
+// each scene pass) are added to the frame stats.
+ViewSet views;
+
+// Draw packets of the frame, sorted by pass, shader, material, VAO and depth before submission
+RenderQueue renderQueue;
+enum RenderPassId {
+	RENDER_PASS_LAMP,
+	RENDER_PASS_CUBES,
+	RENDER_PASS_BACKPACK,
+	// Shadow casters per cascade: static ones into its cached layer, dynamic ones on top of the copy of it
+	RENDER_PASS_SHADOW_STATIC,
+	RENDER_PASS_SHADOW_DYNAMIC = RENDER_PASS_SHADOW_STATIC + CascadedShadowMap::MAX_CASCADES,
+	// Point light shadow casters, drawn into every cube map face they touch
+	RENDER_PASS_POINT_SHADOW = RENDER_PASS_SHADOW_DYNAMIC + CascadedShadowMap::MAX_CASCADES
+};
+const float RENDER_QUEUE_FAR_PLANE = 100.0f;
+
+// Per-object work (animation, bounds, draw packet recording) is split across worker threads
+int workerThreadCount = -1; // --threads N extra threads, default one less than the hardware threads
+const unsigned int OBJECT_BATCH_SIZE = 256; // objects per job batch
+unsigned int cubeCount = 12; // --cubes N, the first 12 cubes have hand-placed positions
+// Cubes are drawn in one instanced draw and animated in the vertex shader; --per-cube-draws animates and draws them one by one on the CPU
+bool useInstancedCubes = true;
+// Distance from a cube's pivot to its furthest corner (the cube spans z 0..1), pads the instanced field's bounds
+const float CUBE_RADIUS = 1.25f;
+
+// Fixed-rate simulation (camera movement, lamp and cube animation) decoupled from the render rate
+double simulationTickRate = 120.0; // ticks per second, set with --sim-hz
+FixedTimestep simulation;
+InputQueue inputQueue;
+
+// Camera path record/replay benchmark: --record <file>, or --replay <file> [--frames N] [--report <file>]
+std::string recordPath;
+std::string replayPath;
+std::string reportPath = "benchmark_report.json";
+unsigned int replayFrameCount = 0; // 0 = length of the recorded path
+const double REPLAY_TIME_STEP = 1.0 / 60.0; // simulated seconds per replayed frame
+
+// Headless mode (--headless): no visible window, an offscreen context (surfaceless EGL on Linux, a hidden GLFW
+// window elsewhere, see HeadlessContext.h) renders a fixed number of frames (--frames N) into an offscreen
+// backbuffer, and can save the last one (--output <file.ppm>). Animation time advances by REPLAY_TIME_STEP per
+// frame so runs are reproducible.
+bool isHeadless = false;
+const unsigned int DEFAULT_HEADLESS_FRAMES = 300;
+std::string headlessOutputPath;
+
+// CPU time per frame and phase over the last frames, printed once per second. Written to <prefix>.csv/.json
+// on F1 and at exit when --stats <prefix> is given (or headless); --stats-frames N sets how many frames are kept.
+FrameStats frameStats;
+std::string statsPath = "frame_stats";
+bool exportStatsAtExit = false;
+
+// GPU time per frame graph pass (--gpu-profile), and per draw (--gpu-profile-draws), reported with the frame stats
+bool gpuProfileEnabled = false;
+bool gpuProfileDraws = false;
+
+// Dynamic resolution (--dynamic-resolution, or --target-fps N): the scene renders offscreen at a scale the
+// governor picks to hold the target frame time, then is upscaled with sharpening to the backbuffer. The governor's
+// lower quality levels also shrink the shadow maps.
+bool dynamicResolution = false;
+QualityGovernor governor;
+const float UPSCALE_SHARPNESS = 0.25f;
+
+// Deferred shading (--deferred): the cubes and models write albedo, specular, normal and depth to a G-buffer,
+// then each light is applied to the pixels its volume covers (spheres for point lights, a cone for the
+// flashlight), stencil-tested so only pixels with a surface inside the volume are shaded. Always renders
+// offscreen, presented by the Upscale pass. The lamp stays forward shaded.
+bool deferredShading = false;
+// Stencil bits: the top one marks the pixels of outlined objects, the rest count light volume faces
+const GLuint OUTLINE_STENCIL_BIT = 0x80;
+const GLuint LIGHT_VOLUME_STENCIL_MASK = 0x7F;
+// Receiver groups stored in the G-buffer (0 is unlit)
+const int GBUFFER_RECEIVER_CUBES = 1;
+const int GBUFFER_RECEIVER_MODELS = 2;
+// Light volumes stenciled and shaded together, at most what the stencil count holds without wrapping
+const unsigned int LIGHT_VOLUME_BATCH_SIZE = LIGHT_VOLUME_STENCIL_MASK;
+
+// Depth pre-pass of the forward Cubes and Backpack passes (--depth-prepass off|on|auto for both, or
+// --depth-prepass-cubes / --depth-prepass-backpack <mode> for one): position-only shaders lay down the depth
+// first, then the pass shades with a GL_EQUAL depth test and no depth writes, so each pixel is shaded once.
+// Auto turns it on while the measured overdraw is high. Shaded fragments per pass are reported either way.
+// Deferred shading doesn't use it, its G-buffer fill is cheap next to the Phong shaders.
+DepthPrepassMode cubesDepthPrepass = DEPTH_PREPASS_OFF;
+DepthPrepassMode backpackDepthPrepass = DEPTH_PREPASS_OFF;
+OverdrawMonitor overdrawMonitor;
+
+// Screen-space outline around renderables marked Outlined (the backpack, toggled with 7/8): their draws set
+// the outline stencil bit, which becomes a mask that a separable distance transform grows by OUTLINE_WIDTH
+// pixels. Needs the scene offscreen, so while any outline is shown the scene is presented by the Upscale pass.
+const float OUTLINE_WIDTH = 3.0f; // backbuffer pixels
+const glm::vec3 OUTLINE_COLOR = 4.0f * glm::vec3(0.04f, 0.28f, 0.26f);
+
+// Software rendering (--software): no window or GL context, the backpack and its lights are drawn by the
+// multithreaded CPU rasterizer (SoftwareRasterizer.h) for --frames N frames at --width x --height, reporting
+// triangle and pixel throughput. The last frame can be saved (--output <file.ppm>).
+bool softwareRendering = false;
+const unsigned int DEFAULT_SOFTWARE_FRAMES = 30;
+
+// Placement of the lamp and the backpack, shared by the GL scene and the software renderer
+const glm::vec3 LAMP_POSITION = glm::vec3(1.2f, 1.0f, 2.0f);
+const glm::vec3 BACKPACK_POSITION = glm::vec3(-1.8f, 0.0f, 2.0f);
+const float BACKPACK_SCALE = 0.5f;
+
+// Chrome trace of the profiler zones (--trace <file.json>), only when built with PROFILER_ENABLED=1
+std::string tracePath;
 
 float deltaTime = 0.0f; // Time to render last frame
 float lastFrame = 0.0f; // Time of last frame
 float startTime = glfwGetTime();
 float timeSinceLastPrintf = 0.0f;
 
-int main() {
-	// Setup version (using OpenGL v3.3 in core-profile mode)
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-	// Create an OpenGL window using GLFW library implementation
-	GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+int main(int argc, char** argv) {
+	// Command line options
+	for (int i = 1; i < argc; i++)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		std::string arg = argv[i];
+		if (arg == "--sim-hz" && i + 1 < argc)
+		{
+			double tickRate = atof(argv[++i]);
+			if (tickRate > 0.0)
+				simulationTickRate = tickRate;
+			else
+				std::cout << "--sim-hz must be above 0, keeping " << simulationTickRate << std::endl;
+		}
+		else if (arg == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (arg == "--replay" && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (arg == "--frames" && i + 1 < argc)
+			replayFrameCount = atoi(argv[++i]);
+		else if (arg == "--report" && i + 1 < argc)
+			reportPath = argv[++i];
+		else if (arg == "--threads" && i + 1 < argc)
+			workerThreadCount = atoi(argv[++i]);
+		else if (arg == "--cubes" && i + 1 < argc)
+			cubeCount = atoi(argv[++i]);
+		else if (arg == "--per-cube-draws")
+			useInstancedCubes = false;
+		else if (arg == "--ecs-entities" && i + 1 < argc)
+			extraEntityCount = atoi(argv[++i]);
+		else if (arg == "--headless")
+			isHeadless = true;
+		else if (arg == "--width" && i + 1 < argc)
+			renderWidth = atoi(argv[++i]);
+		else if (arg == "--height" && i + 1 < argc)
+			renderHeight = atoi(argv[++i]);
+		else if (arg == "--output" && i + 1 < argc)
+			headlessOutputPath = argv[++i];
+		else if (arg == "--stats" && i + 1 < argc)
+		{
+			statsPath = argv[++i];
+			exportStatsAtExit = true;
+		}
+		else if (arg == "--stats-frames" && i + 1 < argc)
+			frameStats.SetCapacity(atoi(argv[++i]));
+		else if (arg == "--gpu-profile")
+			gpuProfileEnabled = true;
+		else if (arg == "--gpu-profile-draws")
+			gpuProfileEnabled = gpuProfileDraws = true;
+		else if (arg == "--dynamic-resolution")
+			dynamicResolution = true;
+		else if (arg == "--target-fps" && i + 1 < argc)
+		{
+			governor.SetTargetFps((float)atof(argv[++i]));
+			dynamicResolution = true;
+		}
+		else if (arg == "--deferred")
+			deferredShading = true;
+		else if (arg == "--no-light-clusters")
+			useLightClusters = false;
+		else if (arg == "--point-lights" && i + 1 < argc)
+			pointLightCount = std::max(1, atoi(argv[++i]));
+		else if (arg == "--occlusion-culling")
+			occlusionCulling = true;
+		else if (arg == "--shadow-cascades" && i + 1 < argc)
+			shadowMap.NumCascades = std::min((unsigned int)std::max(0, atoi(argv[++i])), CascadedShadowMap::MAX_CASCADES);
+		else if (arg == "--shadow-split-lambda" && i + 1 < argc)
+			shadowMap.SplitLambda = glm::clamp((float)atof(argv[++i]), 0.0f, 1.0f);
+		else if (arg == "--shadow-distance" && i + 1 < argc)
+			shadowMap.ShadowDistance = std::max(1.0f, (float)atof(argv[++i]));
+		else if (arg == "--shadow-resolution" && i + 1 < argc)
+			shadowMap.Resolution = std::max(64, atoi(argv[++i]));
+		else if (arg == "--no-shadow-cache")
+			shadowMap.Caching = pointShadowMap.Caching = false;
+		else if (arg == "--views" && i + 1 < argc)
+			parseViewLayout(argv[++i], views.Layout);
+		else if (arg == "--eye-separation" && i + 1 < argc)
+			views.EyeSeparation = (float)atof(argv[++i]);
+		else if (arg == "--no-instanced-stereo")
+			views.InstancedStereo = false;
+		else if (arg == "--no-persistent-mapping")
+			persistentMapping = false;
+		else if (arg == "--no-point-shadows")
+			pointShadows = false;
+		else if (arg == "--point-shadow-resolution" && i + 1 < argc)
+			pointShadowMap.MaxResolution = std::max(16, atoi(argv[++i]));
+		else if (arg == "--depth-prepass" && i + 1 < argc)
+		{
+			if (parseDepthPrepassMode(argv[++i], cubesDepthPrepass))
+				backpackDepthPrepass = cubesDepthPrepass;
+		}
+		else if (arg == "--depth-prepass-cubes" && i + 1 < argc)
+			parseDepthPrepassMode(argv[++i], cubesDepthPrepass);
+		else if (arg == "--depth-prepass-backpack" && i + 1 < argc)
+			parseDepthPrepassMode(argv[++i], backpackDepthPrepass);
+		else if (arg == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg == "--software")
+			softwareRendering = true;
 	}
-	glfwMakeContextCurrent(window);
-
-	// Init GLAD (manages OpenGL function pointers)
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	PROFILE_THREAD_NAME("Main");
+	views.Init();
+	if (views.MultipleViews())
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		deferredShading = false;
+		occlusionCulling = false;
+		useLightClusters = false;
 	}
+	if (!tracePath.empty() && !PROFILE_START(tracePath))
+		std::cout << "Profiler trace not written, build with PROFILER_ENABLED=1 to enable it" << std::endl;
+	if (softwareRendering)
+		return runSoftwareRenderer();
+
+	GLFWwindow* window = NULL;
+	HeadlessContext headlessContext;
+	if (isHeadless)
+	{
+		// Offscreen context and backbuffer, no window or input
+		if (!headlessContext.CreateContext())
+		{
+			std::cout << "Failed to create headless context" << std::endl;
+			return -1;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+		if (!headlessContext.CreateFramebuffer(renderWidth, renderHeight))
+			return -1;
+		std::cout << "Rendering headless at " << renderWidth << "x" << renderHeight << " on " << glGetString(GL_RENDERER) << std::endl;
+	}
+	else
+	{
+		// Setup version (using OpenGL v3.3 in core-profile mode)
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		// Create an OpenGL window using GLFW library implementation
+		window = glfwCreateWindow(renderWidth, renderHeight, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
 
-	// Give OpenGL dimensions of window
-	glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-	
-	// Hide and capture mouse cursor
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// Init GLAD (manages OpenGL function pointers)
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+
+		// Hide and capture mouse cursor
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	// Callback function for window being resized
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		// Callback function for window being resized
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-	// Callback function for mouse cursor movement
-	glfwSetCursorPosCallback(window, mouse_callback);
+		// Callback function for mouse cursor movement
+		glfwSetCursorPosCallback(window, mouse_callback);
 
-	// Callback function for scrolling zoom
-	glfwSetScrollCallback(window, scroll_callback);
+		// Callback function for scrolling zoom
+		glfwSetScrollCallback(window, scroll_callback);
 
-	// Callback function for mouse buttons
-	glfwSetMouseButtonCallback(window, mouse_button_callback);
+		// Callback function for mouse buttons
+		glfwSetMouseButtonCallback(window, mouse_button_callback);
+
+		// Callback function for keys (timestamped for the simulation)
+		glfwSetKeyCallback(window, key_callback);
+	}
+
+	// Give OpenGL dimensions of window
+	glViewport(0, 0, renderWidth, renderHeight);
 
 	// vertices of triangles in object space
 	// Ensure all triangles are counter-clockwise winding order
@@ -333,9 +720,45 @@ int main() {
 
 	Shader shaderProgram_original = Shader("vertex_shader_src.glsl", "fragment_shader_src.glsl");
 	Shader lightingShader = Shader("vertex_shader_lighting_src.glsl", "fragment_shader_lighting_src.glsl");
+	Shader instancedLightingShader = Shader("vertex_shader_lighting_instanced_src.glsl", "fragment_shader_lighting_src.glsl");
 	Shader lampShader = Shader("vertex_shader_light_src.glsl", "fragment_shader_light_src.glsl");
 	Shader modelShader = Shader("vertex_shader_model_src.glsl", "fragment_shader_model_src.glsl");
-	Shader outlineShader = Shader("vertex_shader_model_src.glsl", "fragment_shader_object_outline_src.glsl");
+	Shader outlineMaskShader = Shader("vertex_shader_fullscreen_src.glsl", "fragment_shader_outline_mask_src.glsl");
+	Shader outlineDistanceShader = Shader("vertex_shader_fullscreen_src.glsl", "fragment_shader_outline_distance_src.glsl");
+	Shader outlineShader = Shader("vertex_shader_fullscreen_src.glsl", "fragment_shader_outline_src.glsl");
+	Shader upscaleShader = Shader("vertex_shader_fullscreen_src.glsl", "fragment_shader_upscale_src.glsl");
+	// Deferred shading: G-buffer output for the cubes (per-cube and instanced) and models, then the lighting passes
+	Shader gbufferShader = Shader("vertex_shader_lighting_src.glsl", "fragment_shader_gbuffer_src.glsl");
+	Shader instancedGBufferShader = Shader("vertex_shader_lighting_instanced_src.glsl", "fragment_shader_gbuffer_src.glsl");
+	Shader modelGBufferShader = Shader("vertex_shader_model_src.glsl", "fragment_shader_gbuffer_src.glsl");
+	Shader deferredAmbientShader = Shader("vertex_shader_fullscreen_src.glsl", "fragment_shader_deferred_ambient_src.glsl");
+	Shader deferredLightShader = Shader("vertex_shader_deferred_light_src.glsl", "fragment_shader_deferred_light_src.glsl");
+	// Depth pre-pass versions of the lit cube and model shaders
+	Shader depthShader = Shader("vertex_shader_depth_src.glsl", "fragment_shader_depth_src.glsl");
+	Shader instancedDepthShader = Shader("vertex_shader_depth_instanced_src.glsl", "fragment_shader_depth_src.glsl");
+	renderQueue.SetDepthProgram(lightingShader.ID, depthShader.ID);
+	renderQueue.SetDepthProgram(instancedLightingShader.ID, instancedDepthShader.ID);
+	renderQueue.SetDepthProgram(modelShader.ID, depthShader.ID);
+	// Shadow casters are drawn depth-only with the same programs in deferred shading
+	renderQueue.SetDepthProgram(gbufferShader.ID, depthShader.ID);
+	renderQueue.SetDepthProgram(instancedGBufferShader.ID, instancedDepthShader.ID);
+	renderQueue.SetDepthProgram(modelGBufferShader.ID, depthShader.ID);
+	// Point light shadow casters: the depth-only vertex shaders with identity view and projection give world
+	// positions, which the geometry shader projects onto each cube map face
+	Shader pointShadowShader = Shader("vertex_shader_depth_src.glsl", "fragment_shader_shadow_cube_src.glsl", "geometry_shader_shadow_cube_src.glsl");
+	Shader instancedPointShadowShader = Shader("vertex_shader_depth_instanced_src.glsl", "fragment_shader_shadow_cube_src.glsl", "geometry_shader_shadow_cube_src.glsl");
+	renderQueue.SetDepthProgram(lightingShader.ID, pointShadowShader.ID, DEPTH_PROGRAMS_POINT_SHADOW);
+	renderQueue.SetDepthProgram(instancedLightingShader.ID, instancedPointShadowShader.ID, DEPTH_PROGRAMS_POINT_SHADOW);
+	renderQueue.SetDepthProgram(modelShader.ID, pointShadowShader.ID, DEPTH_PROGRAMS_POINT_SHADOW);
+	renderQueue.SetDepthProgram(gbufferShader.ID, pointShadowShader.ID, DEPTH_PROGRAMS_POINT_SHADOW);
+	renderQueue.SetDepthProgram(instancedGBufferShader.ID, instancedPointShadowShader.ID, DEPTH_PROGRAMS_POINT_SHADOW);
+	renderQueue.SetDepthProgram(modelGBufferShader.ID, pointShadowShader.ID, DEPTH_PROGRAMS_POINT_SHADOW);
+	// View and projection matrices, camera position and time come from the streamed ViewUniforms block
+	const Shader* viewShaders[] = { &lightingShader, &instancedLightingShader, &lampShader, &modelShader, &gbufferShader,
+		&instancedGBufferShader, &modelGBufferShader, &deferredAmbientShader, &deferredLightShader, &depthShader,
+		&instancedDepthShader, &pointShadowShader, &instancedPointShadowShader };
+	for (const Shader* shader : viewShaders)
+		shader->setBlockBinding("ViewUniforms", VIEW_UNIFORM_BINDING);
 
 	// -------------------------------------------------------------------------------------------------------------------------
 	// Generate, bind, and fill main Vertex Array Object (VAO) and Vertex Buffer Objects (VBOs)
@@ -393,6 +816,10 @@ int main() {
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
+	// Empty VAO for full-screen triangles (positions come from gl_VertexID)
+	unsigned int VAO_fullscreen;
+	glGenVertexArrays(1, &VAO_fullscreen);
+
 	// Second VAO for lighting cube
 	unsigned int VAO_light;
 	glGenVertexArrays(1, &VAO_light);
@@ -414,9 +841,19 @@ int main() {
 	// Set textures in shader
 	lightingShader.use();
 	lightingShader.setInt("material.diffuse", 7); // set metalBorderTexture
+	instancedLightingShader.use();
+	instancedLightingShader.setInt("material.diffuse", 7);
+	gbufferShader.use();
+	gbufferShader.setInt("material.diffuse", 7);
+	instancedGBufferShader.use();
+	instancedGBufferShader.setInt("material.diffuse", 7);
+	// Metal border texture diffuse map as a render queue material
+	RenderMaterial cubeMaterialDesc;
+	cubeMaterialDesc.AddTexture(metalBorderTexture, 7, "material.diffuse");
+	unsigned int cubeMaterial = renderQueue.RegisterMaterial(cubeMaterialDesc);
 
 	// Create copies of the cube at different x,y,z locations
-	glm::vec3 cubePositions[] = {
+	std::vector<glm::vec3> cubePositions = {
 		glm::vec3(0.0f, 0.0f, 0.0f),
 		glm::vec3(2.0f, 5.0f, -15.0f),
 		glm::vec3(-1.5f, -2.2f, -2.5f),
@@ -430,6 +867,66 @@ int main() {
 		glm::vec3(1.5f, 0.2f, -1.5f),
 		glm::vec3(-1.3f, 1.0f, -1.5f)
 	};
+	// Any extra cubes are scattered pseudo-randomly (same layout every run)
+	srand(1);
+	while (cubePositions.size() < cubeCount)
+	{
+		float x = rand() / (float)RAND_MAX * 40.0f - 20.0f;
+		float y = rand() / (float)RAND_MAX * 20.0f - 10.0f;
+		float z = rand() / (float)RAND_MAX * -60.0f;
+		cubePositions.push_back(glm::vec3(x, y, z));
+	}
+	cubePositions.resize(cubeCount);
+
+	// Instanced cube field: base position and twist speed per instance, the animation is evaluated in the vertex shader
+	std::vector<glm::vec4> cubeInstances(cubeCount);
+	AABB cubeFieldBounds;
+	cubeFieldBounds.Expand(glm::vec3(0.0f));
+	for (unsigned int i = 0; i < cubeCount; i++)
+	{
+		cubeInstances[i] = glm::vec4(cubePositions[i], i / 2.0f + 7.0f);
+		// Each cube moves between the origin and its base position
+		cubeFieldBounds.Expand(cubePositions[i]);
+	}
+	// Pad by the rotating cube's size (relative to the field's scene node, which holds the -0.5 z offset)
+	cubeFieldBounds = AABB(cubeFieldBounds.Min - glm::vec3(CUBE_RADIUS), cubeFieldBounds.Max + glm::vec3(CUBE_RADIUS));
+	unsigned int VAO_cubeInstanced, VBO_cubeInstances;
+	glGenVertexArrays(1, &VAO_cubeInstanced);
+	glGenBuffers(1, &VBO_cubeInstances);
+	glBindVertexArray(VAO_cubeInstanced);
+	// Per vertex attributes from the cube VBOs (positions, texture coords, normals)
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_vertices);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_metalBorderTexCoords);
+	glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
+	glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	// Per instance attribute, advanced once per instance instead of per vertex
+	glBindBuffer(GL_ARRAY_BUFFER, VBO_cubeInstances);
+	glBufferData(GL_ARRAY_BUFFER, cubeInstances.size() * sizeof(glm::vec4), cubeInstances.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+	glVertexAttribDivisor(6, 1);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(4);
+	glEnableVertexAttribArray(5);
+	glEnableVertexAttribArray(6);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	// Light volumes for deferred shading, and the texture buffers the point lights are packed into
+	LightVolumeMesh sphereVolume = createSphereVolume(8, 16);
+	LightVolumeMesh coneVolume = createConeVolume(16);
+	cubePointLights.Init();
+	modelPointLights.Init();
+	volumePointLights.Init();
+	cubeLightClusters.Init();
+	modelLightClusters.Init();
+
+	// Worker threads, each recording draw packets into its own command list
+	JobSystem jobSystem(workerThreadCount);
+	renderQueue.SetThreadCount(jobSystem.NumThreads());
+	std::cout << "Recording draws on " << jobSystem.NumThreads() << " threads" << std::endl;
 
 	// Flip texture along y axis before loading
 	stbi_set_flip_vertically_on_load(true);
@@ -438,21 +935,198 @@ int main() {
 	modelShader.use();
 	Model backpackModel = Model((char*)"models/backpack/backpack.obj");
 
-	// Flashlight properties
-	glm::vec3 flashlightColour = glm::vec3(0.7f);
-	glm::vec3 fl_diffuseIntensity = glm::vec3(1.0f);
-	glm::vec3 fl_ambientIntensity = glm::vec3(0.2f);
-	glm::vec3 fl_specularIntensity = glm::vec3(0.4f);
-	glm::vec3 fl_diffuseColor = flashlightColour * fl_diffuseIntensity;
-	glm::vec3 fl_ambientColor = fl_diffuseColor * fl_ambientIntensity;
-	// Directional light properties
-	glm::vec3 dl_lightColour = glm::vec3(1.0f);
-	glm::vec3 dl_diffuseIntensity = glm::vec3(0.5f);
-	glm::vec3 dl_ambientIntensity = glm::vec3(0.2f);
-	glm::vec3 dl_specularIntensity = glm::vec3(0.2f);
-	glm::vec3 dl_diffuseColor = dl_lightColour * dl_diffuseIntensity;
-	glm::vec3 dl_ambientColor = dl_diffuseColor * dl_ambientIntensity;
+	// Build the scene graph (parents before children) and the entities placed in it: lamp, backpack with the
+	// imported node hierarchy, then the cubes last since they change every frame
+	unsigned int sceneRoot = sceneGraph.AddNode(glm::mat4(1.0f), SceneGraph::NO_PARENT, "Scene");
+
+	// Lamp: small cube carrying the point light, orbits when the moving light is on (3/4)
+	TransformComponent lampTransform;
+	lampTransform.Position = LAMP_POSITION;
+	lampTransform.Scale = glm::vec3(0.2f);
+	lampTransform.SceneNode = sceneGraph.AddNode(lampTransform.LocalMatrix(), sceneRoot, "Lamp");
+	AnimationComponent lampAnimation;
+	lampAnimation.Type = ANIMATION_ORBIT;
+	lampAnimation.BasePosition = LAMP_POSITION;
+	lampAnimation.Enabled = false;
+	RenderableComponent lampRenderable;
+	lampRenderable.Pass = RENDER_PASS_LAMP;
+	lampRenderable.Program = lampShader.ID;
+	lampRenderable.VAO = VAO_light;
+	lampRenderable.Count = 36;
+	BoundsComponent lampBounds;
+	lampBounds.Local = cubeBounds;
+	lampEntity = world.Create(lampTransform, lampAnimation, lampRenderable, lampBounds, createLampLight());
+
+	// Backpack model
+	TransformComponent backpackTransform;
+	backpackTransform.Position = BACKPACK_POSITION;
+	backpackTransform.Scale = glm::vec3(BACKPACK_SCALE);
+	backpackTransform.SceneNode = sceneGraph.AddNode(backpackTransform.LocalMatrix(), sceneRoot, "Backpack");
+	RenderableComponent backpackRenderable;
+	backpackRenderable.Kind = RENDERABLE_MODEL;
+	backpackRenderable.Pass = RENDER_PASS_BACKPACK;
+	backpackRenderable.Program = deferredShading ? modelGBufferShader.ID : modelShader.ID;
+	backpackRenderable.SourceModel = &backpackModel;
+	backpackRenderable.ModelNode = backpackModel.Instantiate(sceneGraph, backpackTransform.SceneNode);
+	backpackRenderable.ShadowCaster = SHADOW_CASTER_STATIC;
+	BoundsComponent backpackBounds;
+	backpackBounds.Local = backpackModel.Bounds;
+	OccluderComponent backpackOccluder;
+	backpackOccluder.Box = AABB(backpackBounds.Local.Center() - backpackBounds.Local.Extents() * BACKPACK_OCCLUDER_SCALE,
+		backpackBounds.Local.Center() + backpackBounds.Local.Extents() * BACKPACK_OCCLUDER_SCALE);
+	backpackEntity = world.Create(backpackTransform, backpackRenderable, backpackBounds, backpackOccluder);
+
+	// Cubes, placed relative to the cube field node
+	TransformComponent fieldTransform;
+	fieldTransform.Position = glm::vec3(0.0f, 0.0f, -0.5f);
+	fieldTransform.SceneNode = sceneGraph.AddNode(fieldTransform.LocalMatrix(), sceneRoot, "Cubes");
+	RenderableComponent cubeRenderable;
+	cubeRenderable.Pass = RENDER_PASS_CUBES;
+	cubeRenderable.Material = cubeMaterial;
+	cubeRenderable.Count = 42;
+	cubeRenderable.Indexed = true;
+	// With --cubes 0 the field is left empty either way: a draw of 0 instances would go down the non-instanced path
+	if (useInstancedCubes && cubeCount > 0)
+	{
+		// The whole field is one entity, drawn with a single instanced draw and culled as a whole
+		cubeRenderable.Program = deferredShading ? instancedGBufferShader.ID : instancedLightingShader.ID;
+		cubeRenderable.VAO = VAO_cubeInstanced;
+		cubeRenderable.Instances = cubeCount;
+		cubeRenderable.ShadowCaster = SHADOW_CASTER_ANIMATED;
+		BoundsComponent fieldBounds;
+		fieldBounds.Local = cubeFieldBounds;
+		world.Create(fieldTransform, cubeRenderable, fieldBounds);
+	}
+	else
+	{
+		// One entity per cube, animated on the CPU
+		world.Create(fieldTransform);
+		cubeRenderable.Program = deferredShading ? gbufferShader.ID : lightingShader.ID;
+		cubeRenderable.VAO = VAO_cube;
+		cubeRenderable.ShadowCaster = SHADOW_CASTER_DYNAMIC;
+		BoundsComponent cubeBoundsComponent;
+		cubeBoundsComponent.Local = cubeBounds;
+		// The cube is solid, so its bounds occlude exactly
+		OccluderComponent cubeOccluder;
+		cubeOccluder.Box = cubeBounds;
+		for (unsigned int i = 0; i < cubeCount; i++)
+		{
+			TransformComponent cubeTransform;
+			cubeTransform.RotationAxis = glm::vec3(0.1f, 0.1f, 0.15f);
+			cubeTransform.SceneNode = sceneGraph.AddNode(glm::mat4(1.0f), fieldTransform.SceneNode, "Cube");
+			AnimationComponent cubeAnimation;
+			cubeAnimation.Type = ANIMATION_CUBE_TWIST;
+			cubeAnimation.BasePosition = cubePositions[i];
+			cubeAnimation.Speed = i / 2.0f + 7.0f;
+			world.Create(cubeTransform, cubeAnimation, cubeRenderable, cubeBoundsComponent, cubeOccluder);
+		}
+	}
+
+	// Flashlight attached to the camera, toggled with 5/6 or the left mouse button
+	flashlightEntity = world.Create(createFlashlight());
+	// Directional lights, from a different direction for the cubes than for the models. The cubes' light casts
+	// the shadows, of the backpack as well as the cubes.
+	LightComponent cubesDirLight = createDirLight(glm::vec3(-1.0f, -1.0f, 0.0f), LIGHT_RECEIVER_CUBES);
+	cubesDirLight.CastsShadows = true;
+	world.Create(cubesDirLight);
+	world.Create(createDirLight(glm::vec3(1.0f, -0.5f, -1.0f), LIGHT_RECEIVER_MODELS));
+
+	// Extra point lights (the lamp is the first), scattered like the extra cubes with random colours
+	for (unsigned int i = 1; i < pointLightCount; i++)
+		world.Create(createExtraPointLight());
+	if (pointLightCount > 1)
+		std::cout << "Created " << pointLightCount - 1 << " extra point lights" << std::endl;
+	if (deferredShading)
+		std::cout << "Deferred shading" << std::endl;
+	if (views.MultipleViews())
+		std::cout << views.Count() << " views" << (views.SinglePassStereo() ? ", stereo pair in one instanced pass" : "")
+			<< " (forward shading, no light clusters or occlusion culling)" << std::endl;
+	if (shadowMap.NumCascades > 0)
+	{
+		shadowMap.Init();
+		std::cout << shadowMap.NumCascades << " shadow cascades of " << shadowMap.Resolution << "x" << shadowMap.Resolution
+			<< " up to " << shadowMap.ShadowDistance << (shadowMap.Caching ? ", cached" : ", re-rendered every frame") << std::endl;
+	}
+	streamBuffer.Init(isHeadless ? (GLADloadproc)HeadlessContext::GetProcAddress : (GLADloadproc)glfwGetProcAddress,
+		STREAM_BUFFER_FRAME_SIZE, persistentMapping);
+	std::cout << "Streaming per-frame uniforms through " << StreamBuffer::NUM_FRAMES << " x " << streamBuffer.FrameSize() / 1024 << " KB"
+		<< (streamBuffer.Persistent() ? ", persistently mapped" : ", mapped per allocation") << std::endl;
+	if (pointShadows)
+	{
+		pointShadowMap.Init();
+		std::cout << "Point light shadows of " << pointShadowMap.MinResolution << " to " << pointShadowMap.MaxResolution << " per face"
+			<< (pointShadowMap.Caching ? ", cached" : ", re-rendered every frame") << std::endl;
+	}
+
+	// Extra entities scattered like the extra cubes, animated every frame but not in the scene graph or drawn
+	for (unsigned int i = 0; i < extraEntityCount; i++)
+	{
+		AnimationComponent animation;
+		animation.BasePosition = glm::vec3(rand() / (float)RAND_MAX * 40.0f - 20.0f, rand() / (float)RAND_MAX * 20.0f - 10.0f, rand() / (float)RAND_MAX * -60.0f);
+		animation.Speed = (i % 64) / 2.0f + 7.0f;
+		world.Create(TransformComponent(), animation);
+	}
+	if (extraEntityCount > 0)
+		std::cout << "Created " << extraEntityCount << " extra entities" << std::endl;
 	
+	// Camera matrices, frustum and time shared by everything rendered in a frame
+	FrameContext frame;
+	// Render passes of the frame, rebuilt every frame (transient render targets are pooled across frames)
+	FrameGraph frameGraph;
+	if (isHeadless)
+		frameGraph.SetBackbufferFramebuffer(headlessContext.Framebuffer);
+	// Depth-only draws of a shadow cascade's casters queued in the given render queue pass, seen from the light
+	auto drawShadowCasters = [&](unsigned int cascadeIndex, unsigned int pass) {
+		const CascadedShadowMap::Cascade& cascade = shadowMap.GetCascade(cascadeIndex);
+		glm::vec3 lightPosition = glm::vec3(glm::inverse(cascade.View)[3]);
+		bindViewUniforms(streamViewUniforms(cascade.View, cascade.Projection, lightPosition, frame.Time));
+		renderQueue.SubmitDepth(pass);
+	};
+
+	// Camera path recording/replay
+	CameraPath cameraPath;
+	BenchmarkRecorder benchmark;
+	GpuFrameTimer gpuTimer;
+	bool isRecording = !recordPath.empty();
+	bool isReplaying = !replayPath.empty() && cameraPath.Load(replayPath);
+	unsigned int replayFrame = 0;
+	if (isReplaying)
+	{
+		if (replayFrameCount == 0)
+			replayFrameCount = cameraPath.Frames.size();
+		// Don't let vsync cap the measured frame times
+		if (!isHeadless)
+			glfwSwapInterval(0);
+		std::cout << "Replaying " << replayPath << " for " << replayFrameCount << " frames" << std::endl;
+	}
+	// The governor needs the GPU frame time as well
+	if (isReplaying || dynamicResolution)
+		gpuTimer.Init();
+	if (dynamicResolution)
+		std::cout << "Dynamic resolution targeting " << governor.TargetMilliseconds << " ms per frame" << std::endl;
+	// Shadow map sizes at full quality, scaled down by the governor's lower levels
+	const int fullShadowResolution = shadowMap.Resolution;
+	const int fullPointShadowResolution = pointShadowMap.MaxResolution;
+	if (gpuProfileEnabled)
+		gpuProfiler().Init(gpuProfileDraws);
+	if (!deferredShading)
+	{
+		overdrawMonitor.SetPass(RENDER_PASS_CUBES, "Cubes", cubesDepthPrepass);
+		overdrawMonitor.SetPass(RENDER_PASS_BACKPACK, "Backpack", backpackDepthPrepass);
+		overdrawMonitor.Init();
+	}
+	double lastGpuMilliseconds = 0.0;
+	unsigned int headlessFrameCount = isReplaying ? replayFrameCount : (replayFrameCount > 0 ? replayFrameCount : DEFAULT_HEADLESS_FRAMES);
+	unsigned int renderedFrames = 0;
+
+	// Start the simulation clock at the current time
+	simulation.SetTickRate(simulationTickRate);
+	lastFrame = getTime();
+	double firstFrameTime = lastFrame;
+	simulation.Reset(lastFrame);
+	SimulationState previousState = SimulationState::Capture(camera, simulation.Time());
+	SimulationState currentState = previousState;
+
 	// Enable face culling
 	glEnable(GL_CULL_FACE);
 	//glCullFace(GL_FRONT); // cull front faces
@@ -461,117 +1135,852 @@ int main() {
 
 	// -------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 	// Display graphics loop
-	while (!glfwWindowShouldClose(window))
+	while (isHeadless ? renderedFrames < headlessFrameCount : !glfwWindowShouldClose(window))
 	{
+		PROFILE_ZONE("Frame");
+		frameStats.BeginFrame(getTime());
+
+		// Check events first so they are timestamped before the simulation consumes them
+		if (!isHeadless)
+			glfwPollEvents();
+
 		// Calculate deltaTime
-		float currentFrame = glfwGetTime();
+		double frameStartTime = getTime();
+		float currentFrame = frameStartTime;
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 		timeSinceLastPrintf += deltaTime;
 
-		// user key input processing
-		processInput(window);
-
-		// Enable OpenGL z-buffer depth comparisons
-		glEnable(GL_DEPTH_TEST);
-		// Render only those fragments with lower depth values
-		glDepthFunc(GL_LESS);
-
-		// Enable OpenGL stencil buffer
-		glEnable(GL_STENCIL_TEST);
-		// Tell OpenGL that whenever the stencil value of a fragment is not equal to 1, it should be discarded
-		// glStencilFunc(GL_EQUAL, 1, 0xFF);
-		// glStencilOp parameters:
-		// - sfail: action to take if the stencil test fails
-		// - dpfail : action to take if the stencil test passes, but the depth test fails
-		// - dppass : action to take if both the stenciland the depth test pass
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-		// set all fragments to update the stencil buffer
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
-		// bitwise AND operator with each stencil buffer write
-		glStencilMask(0xFF);  // enable stencil buffer writing
-		// Next draw the objects normally before switching stencil buffer properties and shader
-
-		// Lamp point light colour
-		glm::vec3 lightColor;
-		lightColor.x = sin(glfwGetTime() * 1.0f) / 2.0f + 0.7f;
-		lightColor.y = sin(glfwGetTime() * 0.5f) / 2.0f + 0.7f;
-		lightColor.z = sin(glfwGetTime() * 0.4f) / 2.0f + 0.7f;
-
-		// Set clear colour
-		glClearColor(lightColor.x / 10.0f, lightColor.y / 10.0f, lightColor.z / 10.0f, 1.0f);
-		// Clear colour and z-buffers
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-		// Point light properties
-		glm::vec3 pl_diffuseIntensity = glm::vec3(0.9f);
-		glm::vec3 pl_ambientIntensity = glm::vec3(0.4f);
-		glm::vec3 pl_specularIntensity = glm::vec3(0.8f);
-		glm::vec3 pl_diffuseColor = lightColor * pl_diffuseIntensity;
-		glm::vec3 pl_ambientColor = pl_diffuseColor * pl_ambientIntensity;
+		// user key input processing (mode toggles)
+		if (!isHeadless)
+			processInput(window);
+
+		// Run as many fixed-size simulation ticks as fit in the elapsed time
+		simulation.Advance(deltaTime);
+		while (simulation.Step())
+		{
+			previousState = currentState;
+			simulationTick((float)simulation.StepSize(), simulation.Time());
+			currentState = SimulationState::Capture(camera, simulation.Time());
+		}
+
+		// Render an interpolation of the last two simulated states
+		SimulationState renderState = SimulationState::Lerp(previousState, currentState, simulation.Alpha());
+		if (isReplaying)
+		{
+			// Camera pose and toggles come from the recorded path, time advances by a fixed step per frame
+			const CameraPathFrame& pathFrame = cameraPath.At(replayFrame);
+			renderState.CameraPosition = pathFrame.Position;
+			renderState.Yaw = pathFrame.Yaw;
+			renderState.Pitch = pathFrame.Pitch;
+			renderState.Zoom = pathFrame.Zoom;
+			renderState.Time = replayFrame * REPLAY_TIME_STEP;
+			flashlightEnabled() = pathFrame.FlashlightOn;
+			movingLightEnabled() = pathFrame.MovingLight;
+			outlineEnabled() = pathFrame.OutlineOn;
+		}
+		else if (isHeadless)
+			renderState.Time = renderedFrames * REPLAY_TIME_STEP;
+		else if (isRecording)
+		{
+			CameraPathFrame pathFrame = { renderState.CameraPosition, renderState.Yaw, renderState.Pitch, renderState.Zoom,
+				flashlightEnabled(), movingLightEnabled(), outlineEnabled() };
+			cameraPath.Record(pathFrame);
+		}
+		renderCamera.SetPose(renderState.CameraPosition, renderState.Yaw, renderState.Pitch, renderState.Zoom);
+
+		// Snapshot the camera matrices and frame time once; nothing below reads the camera or clock directly
+		frame.Update(renderCamera, (float)renderState.Time, deltaTime, renderWidth, renderHeight);
+		views.Update(renderCamera, (float)renderState.Time, deltaTime, renderWidth, renderHeight);
+		frameStats.Mark(FRAME_PHASE_INPUT, getTime());
+
+		// Update the entities: animation, transforms into the scene graph (then to world space), bounds and lights
+		animationSystem(frame, jobSystem);
+		transformSystem(jobSystem);
+		sceneGraph.Update();
+		boundsSystem(jobSystem);
+		lightSystem(frame);
+		lightBufferSystem(frame, jobSystem);
+		double updateMilliseconds = frameStats.Mark(FRAME_PHASE_UPDATE, getTime());
+
+		// Frustum culling: gather world space bounds of every renderable and test them in one batch
+		cullingSystem(frame, jobSystem);
+		frameStats.Mark(FRAME_PHASE_CULLING, getTime());
+
+		// Wait for this frame's region of the stream buffer (the frame that last used it was submitted
+		// StreamBuffer::NUM_FRAMES frames ago), then stream the camera's uniforms
+		streamBuffer.BeginFrame();
+		cameraViewUniforms = streamViewUniforms(frame.View, frame.Projection, frame.CameraPosition, frame.Time);
+		for (unsigned int v = 0; v < views.Count(); v++)
+		{
+			RenderView& view = views.Views[v];
+			view.Uniforms = streamViewUniforms(view.Frame.View, view.Frame.Projection, view.Frame.CameraPosition, frame.Time);
+		}
+		StreamBuffer::Allocation stereoViewUniforms;
+		if (views.SinglePassStereo())
+			stereoViewUniforms = streamStereoViewUniforms(views.Views[0].Frame, views.Views[1].Frame, frame.Time);
+
+		// Record the draws of every pass into the render queue
+		renderQueue.Clear();
+		renderQueue.SetCamera(frame.CameraPosition, RENDER_QUEUE_FAR_PLANE);
+		renderSystem(jobSystem);
+		shadowSystem(frame);
+		pointShadowSystem(frame);
+		renderQueue.Sort();
+
+		renderStats().Reset();
+		if (isReplaying || dynamicResolution)
+			gpuTimer.BeginFrame();
+
+		// GPU scope results of the frame NUM_FRAMES ago
+		if (gpuProfiler().BeginFrame())
+		{
+			for (unsigned int i = 0; i < gpuProfiler().Results.size(); i++)
+			{
+				const GpuProfiler::ScopeResult& result = gpuProfiler().Results[i];
+				frameStats.AddSample("gpu_ms " + result.Path, result.Milliseconds);
+				if (isReplaying)
+					benchmark.AddSample("gpu_ms " + result.Path, result.Milliseconds);
+				if (result.HasStatistics)
+				{
+					frameStats.AddSample("vs_invocations " + result.Path, (double)result.VertexInvocations);
+					frameStats.AddSample("fs_invocations " + result.Path, (double)result.FragmentInvocations);
+					if (isReplaying)
+					{
+						benchmark.AddSample("vs_invocations " + result.Path, (double)result.VertexInvocations);
+						benchmark.AddSample("fs_invocations " + result.Path, (double)result.FragmentInvocations);
+					}
+				}
+			}
+		}
+
+		// Shaded fragment counts of the frame NUM_FRAMES ago, and this frame's depth pre-passes
+		if (overdrawMonitor.BeginFrame())
+		{
+			for (unsigned int pass = 0; pass < overdrawMonitor.NumPasses(); pass++)
+			{
+				if (!overdrawMonitor.HasPass(pass) || !overdrawMonitor.Result(pass).Measured)
+					continue;
+				const OverdrawMonitor::PassResult& result = overdrawMonitor.Result(pass);
+				frameStats.AddSample("shaded_fragments " + overdrawMonitor.Name(pass), (double)result.ShadedFragments);
+				if (result.Prepass)
+					frameStats.AddSample("prepass_fragments " + overdrawMonitor.Name(pass), (double)result.PrepassFragments);
+			}
+		}
+
+		// Lamp point light colour (also tints the clear colour)
+		glm::vec3 lightColor = world.Get<LightComponent>(lampEntity).Color;
+
+		// Build the frame graph: each pass declares which backbuffer attachments it reads and writes,
+		// and the state it needs. The graph orders the passes and applies the state changes between them.
+		frameGraph.Reset();
+		frameGraph.SetBackbufferSize(frame.ViewportWidth, frame.ViewportHeight);
+		FrameGraph::Handle backbufferColor = frameGraph.ImportBackbuffer("BackbufferColor");
+		// The scene passes render straight into the backbuffer, or with dynamic resolution into the bottom left
+		// sceneWidth x sceneHeight of full size offscreen targets that the Upscale pass stretches over the backbuffer.
+		// Deferred shading samples the depth and outlines build a mask from the stencil, so they render offscreen.
+		bool showOutlines = false;
+		world.Each<RenderableComponent>([&](unsigned int count, RenderableComponent* renderables) {
+			for (unsigned int i = 0; i < count; i++)
+				showOutlines = showOutlines || (renderables[i].Enabled && renderables[i].Outlined);
+		});
+		bool offscreenScene = dynamicResolution || deferredShading || showOutlines;
+		FrameGraph::Handle sceneColor = backbufferColor;
+		FrameGraph::Handle sceneDepthStencil = offscreenScene ? FrameGraph::INVALID_HANDLE : frameGraph.ImportBackbuffer("BackbufferDepthStencil");
+		float renderScale = dynamicResolution ? governor.RenderScale() : 1.0f;
+		int sceneWidth = std::max(1, (int)(frame.ViewportWidth * renderScale));
+		int sceneHeight = std::max(1, (int)(frame.ViewportHeight * renderScale));
+		int outlineWidth = std::max(1, (int)(OUTLINE_WIDTH * renderScale + 0.5f));
+
+		// Submits a scene pass's draws once per view, into the view's part of the scene target with its ViewUniforms,
+		// skipping the draws the view can't see. Single-pass stereo submits once for both eyes: every draw gets an
+		// instance per eye, and the cube field's per-instance data advances once per eye pair. Views are GPU
+		// profiled as scopes inside the pass.
+		auto submitViews = [&](unsigned int pass, bool depthOnly) {
+			for (unsigned int v = 0; v < views.Submissions(); v++)
+			{
+				RenderView& view = views.Views[v];
+				if (views.MultipleViews())
+					gpuProfiler().BeginScope(views.SubmissionName(v));
+				if (views.SinglePassStereo())
+				{
+					glViewport(0, 0, sceneWidth, sceneHeight);
+					bindViewUniforms(stereoViewUniforms);
+					glEnable(GL_CLIP_DISTANCE0);
+					glBindVertexArray(VAO_cubeInstanced);
+					glVertexAttribDivisor(6, 2);
+					renderQueue.SetViews(views.AllViews(), 2);
+				}
+				else
+				{
+					ViewSet::SetViewport(view, sceneWidth, sceneHeight);
+					bindViewUniforms(view.Uniforms);
+					renderQueue.SetViews(1u << v);
+				}
+				double start = getTime();
+				unsigned int draws = renderStats().DrawCalls;
+				if (depthOnly)
+					renderQueue.SubmitDepth(pass);
+				else
+					renderQueue.Submit(pass);
+				view.SubmitMilliseconds += (getTime() - start) * 1000.0;
+				view.Draws += renderStats().DrawCalls - draws;
+				if (views.SinglePassStereo())
+				{
+					glDisable(GL_CLIP_DISTANCE0);
+					glBindVertexArray(VAO_cubeInstanced);
+					glVertexAttribDivisor(6, 1);
+					glBindVertexArray(0);
+				}
+				if (views.MultipleViews())
+					gpuProfiler().EndScope();
+			}
+			renderQueue.SetViews();
+			glViewport(0, 0, sceneWidth, sceneHeight);
+		};
+
+		// Shadow cascades re-rendered this frame, each in its own passes so their cost is profiled separately. The
+		// others keep the depth of an earlier frame. Static casters are drawn into the cached static layer only
+		// when the cascade moved; the sampled layer starts from a copy of it and gets the dynamic casters on top.
+		std::vector<FrameGraph::Handle> shadowLayers;
+		if (shadowMap.Enabled)
+		{
+			PassState shadowState;
+			shadowState.ColorWrite = false;
+			shadowState.PolygonOffset = true;
+			shadowState.PolygonOffsetFactor = SHADOW_SLOPE_BIAS;
+			shadowState.PolygonOffsetUnits = SHADOW_CONSTANT_BIAS;
+			for (unsigned int c = 0; c < shadowMap.NumCascades; c++)
+			{
+				const CascadedShadowMap::Cascade& cascade = shadowMap.GetCascade(c);
+				std::string cascadeName = "ShadowCascade " + std::to_string(c);
+				frameStats.AddSample("shadow_rendered " + cascadeName, cascade.Dirty ? 1.0 : 0.0);
+				frameStats.AddSample("shadow_draws " + cascadeName, (double)(cascade.StaticDraws + cascade.DynamicDraws));
+				FrameGraph::Handle layer = frameGraph.ImportTexture(cascadeName, shadowMap.Texture(), shadowMap.LayerDesc(), c);
+				if (cascade.Dirty)
+				{
+					FrameGraph::Handle staticLayer = FrameGraph::INVALID_HANDLE;
+					if (shadowMap.Caching)
+					{
+						staticLayer = frameGraph.ImportTexture("ShadowStatic " + std::to_string(c), shadowMap.StaticTexture(), shadowMap.LayerDesc(), c);
+						if (cascade.StaticDirty)
+						{
+							frameGraph.AddPass("ShadowStatic " + std::to_string(c),
+								[&](FrameGraph::Builder& builder) {
+									staticLayer = builder.Write(staticLayer);
+									builder.SetState(shadowState);
+								},
+								[&, c](const FrameGraph::Resources&) {
+									glClear(GL_DEPTH_BUFFER_BIT);
+									drawShadowCasters(c, RENDER_PASS_SHADOW_STATIC + c);
+								});
+						}
+					}
+					frameGraph.AddPass(cascadeName,
+						[&](FrameGraph::Builder& builder) {
+							if (staticLayer != FrameGraph::INVALID_HANDLE)
+								builder.Read(staticLayer);
+							layer = builder.Write(layer);
+							builder.SetState(shadowState);
+						},
+						[&, c](const FrameGraph::Resources&) {
+							// Without caching the static casters are queued with the dynamic ones
+							if (shadowMap.Caching)
+								shadowMap.CopyStaticLayer(c);
+							else
+								glClear(GL_DEPTH_BUFFER_BIT);
+							drawShadowCasters(c, RENDER_PASS_SHADOW_DYNAMIC + c);
+						});
+				}
+				shadowLayers.push_back(layer);
+			}
+		}
+		// Point light shadow cube map, every face in one pass when it is re-rendered. Its depth is the distance
+		// from the light written by the fragment shader, so polygon offset wouldn't apply: receivers bias their
+		// lookups instead. The faces are flipped the way cube maps are sampled, which flips the winding, so both
+		// sides are drawn.
+		if (pointShadowMap.Enabled)
+		{
+			frameStats.AddSample("shadow_rendered PointShadow", pointShadowMap.Dirty ? 1.0 : 0.0);
+			frameStats.AddSample("shadow_resolution PointShadow", (double)pointShadowMap.Resolution);
+			frameStats.AddSample("shadow_draws PointShadow", (double)pointShadowMap.Draws);
+			frameStats.AddSample("shadow_face_draws PointShadow", (double)pointShadowMap.FaceDraws);
+			FrameGraph::Handle cube = frameGraph.ImportTexture("PointShadow", pointShadowMap.Texture(), pointShadowMap.FaceDesc(), FrameGraph::ALL_LAYERS);
+			if (pointShadowMap.Dirty)
+			{
+				frameGraph.AddPass("PointShadow",
+					[&](FrameGraph::Builder& builder) {
+						cube = builder.Write(cube);
+						PassState state;
+						state.ColorWrite = false;
+						state.CullFace = false;
+						builder.SetState(state);
+					},
+					[&](const FrameGraph::Resources&) {
+						glClear(GL_DEPTH_BUFFER_BIT);
+						bindViewUniforms(streamViewUniforms(glm::mat4(1.0f), glm::mat4(1.0f), pointShadowMap.Position, frame.Time));
+						pointShadowShader.use();
+						pointShadowMap.ApplyCaster(pointShadowShader);
+						instancedPointShadowShader.use();
+						pointShadowMap.ApplyCaster(instancedPointShadowShader);
+						renderQueue.SubmitDepth(RENDER_PASS_POINT_SHADOW, DEPTH_PROGRAMS_POINT_SHADOW);
+					});
+			}
+			shadowLayers.push_back(cube);
+		}
+
+		// Clear colour, depth and stencil
+		frameGraph.AddPass("Clear",
+			[&](FrameGraph::Builder& builder) {
+				if (offscreenScene)
+				{
+					// Deferred lights are summed by blending, which would lose precision in an 8 bit target
+					GLenum colorFormat = deferredShading ? GL_RGBA16F : GL_RGBA8;
+					FrameGraphTextureDesc colorDesc = { (int)frame.ViewportWidth, (int)frame.ViewportHeight, colorFormat };
+					FrameGraphTextureDesc depthDesc = { (int)frame.ViewportWidth, (int)frame.ViewportHeight, GL_DEPTH24_STENCIL8 };
+					sceneColor = builder.Create("SceneColor", colorDesc);
+					sceneDepthStencil = builder.Create("SceneDepthStencil", depthDesc);
+				}
+				else
+				{
+					sceneColor = builder.Write(sceneColor);
+					sceneDepthStencil = builder.Write(sceneDepthStencil);
+				}
+				builder.SetViewport(sceneWidth, sceneHeight);
+				PassState state;
+				state.StencilWriteMask = 0xFF; // glClear respects the stencil write mask
+				builder.SetState(state);
+			},
+			[&](const FrameGraph::Resources&) {
+				glClearColor(lightColor.x / 10.0f, lightColor.y / 10.0f, lightColor.z / 10.0f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+			});
+
+		// Scene geometry passes write the outline stencil bit: 0 normally, set by the render queue for outlined draws
+		PassState outlineMarking;
+		outlineMarking.StencilTest = true;
+		outlineMarking.StencilWriteMask = OUTLINE_STENCIL_BIT;
+		outlineMarking.StencilPass = GL_REPLACE; // keep if stencil or depth test fails, replace if both pass
+		renderQueue.OutlineStencilBit = OUTLINE_STENCIL_BIT;
 
 		// Lamp object rendering
-		setupLampObject(lampShader, lightColor);
-		glBindVertexArray(VAO_light);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// Cube rendering
-		setupCubeObjects(lightingShader, lightColor, pl_ambientIntensity, pl_diffuseIntensity, pl_specularIntensity,
-			fl_ambientColor, fl_diffuseColor, fl_specularIntensity, dl_ambientColor, dl_diffuseColor, dl_specularIntensity);
-		// Bind metal border texture diffuse map 
-		// TODO figure out why the cube is getting wrong texture
-		glActiveTexture(GL_TEXTURE7);
-		glBindTexture(GL_TEXTURE_2D, metalBorderTexture);
-		glBindVertexArray(VAO_cube);
-		//glDrawElements(GL_TRIANGLES, 42, GL_UNSIGNED_INT, 0);
-
-		// set all fragments to NOT update the stencil buffer
-		glStencilFunc(GL_ALWAYS, 0, 0xFF);
-		// Setup and render moving cube objects
-		setupMovingCubes(cubePositions, lightingShader);
-
-		// set all fragments to update the stencil buffer
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
-		// Setup and render the loaded backpack model
-		setupModelObject(modelShader, lightColor, pl_ambientIntensity, pl_diffuseIntensity, pl_specularIntensity,
-			fl_ambientColor, fl_diffuseColor, fl_specularIntensity, dl_ambientColor, dl_diffuseColor, dl_specularIntensity);
-		backpackModel.Draw(modelShader);
-
-		if (isOutlineOn) {
-			// TODO figure out why cubes are rendered over outline 
-			// (likely need to turn off writing to stencil buffer before rendering the cubes)
-			outlineShader.use();
-			// Draw outline around objects
-			glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-			glStencilMask(0x00); // disable writing to the stencil buffer
-			glDisable(GL_DEPTH_TEST);
-			// 
-			// View/Projection transformations
-			glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-			glm::mat4 view = camera.GetViewMatrix();
-			outlineShader.setMatrix4("proj", projection);
-			outlineShader.setMatrix4("view", view);
-			//
-			// Render the outline (scaled model)
-			glm::mat4 model_outline_matrix = glm::mat4(1.0f);
-			model_outline_matrix = glm::translate(model_outline_matrix, glm::vec3(backpackPos));
-			// Scale by factor larger than before
-			model_outline_matrix = glm::scale(model_outline_matrix, glm::vec3(0.51f));
-			outlineShader.setMatrix4("model", model_outline_matrix);
-			backpackModel.Draw(outlineShader);
-		}
-
-		// Print FPS
-		float fps = 1.0f / deltaTime;
+		frameGraph.AddPass("Lamp",
+			[&](FrameGraph::Builder& builder) {
+				sceneColor = builder.Write(sceneColor);
+				sceneDepthStencil = builder.Write(sceneDepthStencil);
+				builder.SetViewport(sceneWidth, sceneHeight);
+				builder.SetState(outlineMarking);
+			},
+			[&](const FrameGraph::Resources&) {
+				setupLampObject(lampShader, lightColor);
+				submitViews(RENDER_PASS_LAMP, false);
+			});
+
+		if (!deferredShading)
+		{
+			// Depth of the cubes and/or backpack first, so their passes below only shade the visible fragments
+			bool cubesPrepass = overdrawMonitor.UsePrepass(RENDER_PASS_CUBES);
+			bool backpackPrepass = overdrawMonitor.UsePrepass(RENDER_PASS_BACKPACK);
+			if (cubesPrepass || backpackPrepass)
+			{
+				frameGraph.AddPass("DepthPrepass",
+					[&](FrameGraph::Builder& builder) {
+						sceneDepthStencil = builder.Write(sceneDepthStencil);
+						builder.SetViewport(sceneWidth, sceneHeight);
+						PassState state;
+						state.ColorWrite = false;
+						builder.SetState(state);
+					},
+					[&](const FrameGraph::Resources&) {
+						if (cubesPrepass)
+						{
+							overdrawMonitor.BeginQuery(RENDER_PASS_CUBES, true);
+							submitViews(RENDER_PASS_CUBES, true);
+							overdrawMonitor.EndQuery();
+						}
+						if (backpackPrepass)
+						{
+							overdrawMonitor.BeginQuery(RENDER_PASS_BACKPACK, true);
+							submitViews(RENDER_PASS_BACKPACK, true);
+							overdrawMonitor.EndQuery();
+						}
+					});
+			}
+			// After a pre-pass only the fragments at the nearest depth pass, and the depth is already written
+			PassState cubesState = outlineMarking, backpackState = outlineMarking;
+			if (cubesPrepass)
+			{
+				cubesState.DepthFunc = GL_EQUAL;
+				cubesState.DepthWrite = false;
+			}
+			if (backpackPrepass)
+			{
+				backpackState.DepthFunc = GL_EQUAL;
+				backpackState.DepthWrite = false;
+			}
+
+			// Cube rendering
+			frameGraph.AddPass("Cubes",
+				[&](FrameGraph::Builder& builder) {
+					for (unsigned int s = 0; s < shadowLayers.size(); s++)
+						builder.Read(shadowLayers[s]);
+					sceneColor = builder.Write(sceneColor);
+					sceneDepthStencil = builder.Write(sceneDepthStencil);
+					builder.SetViewport(sceneWidth, sceneHeight);
+					builder.SetState(cubesState);
+				},
+				[&](const FrameGraph::Resources&) {
+					Shader& cubeShader = useInstancedCubes ? instancedLightingShader : lightingShader;
+					setupLitShader(cubeShader, LIGHT_RECEIVER_CUBES, sceneWidth, sceneHeight);
+					overdrawMonitor.BeginQuery(RENDER_PASS_CUBES, false);
+					submitViews(RENDER_PASS_CUBES, false);
+					overdrawMonitor.EndQuery();
+				});
+
+			// Setup and render the loaded backpack model
+			frameGraph.AddPass("Backpack",
+				[&](FrameGraph::Builder& builder) {
+					for (unsigned int s = 0; s < shadowLayers.size(); s++)
+						builder.Read(shadowLayers[s]);
+					sceneColor = builder.Write(sceneColor);
+					sceneDepthStencil = builder.Write(sceneDepthStencil);
+					builder.SetViewport(sceneWidth, sceneHeight);
+					builder.SetState(backpackState);
+				},
+				[&](const FrameGraph::Resources&) {
+					setupLitShader(modelShader, LIGHT_RECEIVER_MODELS, sceneWidth, sceneHeight);
+					overdrawMonitor.BeginQuery(RENDER_PASS_BACKPACK, false);
+					submitViews(RENDER_PASS_BACKPACK, false);
+					overdrawMonitor.EndQuery();
+				});
+		}
+		else
+		{
+			// G-buffer: the cubes clear and fill it, the backpack is drawn on top
+			FrameGraph::Handle gAlbedoSpecular = FrameGraph::INVALID_HANDLE, gNormalReceiver = FrameGraph::INVALID_HANDLE, gDepth = FrameGraph::INVALID_HANDLE;
+			frameGraph.AddPass("GBufferCubes",
+				[&](FrameGraph::Builder& builder) {
+					// Attachment order is the shader's output locations
+					gAlbedoSpecular = builder.Create("GBufferAlbedoSpecular", { (int)frame.ViewportWidth, (int)frame.ViewportHeight, GL_RGBA8 });
+					gNormalReceiver = builder.Create("GBufferNormalReceiver", { (int)frame.ViewportWidth, (int)frame.ViewportHeight, GL_RGB10_A2 });
+					gDepth = builder.Create("GBufferDepth", { (int)frame.ViewportWidth, (int)frame.ViewportHeight, GL_R32F });
+					sceneDepthStencil = builder.Write(sceneDepthStencil);
+					builder.SetViewport(sceneWidth, sceneHeight);
+					builder.SetState(outlineMarking);
+				},
+				[&](const FrameGraph::Resources&) {
+					// Receiver group 0 (unlit) wherever nothing is drawn
+					const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+					for (int i = 0; i < 3; i++)
+						glClearBufferfv(GL_COLOR, i, zero);
+					Shader& cubeShader = useInstancedCubes ? instancedGBufferShader : gbufferShader;
+					setupGBufferShader(cubeShader, GBUFFER_RECEIVER_CUBES);
+					renderQueue.Submit(RENDER_PASS_CUBES);
+				});
+			frameGraph.AddPass("GBufferBackpack",
+				[&](FrameGraph::Builder& builder) {
+					gAlbedoSpecular = builder.Write(gAlbedoSpecular);
+					gNormalReceiver = builder.Write(gNormalReceiver);
+					gDepth = builder.Write(gDepth);
+					sceneDepthStencil = builder.Write(sceneDepthStencil);
+					builder.SetViewport(sceneWidth, sceneHeight);
+					builder.SetState(outlineMarking);
+				},
+				[&](const FrameGraph::Resources&) {
+					setupGBufferShader(modelGBufferShader, GBUFFER_RECEIVER_MODELS);
+					renderQueue.Submit(RENDER_PASS_BACKPACK);
+				});
+
+			// Directional lights over the whole screen
+			frameGraph.AddPass("DeferredAmbient",
+				[&](FrameGraph::Builder& builder) {
+					builder.Read(gAlbedoSpecular);
+					builder.Read(gNormalReceiver);
+					builder.Read(gDepth);
+					for (unsigned int s = 0; s < shadowLayers.size(); s++)
+						builder.Read(shadowLayers[s]);
+					sceneColor = builder.Write(sceneColor);
+					builder.SetViewport(sceneWidth, sceneHeight);
+					PassState state;
+					state.DepthTest = false;
+					state.DepthWrite = false;
+					state.CullFace = false;
+					builder.SetState(state);
+				},
+				[&, gAlbedoSpecular, gNormalReceiver, gDepth](const FrameGraph::Resources& resources) {
+					setupDeferredLightShader(deferredAmbientShader, frame, sceneWidth, sceneHeight);
+					shadowMap.Apply(deferredAmbientShader, SHADOW_MAP_TEXTURE_UNIT);
+					deferredAmbientShader.setInt("shadowedDirLight", -1);
+					// One directional light per receiver group
+					for (unsigned int group = 0; group < 2; group++)
+					{
+						unsigned int receivers = group == 0 ? LIGHT_RECEIVER_CUBES : LIGHT_RECEIVER_MODELS;
+						std::string name = "dirLights[" + std::to_string(group) + "]";
+						bool found = false;
+						world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+							for (unsigned int i = 0; i < count && !found; i++)
+								if (lights[i].Enabled && lights[i].Type == LIGHT_DIRECTIONAL && (lights[i].Receivers & receivers))
+								{
+									setLightUniforms(deferredAmbientShader, name, lights[i]);
+									if (lights[i].CastsShadows && shadowMap.Enabled)
+										deferredAmbientShader.setInt("shadowedDirLight", group);
+									found = true;
+								}
+						});
+						if (!found)
+						{
+							LightComponent off;
+							off.Type = LIGHT_DIRECTIONAL;
+							off.Color = glm::vec3(0.0f);
+							off.SpecularIntensity = glm::vec3(0.0f);
+							setLightUniforms(deferredAmbientShader, name, off);
+						}
+					}
+					GLuint textures[3] = { resources.GetTexture(gAlbedoSpecular), resources.GetTexture(gNormalReceiver), resources.GetTexture(gDepth) };
+					for (int i = 0; i < 3; i++)
+					{
+						glActiveTexture(GL_TEXTURE0 + i);
+						glBindTexture(GL_TEXTURE_2D, textures[i]);
+					}
+					glActiveTexture(GL_TEXTURE0);
+					glBindVertexArray(VAO_fullscreen);
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+					glBindVertexArray(0);
+				});
+
+			// Point lights and the flashlight, in batches small enough that the stencil count can't wrap. Each batch
+			// counts, per pixel, the volumes with the surface inside them (z-fail: back faces behind the surface
+			// add one, front faces behind it take one away), then shades the volumes' back faces where the count
+			// isn't zero, so pixels in front of or behind every volume are skipped.
+			auto addLightVolumePasses = [&](const std::string& suffix, unsigned int first, unsigned int count, bool spot) {
+				frameGraph.AddPass("LightStencil" + suffix,
+					[&](FrameGraph::Builder& builder) {
+						sceneDepthStencil = builder.Write(sceneDepthStencil);
+						builder.SetViewport(sceneWidth, sceneHeight);
+						PassState state;
+						state.DepthWrite = false;
+						state.CullFace = false;
+						state.ColorWrite = false;
+						state.StencilTest = true;
+						state.StencilWriteMask = LIGHT_VOLUME_STENCIL_MASK;
+						state.StencilTwoSided = true;
+						state.StencilDepthFail = GL_DECR_WRAP;
+						state.StencilBackDepthFail = GL_INCR_WRAP;
+						builder.SetState(state);
+					},
+					[&, first, count, spot](const FrameGraph::Resources&) {
+						// Reset the count from the previous batch (glClear respects the stencil write mask)
+						glClear(GL_STENCIL_BUFFER_BIT);
+						setupDeferredLightShader(deferredLightShader, frame, sceneWidth, sceneHeight);
+						deferredLightShader.setInt("firstLight", first);
+						deferredLightShader.setBool("spotVolume", spot);
+						const LightVolumeMesh& volume = spot ? coneVolume : sphereVolume;
+						glBindVertexArray(volume.VAO);
+						glDrawElementsInstanced(GL_TRIANGLES, volume.Count, GL_UNSIGNED_INT, 0, count);
+						glBindVertexArray(0);
+					});
+				frameGraph.AddPass((spot ? "SpotLight" : "PointLights") + suffix,
+					[&](FrameGraph::Builder& builder) {
+						builder.Read(gAlbedoSpecular);
+						builder.Read(gNormalReceiver);
+						builder.Read(gDepth);
+						for (unsigned int s = 0; s < shadowLayers.size(); s++)
+							builder.Read(shadowLayers[s]);
+						sceneColor = builder.Write(sceneColor);
+						sceneDepthStencil = builder.Write(sceneDepthStencil);
+						builder.SetViewport(sceneWidth, sceneHeight);
+						PassState state;
+						state.DepthTest = false;
+						state.DepthWrite = false;
+						state.CullMode = GL_FRONT; // back faces are still there with the camera inside the volume
+						state.StencilTest = true;
+						state.StencilFunc = GL_NOTEQUAL;
+						state.StencilRef = 0;
+						state.StencilReadMask = LIGHT_VOLUME_STENCIL_MASK;
+						state.Blend = true;
+						state.BlendSource = GL_ONE;
+						state.BlendDestination = GL_ONE;
+						builder.SetState(state);
+					},
+					[&, first, count, spot, gAlbedoSpecular, gNormalReceiver, gDepth](const FrameGraph::Resources& resources) {
+						setupDeferredLightShader(deferredLightShader, frame, sceneWidth, sceneHeight);
+						deferredLightShader.setInt("firstLight", first);
+						deferredLightShader.setBool("spotVolume", spot);
+						GLuint textures[3] = { resources.GetTexture(gAlbedoSpecular), resources.GetTexture(gNormalReceiver), resources.GetTexture(gDepth) };
+						for (int i = 0; i < 3; i++)
+						{
+							glActiveTexture(GL_TEXTURE0 + i);
+							glBindTexture(GL_TEXTURE_2D, textures[i]);
+						}
+						glActiveTexture(GL_TEXTURE0);
+						const LightVolumeMesh& volume = spot ? coneVolume : sphereVolume;
+						glBindVertexArray(volume.VAO);
+						glDrawElementsInstanced(GL_TRIANGLES, volume.Count, GL_UNSIGNED_INT, 0, count);
+						glBindVertexArray(0);
+					});
+			};
+			for (unsigned int first = 0; first < volumePointLights.Count(); first += LIGHT_VOLUME_BATCH_SIZE)
+				addLightVolumePasses(" " + std::to_string(first / LIGHT_VOLUME_BATCH_SIZE), first,
+					std::min(LIGHT_VOLUME_BATCH_SIZE, volumePointLights.Count() - first), false);
+			if (flashlightEnabled())
+				addLightVolumePasses("", 0, 1, true);
+		}
+
+		if (showOutlines) {
+			// Outline mask: 1 where the outline stencil bit is set
+			FrameGraph::Handle outlineMask = FrameGraph::INVALID_HANDLE, outlineDistanceX = FrameGraph::INVALID_HANDLE;
+			frameGraph.AddPass("OutlineMask",
+				[&](FrameGraph::Builder& builder) {
+					outlineMask = builder.Create("OutlineMask", { (int)frame.ViewportWidth, (int)frame.ViewportHeight, GL_R8 });
+					sceneDepthStencil = builder.Write(sceneDepthStencil); // attached for the stencil test only
+					builder.SetViewport(sceneWidth, sceneHeight);
+					PassState state;
+					state.DepthTest = false;
+					state.DepthWrite = false;
+					state.CullFace = false;
+					state.StencilTest = true;
+					state.StencilFunc = GL_EQUAL;
+					state.StencilRef = OUTLINE_STENCIL_BIT;
+					state.StencilReadMask = OUTLINE_STENCIL_BIT;
+					builder.SetState(state);
+				},
+				[&](const FrameGraph::Resources&) {
+					const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+					glClearBufferfv(GL_COLOR, 0, zero);
+					outlineMaskShader.use();
+					glBindVertexArray(VAO_fullscreen);
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+					glBindVertexArray(0);
+				});
+
+			// Grow the mask by the outline width: distance to it along rows, then down columns while drawing
+			frameGraph.AddPass("OutlineDistance",
+				[&](FrameGraph::Builder& builder) {
+					builder.Read(outlineMask);
+					outlineDistanceX = builder.Create("OutlineDistanceX", { (int)frame.ViewportWidth, (int)frame.ViewportHeight, GL_R8 });
+					builder.SetViewport(sceneWidth, sceneHeight);
+					PassState state;
+					state.DepthTest = false;
+					state.DepthWrite = false;
+					state.CullFace = false;
+					builder.SetState(state);
+				},
+				[&, outlineMask](const FrameGraph::Resources& resources) {
+					outlineDistanceShader.use();
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_2D, resources.GetTexture(outlineMask));
+					outlineDistanceShader.setInt("outlineMask", 0);
+					outlineDistanceShader.setInt("outlineWidth", outlineWidth);
+					glUniform2i(glGetUniformLocation(outlineDistanceShader.ID, "viewportSize"), sceneWidth, sceneHeight);
+					glBindVertexArray(VAO_fullscreen);
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+					glBindVertexArray(0);
+				});
+			frameGraph.AddPass("Outline",
+				[&](FrameGraph::Builder& builder) {
+					builder.Read(outlineMask);
+					builder.Read(outlineDistanceX);
+					sceneColor = builder.Write(sceneColor);
+					builder.SetViewport(sceneWidth, sceneHeight);
+					PassState state;
+					state.DepthTest = false;
+					state.DepthWrite = false;
+					state.CullFace = false;
+					state.Blend = true;
+					state.BlendSource = GL_SRC_ALPHA;
+					state.BlendDestination = GL_ONE_MINUS_SRC_ALPHA;
+					builder.SetState(state);
+				},
+				[&, outlineMask, outlineDistanceX](const FrameGraph::Resources& resources) {
+					outlineShader.use();
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_2D, resources.GetTexture(outlineMask));
+					glActiveTexture(GL_TEXTURE1);
+					glBindTexture(GL_TEXTURE_2D, resources.GetTexture(outlineDistanceX));
+					glActiveTexture(GL_TEXTURE0);
+					outlineShader.setInt("outlineMask", 0);
+					outlineShader.setInt("outlineDistanceX", 1);
+					outlineShader.setInt("outlineWidth", outlineWidth);
+					glUniform2i(glGetUniformLocation(outlineShader.ID, "viewportSize"), sceneWidth, sceneHeight);
+					outlineShader.setVec3("outlineColor", OUTLINE_COLOR);
+					glBindVertexArray(VAO_fullscreen);
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+					glBindVertexArray(0);
+				});
+		}
+
+		if (offscreenScene) {
+			// Stretch the scaled scene over the backbuffer, sharpening to make up for the lost detail
+			frameGraph.AddPass("Upscale",
+				[&](FrameGraph::Builder& builder) {
+					builder.Read(sceneColor);
+					backbufferColor = builder.Write(backbufferColor);
+					PassState state;
+					state.DepthTest = false;
+					state.DepthWrite = false;
+					state.CullFace = false;
+					builder.SetState(state);
+				},
+				[&](const FrameGraph::Resources& resources) {
+					const FrameGraphTextureDesc& desc = resources.GetDesc(sceneColor);
+					upscaleShader.use();
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_2D, resources.GetTexture(sceneColor));
+					upscaleShader.setInt("sceneTexture", 0);
+					upscaleShader.setVec2("uvScale", glm::vec2((float)sceneWidth / desc.Width, (float)sceneHeight / desc.Height));
+					upscaleShader.setVec2("texelSize", glm::vec2(1.0f / desc.Width, 1.0f / desc.Height));
+					upscaleShader.setFloat("sharpness", renderScale < 1.0f ? UPSCALE_SHARPNESS : 0.0f);
+					glBindVertexArray(VAO_fullscreen);
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+					glBindVertexArray(0);
+				});
+		}
+
+		frameGraph.Compile();
+		frameGraph.Execute();
+		streamBuffer.EndFrame();
+		frameStats.AddSample("stream_fence_wait_ms", streamBuffer.FenceWaitMilliseconds);
+		frameStats.AddSample("stream_bytes", (double)streamBuffer.BytesAllocated);
+		frameStats.AddSample("stream_failed_allocations", (double)streamBuffer.FailedAllocations);
+		if (views.MultipleViews())
+		{
+			// Cost of each view on top of the culling and draw recording they share (both eyes together with
+			// single-pass stereo)
+			for (unsigned int v = 0; v < views.Submissions(); v++)
+			{
+				frameStats.AddSample("submit_ms " + views.SubmissionName(v), views.Views[v].SubmitMilliseconds);
+				frameStats.AddSample("draws " + views.SubmissionName(v), (double)views.Views[v].Draws);
+			}
+		}
+		gpuProfiler().EndFrame();
+		overdrawMonitor.EndFrame();
+		frameStats.Mark(FRAME_PHASE_SUBMISSION, getTime());
+
+		if (isReplaying || dynamicResolution)
+		{
+			// Every earlier frame the GPU has finished since the last read
+			gpuTimer.EndFrame();
+			double gpuMilliseconds;
+			while (gpuTimer.ReadResult(gpuMilliseconds))
+			{
+				lastGpuMilliseconds = gpuMilliseconds;
+				if (isReplaying)
+					benchmark.AddGpuTime(gpuMilliseconds);
+			}
+		}
+
+		// Swap frame buffers (avoids flickering). Headless there is nothing to present, so wait for the frame
+		// to finish instead, keeping frame times comparable.
+		{
+			PROFILE_ZONE("Swap");
+			if (isHeadless)
+				glFinish();
+			else
+				glfwSwapBuffers(window);
+		}
+		renderedFrames++;
+		frameStats.Mark(FRAME_PHASE_SWAP, getTime());
+		frameStats.EndFrame(getTime());
+
+		// Pick next frame's resolution from the busy time of this frame (waiting on the swap doesn't count)
+		if (dynamicResolution)
+		{
+			const FrameStats::FrameRecord& record = frameStats.At(frameStats.Size() - 1);
+			double cpuMilliseconds = record.Total - record.Phases[FRAME_PHASE_SWAP];
+			if (governor.Update(std::max(cpuMilliseconds, lastGpuMilliseconds)))
+			{
+				const QualityKnobs& knobs = governor.Knobs();
+				// Re-allocated at the new size, and re-rendered next frame
+				shadowMap.SetResolution(std::max(64, (int)(fullShadowResolution * knobs.ShadowResolutionScale)));
+				pointShadowMap.SetMaxResolution((int)(fullPointShadowResolution * knobs.ShadowResolutionScale));
+				printf("Quality level %u (texture LOD bias %f, %u lights, shadow maps %d, point shadows up to %d)\n", governor.Level(),
+					knobs.LodBias, knobs.MaxLights, shadowMap.Resolution, pointShadowMap.MaxResolution);
+			}
+			frameStats.AddSample("render_scale", governor.RenderScale());
+		}
+
+		// Print rolling frame statistics
 		if (timeSinceLastPrintf > 1.0) {
-			printf("%f seconds per frame\n", deltaTime);
-			printf("%f fps =  1 / secs per frame \n\n", fps);
+			frameStats.Print();
+			printf("%u objects visible, %u culled\n", cullingBatch.NumVisible, cullingBatch.NumCulled);
+			if (occlusionCulling)
+				printf("%u objects occluded by %u occluders (%u triangles)\n", occlusionCuller.NumOccluded, occlusionCuller.NumOccluders, occlusionCuller.NumTriangles);
+			printf("%u entities updated in %f ms\n", world.Count<TransformComponent>(), updateMilliseconds);
+			if (views.MultipleViews())
+			{
+				printf("%u views culled together, %u objects visible in at least one\n", views.Count(), cullingBatch.NumVisible);
+				for (unsigned int v = 0; v < views.Submissions(); v++)
+					printf("  %s: %u draws submitted in %f ms\n", views.SubmissionName(v).c_str(), views.Views[v].Draws, views.Views[v].SubmitMilliseconds);
+			}
+			printf("%lld bytes streamed, %u frames waited on the stream buffer (%f ms in total)\n", (long long)streamBuffer.BytesAllocated,
+				streamBuffer.FramesWaited, streamBuffer.TotalFenceWaitMilliseconds);
+			if (dynamicResolution)
+				printf("render scale %f, quality level %u\n", governor.RenderScale(), governor.Level());
+			if (!deferredShading && useLightClusters)
+				printf("%u cube and %u model light cluster entries, at most %u lights per cluster\n", cubeLightClusters.NumIndices, modelLightClusters.NumIndices,
+					std::max(cubeLightClusters.MaxLightsPerCluster, modelLightClusters.MaxLightsPerCluster));
+			for (unsigned int pass = 0; pass < overdrawMonitor.NumPasses(); pass++)
+			{
+				if (!overdrawMonitor.HasPass(pass) || !overdrawMonitor.Result(pass).Measured)
+					continue;
+				const OverdrawMonitor::PassResult& result = overdrawMonitor.Result(pass);
+				if (result.Prepass)
+					printf("%s: %llu fragments shaded with the depth pre-pass, %llu without (overdraw %f)\n", overdrawMonitor.Name(pass).c_str(),
+						(unsigned long long)result.ShadedFragments, (unsigned long long)result.PrepassFragments, overdrawMonitor.Overdraw(pass));
+				else
+					printf("%s: %llu fragments shaded without a depth pre-pass\n", overdrawMonitor.Name(pass).c_str(), (unsigned long long)result.ShadedFragments);
+			}
+			printf("\n");
 			timeSinceLastPrintf = 0.0f;
 		}
 
-		// Check events and swap frame buffers (avoids flickering)
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		if (isReplaying)
+		{
+			benchmark.AddFrame((getTime() - frameStartTime) * 1000.0, renderStats().DrawCalls, renderStats().Triangles);
+			if (++replayFrame >= replayFrameCount && !isHeadless)
+				glfwSetWindowShouldClose(window, true);
+		}
+	}
+
+	// Write out the recorded path / benchmark report / frame stats
+	if (exportStatsAtExit || isHeadless)
+		frameStats.Export(statsPath);
+	if (isRecording)
+		cameraPath.Save(recordPath);
+	if (isReplaying)
+	{
+		// The frames still in flight, so every timed frame is in the report
+		double gpuMilliseconds;
+		while (gpuTimer.ReadResult(gpuMilliseconds, true))
+			benchmark.AddGpuTime(gpuMilliseconds);
+		if (gpuTimer.UntimedFrames > 0)
+			std::cout << gpuTimer.UntimedFrames << " frames not GPU timed, the GPU was " << GpuFrameTimer::MAX_QUERIES << " frames behind" << std::endl;
+		benchmark.SetUntimedGpuFrames(gpuTimer.UntimedFrames);
+		benchmark.WriteReport(reportPath, replayPath);
+	}
+	if (isReplaying || dynamicResolution)
+		gpuTimer.Release();
+	frameGraph.Release();
+	gpuProfiler().Release();
+	overdrawMonitor.Release();
+	sphereVolume.Release();
+	coneVolume.Release();
+	cubePointLights.Release();
+	modelPointLights.Release();
+	volumePointLights.Release();
+	cubeLightClusters.Release();
+	modelLightClusters.Release();
+	shadowMap.Release();
+	pointShadowMap.Release();
+	streamBuffer.Release();
+	PROFILE_STOP();
+	if (isHeadless)
+	{
+		double elapsedSeconds = getTime() - firstFrameTime;
+		printf("Rendered %u frames headless in %f seconds (%f ms per frame)\n", renderedFrames, elapsedSeconds,
+			renderedFrames > 0 ? elapsedSeconds * 1000.0 / renderedFrames : 0.0);
+		if (!headlessOutputPath.empty() && headlessContext.SaveImage(headlessOutputPath))
+			std::cout << "Saved last frame to " << headlessOutputPath << std::endl;
 	}
 
 	// Print max number of attribute pointers supported on system
@@ -582,174 +1991,781 @@ int main() {
 	// Release GLFW resources before exiting
 	glDeleteVertexArrays(1, &VAO_cube);
 	glDeleteVertexArrays(1, &VAO_light);
+	glDeleteVertexArrays(1, &VAO_fullscreen);
+	glDeleteVertexArrays(1, &VAO_cubeInstanced);
+	glDeleteBuffers(1, &VBO_cubeInstances);
 	glDeleteBuffers(1, &VBO_vertices);
 	glDeleteBuffers(1, &VBO_colours);
 	glDeleteBuffers(1, &VBO_containerTexCoords);
 	glDeleteBuffers(1, &VBO_faceTexCoords);
 	glDeleteBuffers(1, &VBO_metalBorderTexCoords);
 	glDeleteBuffers(1, &EBO);
-	glfwTerminate();
+	if (isHeadless)
+		headlessContext.Destroy();
+	else
+		glfwTerminate();
 	return 0;
 }
 
-void setupMovingCubes(glm::vec3 (&cubePositions)[12], Shader lightingShader)
+// Moves the animated entities for this frame, over the packed transform and animation arrays of every archetype with both
+void animationSystem(const FrameContext& frame, JobSystem& jobSystem)
 {
-	for (unsigned int i = 0; i < sizeof(cubePositions) / sizeof(glm::vec3); i++)
+	PROFILE_ZONE("animationSystem");
+	float animation = (float)(sin(frame.Time) / 2.0f + 0.5f);
+	glm::vec3 orbit((float)(sin(frame.Time) * 3.0f), (float)(cos(frame.Time) * 3.0f), 1.0f);
+	world.Each<TransformComponent, AnimationComponent>([&](unsigned int count, TransformComponent* transforms, AnimationComponent* animations) {
+		jobSystem.ParallelFor(count, ENTITY_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int /*threadIndex*/) {
+			for (unsigned int i = begin; i < end; i++)
+			{
+				const AnimationComponent& entityAnimation = animations[i];
+				TransformComponent& transform = transforms[i];
+				glm::vec3 position = entityAnimation.BasePosition;
+				float angle = 0.0f;
+				if (entityAnimation.Enabled)
+				{
+					if (entityAnimation.Type == ANIMATION_CUBE_TWIST)
+					{
+						position *= animation;
+						angle = entityAnimation.Speed * animation;
+					}
+					else
+						position *= orbit;
+				}
+				// Only mark the transform changed (and touch the scene graph) when the entity actually moved
+				if (position != transform.Position || angle != transform.RotationAngle)
+				{
+					transform.Position = position;
+					transform.RotationAngle = angle;
+					transform.Changed = true;
+				}
+			}
+		});
+	});
+}
+
+// Writes changed transforms to the entities' scene graph nodes
+void transformSystem(JobSystem& jobSystem)
+{
+	PROFILE_ZONE("transformSystem");
+	world.Each<TransformComponent>([&](unsigned int count, TransformComponent* transforms) {
+		jobSystem.ParallelFor(count, ENTITY_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int /*threadIndex*/) {
+			for (unsigned int i = begin; i < end; i++)
+			{
+				TransformComponent& transform = transforms[i];
+				if (!transform.Changed)
+					continue;
+				if (transform.SceneNode != SceneGraph::NO_PARENT)
+					sceneGraph.SetLocalTransform(transform.SceneNode, transform.LocalMatrix());
+				transform.Changed = false;
+			}
+		});
+	});
+}
+
+// World space bounds for frustum culling, from the updated scene graph
+void boundsSystem(JobSystem& jobSystem)
+{
+	PROFILE_ZONE("boundsSystem");
+	world.Each<TransformComponent, BoundsComponent>([&](unsigned int count, TransformComponent* transforms, BoundsComponent* bounds) {
+		jobSystem.ParallelFor(count, OBJECT_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int /*threadIndex*/) {
+			for (unsigned int i = begin; i < end; i++)
+				if (transforms[i].SceneNode != SceneGraph::NO_PARENT)
+				{
+					bounds[i].PreviousWorld = bounds[i].World;
+					bounds[i].World = bounds[i].Local.Transform(sceneGraph.GetWorldTransform(transforms[i].SceneNode));
+				}
+		});
+	});
+}
+
+// Light colours and positions for this frame
+void lightSystem(const FrameContext& frame)
+{
+	PROFILE_ZONE("lightSystem");
+	glm::vec3 cycleColor = lampColor(frame.Time);
+	world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (lights[i].CycleColor)
+				lights[i].Color = cycleColor;
+			if (lights[i].FollowCamera)
+			{
+				lights[i].Position = frame.CameraPosition;
+				lights[i].Direction = frame.CameraFront;
+			}
+		}
+	});
+	// Lights on an entity in the scene sit at its world position
+	world.Each<TransformComponent, LightComponent>([&](unsigned int count, TransformComponent* transforms, LightComponent* lights) {
+		for (unsigned int i = 0; i < count; i++)
+			if (transforms[i].SceneNode != SceneGraph::NO_PARENT)
+				lights[i].Position = glm::vec3(sceneGraph.GetWorldTransform(transforms[i].SceneNode)[3]);
+	});
+}
+
+// Packs the enabled point lights into the light buffers: per receiver group for forward shading, all of them
+// for the light volumes of deferred shading. The quality governor's light limit is taken out of the point
+// lights only: each group's directional light and the flashlight are counted first, and the point lights past
+// what is left are dropped in storage order. Deferred shading shares one buffer between the groups, so it keeps
+// to the smaller of their budgets. Forward shading then bins each buffer's lights into clusters, in parallel.
+void lightBufferSystem(const FrameContext& frame, JobSystem& jobSystem)
+{
+	PROFILE_ZONE("lightBufferSystem");
+	const QualityKnobs& knobs = governor.Knobs();
+	unsigned int maxCubeLights = knobs.PointLightBudget(countNonPointLights(LIGHT_RECEIVER_CUBES));
+	unsigned int maxModelLights = knobs.PointLightBudget(countNonPointLights(LIGHT_RECEIVER_MODELS));
+	unsigned int maxVolumeLights = std::min(maxCubeLights, maxModelLights);
+	cubePointLights.Clear();
+	modelPointLights.Clear();
+	volumePointLights.Clear();
+	world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const LightComponent& light = lights[i];
+			if (!light.Enabled || light.Type != LIGHT_POINT)
+				continue;
+			if (deferredShading)
+			{
+				if (volumePointLights.Count() < maxVolumeLights)
+					volumePointLights.Add(light);
+				continue;
+			}
+			if ((light.Receivers & LIGHT_RECEIVER_CUBES) && cubePointLights.Count() < maxCubeLights)
+				cubePointLights.Add(light);
+			if ((light.Receivers & LIGHT_RECEIVER_MODELS) && modelPointLights.Count() < maxModelLights)
+				modelPointLights.Add(light);
+		}
+	});
+	if (deferredShading)
+		volumePointLights.Upload();
+	else
 	{
-		// Model: Render copies of cube with differing model matrices
-		glm::mat4 model_matrix(1.0f);
-		model_matrix = glm::translate(model_matrix, glm::vec3(0.0f, 0.0f, -0.5f));
-		glm::vec3 movingCubePos = (glm::vec3)cubePositions[i] * (float)(sin(glfwGetTime()) / 2.0f + 0.5f);
-		model_matrix = glm::translate(model_matrix, movingCubePos);
-		float twistSpeed = i / 2.0f + 7.0f;
-		model_matrix = glm::rotate(model_matrix, twistSpeed * (float)(sin(glfwGetTime()) / 2.0f + 0.5f), glm::vec3(0.1f, 0.1f, 0.15f));
-		// View: Translate scene in reverse direction from camera
-		glm::mat4 view_matrix = camera.GetViewMatrix();
-		// Proj: Zoom/Field of View (FOV), set aspect ratio, front and back clipping of view frustum 
-		glm::mat4 projection_matrix(1.0f);
-		projection_matrix = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-		// Set uniforms in shader program
-		lightingShader.setMatrix4("model", model_matrix);
-		lightingShader.setMatrix4("view", view_matrix);
-		lightingShader.setMatrix4("proj", projection_matrix);
-		// Draw each cube
-		glDrawElements(GL_TRIANGLES, 42, GL_UNSIGNED_INT, 0);
+		cubePointLights.Upload();
+		modelPointLights.Upload();
+		if (useLightClusters)
+		{
+			cubeLightClusters.Build(cubePointLights, frame.View, frame.Projection, jobSystem);
+			cubeLightClusters.Upload();
+			modelLightClusters.Build(modelPointLights, frame.View, frame.Projection, jobSystem);
+			modelLightClusters.Upload();
+		}
 	}
 }
 
-void setupCubeObjects(Shader lightingShader, glm::vec3 lightColor, glm::vec3 pl_ambientColor, glm::vec3 pl_diffuseColor, glm::vec3 pl_specularIntensity, glm::vec3 fl_ambientColor, glm::vec3 fl_diffuseColor, glm::vec3 fl_specularIntensity, glm::vec3 dl_ambientColor, glm::vec3 dl_diffuseColor, glm::vec3 dl_specularIntensity)
+// Adds the bounds of every enabled renderable to the culling batch (models per mesh) and culls them against
+// the view frustum, then with occlusion culling against the occluders of the entities left in view
+void cullingSystem(const FrameContext& frame, JobSystem& jobSystem)
 {
-	lightingShader.use();
-	// Set uniforms in shader program
-	// Model matrix for world-centered cube
-	glm::mat4 model_matrix = glm::mat4(1.0f);
-	model_matrix = glm::mat4(1.0f);
-	lightingShader.setMatrix4("model", model_matrix);
-	// Use same view and proj matrices as for lamp in setupLampObject()
-	lightingShader.setMatrix4("view", camera.GetViewMatrix());
-	glm::mat4 projection_matrix(1.0f);
-	projection_matrix = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-	lightingShader.setMatrix4("proj", projection_matrix);
-	lightingShader.setVec3("viewPos", camera.Position.x, camera.Position.y, camera.Position.z);
-	// Set material struct properties
-	lightingShader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-	lightingShader.setFloat("material.shininess", 16.0f);
-	//
-	// Point light properties
-	lightingShader.setVec3("pointLights[0].ambient", pl_ambientColor);
-	lightingShader.setVec3("pointLights[0].diffuse", pl_diffuseColor);
-	lightingShader.setVec3("pointLights[0].specular", pl_specularIntensity);
-	// Point light attenuation properties
-	lightingShader.setFloat("pointLights[0].constant", 1.0f);
-	lightingShader.setFloat("pointLights[0].linear", 0.09f);
-	lightingShader.setFloat("pointLights[0].quadratic", 0.032f);
-	// Point light position
-	lightingShader.setVec3("pointLights[0].position", movingLightPos);
-	//
-	// Flashlight properties
-	lightingShader.setBool("flashlight.on", isFlashlightOn);
-	lightingShader.setVec3("flashlight.ambient", fl_ambientColor);
-	lightingShader.setVec3("flashlight.diffuse", fl_diffuseColor);
-	lightingShader.setVec3("flashlight.specular", fl_specularIntensity);
-	// Flashlight attenuation properties
-	lightingShader.setFloat("flashlight.constant", 1.0f);
-	lightingShader.setFloat("flashlight.linear", 0.09f);
-	lightingShader.setFloat("flashlight.quadratic", 0.032f);
-	// Flashlight position and direction
-	lightingShader.setVec3("flashlight.position", camera.Position);
-	lightingShader.setVec3("flashlight.direction", camera.Front);
-	// Flashlight cutOff angle
-	lightingShader.setFloat("flashlight.cutOff", glm::cos(glm::radians(5.0f)));
-	lightingShader.setFloat("flashlight.outerCutOff", glm::cos(glm::radians(20.0f)));
-	//
-	// Directional light properties
-	lightingShader.setVec3("dirLights[0].ambient", dl_ambientColor);
-	lightingShader.setVec3("dirLights[0].diffuse", dl_diffuseColor);
-	lightingShader.setVec3("dirLights[0].specular", dl_specularIntensity);
-	// Directional light direction
-	lightingShader.setVec3("dirLights[0].direction", glm::vec3(-1.0f, -1.0f, 0.0f));
+	PROFILE_ZONE("cullingSystem");
+	cullingBatch.Clear();
+	world.Each<RenderableComponent, BoundsComponent>([&](unsigned int count, RenderableComponent* renderables, BoundsComponent* bounds) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			RenderableComponent& renderable = renderables[i];
+			if (!renderable.Enabled)
+				continue;
+			if (renderable.Kind == RENDERABLE_MODEL)
+				renderable.CullIndex = renderable.SourceModel->AddToCullingBatch(cullingBatch, sceneGraph, renderable.ModelNode);
+			else
+				renderable.CullIndex = cullingBatch.Add(bounds[i].World);
+		}
+	});
+	// Several views are culled together, each draw keeping the views it is visible in
+	if (views.MultipleViews())
+		views.Cull(cullingBatch, minCullPixelSize);
+	else
+		cullingBatch.Cull(frame.ViewFrustum, frame.CameraPosition, frame.Projection[1][1], (float)frame.ViewportHeight, minCullPixelSize);
+	if (!occlusionCulling)
+		return;
+
+	occlusionCuller.Begin(frame.ViewProjection, frame.CameraPosition);
+	world.Each<TransformComponent, RenderableComponent, OccluderComponent>([&](unsigned int count, TransformComponent* transforms,
+		RenderableComponent* renderables, OccluderComponent* occluders) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			// Models are culled per mesh, so only single meshes can be skipped when out of view
+			const RenderableComponent& renderable = renderables[i];
+			if (renderable.Enabled && (renderable.Kind == RENDERABLE_MODEL || cullingBatch.IsVisible(renderable.CullIndex)))
+				occlusionCuller.AddOccluder(occluders[i].Box, sceneGraph.GetWorldTransform(transforms[i].SceneNode));
+		}
+	});
+	occlusionCuller.Rasterize(jobSystem);
+	occlusionCuller.Cull(cullingBatch, jobSystem);
 }
 
-void setupLampObject(Shader lampShader, glm::vec3 lightColor)
+// Queues draws of the visible renderables. Single draws are recorded by each thread into its own command list,
+// models (one draw per visible mesh) are queued from this thread.
+void renderSystem(JobSystem& jobSystem)
 {
-	lampShader.use();
-	// Model matrix: Translate and scale the light object
-	glm::mat4 model_matrix = glm::mat4(1.0f);
-	movingLightPos = pointLightPos;
-	if (isMovingLight) {
-		movingLightPos.x *= (float)(sin(glfwGetTime()) * 3.0f);
-		movingLightPos.y *= (float)(cos(glfwGetTime()) * 3.0f);
+	PROFILE_ZONE("renderSystem");
+	world.Each<TransformComponent, RenderableComponent>([&](unsigned int count, TransformComponent* transforms, RenderableComponent* renderables) {
+		jobSystem.ParallelFor(count, OBJECT_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int threadIndex) {
+			RenderCommandList& commandList = renderQueue.CommandList(threadIndex);
+			for (unsigned int i = begin; i < end; i++)
+			{
+				const RenderableComponent& renderable = renderables[i];
+				if (renderable.Kind != RENDERABLE_MESH || !renderable.Enabled || !cullingBatch.IsVisible(renderable.CullIndex))
+					continue;
+				const glm::mat4& model_matrix = sceneGraph.GetWorldTransform(transforms[i].SceneNode);
+				// Normal matrix precomputed once per object
+				glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(model_matrix)));
+				DrawCommand draw = { renderable.Program, renderable.VAO, renderable.Material, GL_TRIANGLES, renderable.Count, renderable.Indexed,
+					model_matrix, normal_matrix, renderable.Instances, renderable.Outlined };
+				draw.ViewMask = cullingBatch.ViewMask(renderable.CullIndex);
+				commandList.Enqueue(renderable.Pass, draw, glm::vec3(model_matrix[3]));
+			}
+		});
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const RenderableComponent& renderable = renderables[i];
+			if (renderable.Kind == RENDERABLE_MODEL && renderable.Enabled)
+				renderable.SourceModel->Enqueue(renderQueue, renderable.Pass, renderable.Program, sceneGraph, renderable.ModelNode, cullingBatch, renderable.CullIndex,
+					renderable.Outlined);
+		}
+	});
+}
+
+// Fits the shadow cascades to the camera, works out which ones are re-rendered this frame, and queues their
+// casters culled against each cascade's volume. Static casters are only queued for cascades whose cached
+// static layer is redrawn.
+void shadowSystem(const FrameContext& frame)
+{
+	PROFILE_ZONE("shadowSystem");
+	shadowMap.Enabled = false;
+	if (!shadowMap.Initialized())
+		return;
+	glm::vec3 lightDirection;
+	world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+		for (unsigned int i = 0; i < count && !shadowMap.Enabled; i++)
+			if (lights[i].Enabled && lights[i].Type == LIGHT_DIRECTIONAL && lights[i].CastsShadows)
+			{
+				lightDirection = lights[i].Direction;
+				shadowMap.Enabled = true;
+			}
+	});
+	if (!shadowMap.Enabled)
+		return;
+
+	AABB casterBounds;
+	world.Each<RenderableComponent, BoundsComponent>([&](unsigned int count, RenderableComponent* renderables, BoundsComponent* bounds) {
+		for (unsigned int i = 0; i < count; i++)
+			if (renderables[i].Enabled && renderables[i].ShadowCaster != SHADOW_CASTER_NONE)
+				casterBounds.Expand(bounds[i].World);
+	});
+	shadowMap.Update(frame, lightDirection, casterBounds);
+
+	// Dynamic casters that moved re-render the cascades they were in or are in now
+	world.Each<RenderableComponent, BoundsComponent>([&](unsigned int count, RenderableComponent* renderables, BoundsComponent* bounds) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const RenderableComponent& renderable = renderables[i];
+			if (!renderable.Enabled)
+				continue;
+			if (renderable.ShadowCaster == SHADOW_CASTER_ANIMATED)
+				shadowMap.MarkMoved(bounds[i].World);
+			else if (renderable.ShadowCaster == SHADOW_CASTER_DYNAMIC && (bounds[i].World.Min != bounds[i].PreviousWorld.Min
+				|| bounds[i].World.Max != bounds[i].PreviousWorld.Max))
+			{
+				AABB swept = bounds[i].World;
+				swept.Expand(bounds[i].PreviousWorld);
+				shadowMap.MarkMoved(swept);
+			}
+		}
+	});
+
+	std::vector<unsigned int> cullIndices;
+	RenderCommandList& commandList = renderQueue.CommandList(0);
+	for (unsigned int c = 0; c < shadowMap.NumCascades; c++)
+	{
+		CascadedShadowMap::Cascade& cascade = shadowMap.GetCascade(c);
+		cascade.StaticDraws = cascade.DynamicDraws = 0;
+		if (!cascade.Dirty)
+			continue;
+		// Cached static casters are only needed when the static layer is redrawn
+		bool drawStatic = !shadowMap.Caching || cascade.StaticDirty;
+		CullingBatch& batch = shadowCullingBatches[c];
+		batch.Clear();
+		cullIndices.clear();
+		// Same iteration twice: add the casters' bounds, cull, then queue the visible ones
+		world.Each<TransformComponent, RenderableComponent, BoundsComponent>([&](unsigned int count, TransformComponent*, RenderableComponent* renderables,
+			BoundsComponent* bounds) {
+			for (unsigned int i = 0; i < count; i++)
+			{
+				const RenderableComponent& renderable = renderables[i];
+				if (!renderable.Enabled || renderable.ShadowCaster == SHADOW_CASTER_NONE || (renderable.ShadowCaster == SHADOW_CASTER_STATIC && !drawStatic))
+					continue;
+				if (renderable.Kind == RENDERABLE_MODEL)
+					cullIndices.push_back(renderable.SourceModel->AddToCullingBatch(batch, sceneGraph, renderable.ModelNode));
+				else
+					cullIndices.push_back(batch.Add(bounds[i].World));
+			}
+		});
+		batch.Cull(cascade.Volume, frame.CameraPosition, 1.0f, 1.0f);
+
+		unsigned int next = 0;
+		world.Each<TransformComponent, RenderableComponent, BoundsComponent>([&](unsigned int count, TransformComponent* transforms,
+			RenderableComponent* renderables, BoundsComponent*) {
+			for (unsigned int i = 0; i < count; i++)
+			{
+				const RenderableComponent& renderable = renderables[i];
+				if (!renderable.Enabled || renderable.ShadowCaster == SHADOW_CASTER_NONE || (renderable.ShadowCaster == SHADOW_CASTER_STATIC && !drawStatic))
+					continue;
+				bool cached = renderable.ShadowCaster == SHADOW_CASTER_STATIC && shadowMap.Caching;
+				unsigned int pass = (cached ? RENDER_PASS_SHADOW_STATIC : RENDER_PASS_SHADOW_DYNAMIC) + c;
+				unsigned int queued = commandList.Size();
+				if (renderable.Kind == RENDERABLE_MODEL)
+					renderable.SourceModel->Enqueue(renderQueue, pass, renderable.Program, sceneGraph, renderable.ModelNode, batch, cullIndices[next++]);
+				else if (batch.IsVisible(cullIndices[next++]))
+				{
+					const glm::mat4& model_matrix = sceneGraph.GetWorldTransform(transforms[i].SceneNode);
+					DrawCommand draw = { renderable.Program, renderable.VAO, renderable.Material, GL_TRIANGLES, renderable.Count, renderable.Indexed,
+						model_matrix, glm::mat3(1.0f), renderable.Instances, false };
+					commandList.Enqueue(pass, draw, glm::vec3(model_matrix[3]));
+				}
+				(cached ? cascade.StaticDraws : cascade.DynamicDraws) += commandList.Size() - queued;
+			}
+		});
 	}
-	model_matrix = glm::translate(model_matrix, movingLightPos);
-	model_matrix = glm::scale(model_matrix, glm::vec3(0.2f));
-	// View matrix: camera
-	glm::mat4 view_matrix = camera.GetViewMatrix();
-	// Proj matrix: Zoom/Field of View (FOV), set aspect ratio, front and back clipping of view frustum 
-	glm::mat4 projection_matrix(1.0f);
-	projection_matrix = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-	// Set uniforms in shader program
-	// Model, view, projection matrices
-	lampShader.setMatrix4("model", model_matrix);
-	lampShader.setMatrix4("view", view_matrix);
-	lampShader.setMatrix4("proj", projection_matrix);
-	// Light colour uniform
-	lampShader.setVec3("lampColor", lightColor * 0.8f);
 }
 
-void setupModelObject(Shader modelShader, glm::vec3 lightColor, glm::vec3 pl_ambientColor, glm::vec3 pl_diffuseColor, glm::vec3 pl_specularIntensity, glm::vec3 fl_ambientColor, glm::vec3 fl_diffuseColor, glm::vec3 fl_specularIntensity, glm::vec3 dl_ambientColor, glm::vec3 dl_diffuseColor, glm::vec3 dl_specularIntensity)
+// Places the point shadow map at the shadow casting point light and, if it is re-rendered this frame, queues
+// every caster inside the light's radius once, with the cube map faces its bounds touch
+void pointShadowSystem(const FrameContext& frame)
 {
-	// Use the model shader
-	modelShader.use();
+	PROFILE_ZONE("pointShadowSystem");
+	pointShadowMap.Draws = pointShadowMap.FaceDraws = 0;
+	if (!pointShadowMap.Initialized())
+		return;
+	bool found = false;
+	glm::vec3 lightPosition;
+	float lightRadius = 0.0f;
+	world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+		for (unsigned int i = 0; i < count && !found; i++)
+			if (lights[i].Enabled && lights[i].Type == LIGHT_POINT && lights[i].CastsShadows)
+			{
+				lightPosition = lights[i].Position;
+				lightRadius = lightAttenuationRadius(lights[i]);
+				found = true;
+			}
+	});
+	pointShadowMap.Update(frame, lightPosition, found ? lightRadius : 0.0f);
+	if (!pointShadowMap.Enabled)
+		return;
+
+	// Dynamic casters that moved near the light re-render it
+	world.Each<RenderableComponent, BoundsComponent>([&](unsigned int count, RenderableComponent* renderables, BoundsComponent* bounds) {
+		for (unsigned int i = 0; i < count && !pointShadowMap.Dirty; i++)
+		{
+			const RenderableComponent& renderable = renderables[i];
+			if (!renderable.Enabled)
+				continue;
+			if (renderable.ShadowCaster == SHADOW_CASTER_ANIMATED)
+				pointShadowMap.MarkMoved(bounds[i].World);
+			else if (renderable.ShadowCaster == SHADOW_CASTER_DYNAMIC && (bounds[i].World.Min != bounds[i].PreviousWorld.Min
+				|| bounds[i].World.Max != bounds[i].PreviousWorld.Max))
+			{
+				AABB swept = bounds[i].World;
+				swept.Expand(bounds[i].PreviousWorld);
+				pointShadowMap.MarkMoved(swept);
+			}
+		}
+	});
+	if (!pointShadowMap.Dirty)
+		return;
+
+	// Same iteration twice: add the casters' bounds, cull them against each face, then queue the ones in any face
+	CullingBatch& batch = pointShadowCullingBatch;
+	batch.Clear();
+	std::vector<unsigned int> cullIndices;
+	world.Each<TransformComponent, RenderableComponent, BoundsComponent>([&](unsigned int count, TransformComponent*, RenderableComponent* renderables,
+		BoundsComponent* bounds) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const RenderableComponent& renderable = renderables[i];
+			if (!renderable.Enabled || renderable.ShadowCaster == SHADOW_CASTER_NONE)
+				continue;
+			if (renderable.Kind == RENDERABLE_MODEL)
+				cullIndices.push_back(renderable.SourceModel->AddToCullingBatch(batch, sceneGraph, renderable.ModelNode));
+			else
+				cullIndices.push_back(batch.Add(bounds[i].World));
+		}
+	});
+	pointShadowMap.CullFaces(batch);
+
+	RenderCommandList& commandList = renderQueue.CommandList(0);
+	unsigned int next = 0;
+	world.Each<TransformComponent, RenderableComponent, BoundsComponent>([&](unsigned int count, TransformComponent* transforms,
+		RenderableComponent* renderables, BoundsComponent*) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const RenderableComponent& renderable = renderables[i];
+			if (!renderable.Enabled || renderable.ShadowCaster == SHADOW_CASTER_NONE)
+				continue;
+			unsigned int first = cullIndices[next++];
+			if (renderable.Kind == RENDERABLE_MODEL)
+			{
+				unsigned int queued = commandList.Size();
+				renderable.SourceModel->EnqueueLayered(renderQueue, RENDER_PASS_POINT_SHADOW, renderable.Program, sceneGraph, renderable.ModelNode,
+					pointShadowMap.FaceMasks, first);
+				pointShadowMap.Draws += commandList.Size() - queued;
+				for (unsigned int m = 0; m < renderable.SourceModel->NumMeshes(); m++)
+					pointShadowMap.FaceDraws += PointShadowMap::FaceCount(pointShadowMap.FaceMasks[first + m]);
+			}
+			else if (pointShadowMap.FaceMasks[first] != 0)
+			{
+				const glm::mat4& model_matrix = sceneGraph.GetWorldTransform(transforms[i].SceneNode);
+				DrawCommand draw = { renderable.Program, renderable.VAO, renderable.Material, GL_TRIANGLES, renderable.Count, renderable.Indexed,
+					model_matrix, glm::mat3(1.0f), renderable.Instances, false, pointShadowMap.FaceMasks[first] };
+				commandList.Enqueue(RENDER_PASS_POINT_SHADOW, draw, glm::vec3(model_matrix[3]));
+				pointShadowMap.Draws++;
+				pointShadowMap.FaceDraws += PointShadowMap::FaceCount(pointShadowMap.FaceMasks[first]);
+			}
+		}
+	});
+}
 
-	// View/Projection transformations
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	modelShader.setMatrix4("proj", projection);
-	modelShader.setMatrix4("view", view);
-
-	// Render the loaded model
-	glm::mat4 loaded_model_matrix = glm::mat4(1.0f);
-	loaded_model_matrix = glm::translate(loaded_model_matrix, glm::vec3(backpackPos));
-	loaded_model_matrix = glm::scale(loaded_model_matrix, glm::vec3(0.5f));
-	modelShader.setMatrix4("model", loaded_model_matrix);
-	modelShader.setVec3("viewPos", camera.Position.x, camera.Position.y, camera.Position.z);
+// Camera, material and light uniforms of the lit shaders (cubes and models), rendering sceneWidth x sceneHeight
+void setupLitShader(Shader& shader, unsigned int receivers, int sceneWidth, int sceneHeight)
+{
+	PROFILE_ZONE("setupLitShader");
+	shader.use();
+	// View/Projection transformations and camera position (model matrices come with each draw)
+	bindViewUniforms(cameraViewUniforms);
 	// Set material struct properties
-	modelShader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-	modelShader.setFloat("material.shininess", 16.0f);
-	//
-	// Point light properties
-	modelShader.setVec3("pointLights[0].ambient", pl_ambientColor);
-	modelShader.setVec3("pointLights[0].diffuse", pl_diffuseColor);
-	modelShader.setVec3("pointLights[0].specular", pl_specularIntensity);
-	// Point light attenuation properties
-	modelShader.setFloat("pointLights[0].constant", 1.0f);
-	modelShader.setFloat("pointLights[0].linear", 0.09f);
-	modelShader.setFloat("pointLights[0].quadratic", 0.032f);
-	// Point light position
-	modelShader.setVec3("pointLights[0].position", movingLightPos);
-	//
-	// Flashlight properties
-	modelShader.setBool("flashlight.on", isFlashlightOn);
-	modelShader.setVec3("flashlight.ambient", fl_ambientColor);
-	modelShader.setVec3("flashlight.diffuse", fl_diffuseColor);
-	modelShader.setVec3("flashlight.specular", fl_specularIntensity);
-	// Flashlight attenuation properties
-	modelShader.setFloat("flashlight.constant", 1.0f);
-	modelShader.setFloat("flashlight.linear", 0.09f);
-	modelShader.setFloat("flashlight.quadratic", 0.032f);
-	// Flashlight position and direction
-	modelShader.setVec3("flashlight.position", camera.Position);
-	modelShader.setVec3("flashlight.direction", camera.Front);
-	// Flashlight cutOff angle
-	modelShader.setFloat("flashlight.cutOff", glm::cos(glm::radians(5.0f)));
-	modelShader.setFloat("flashlight.outerCutOff", glm::cos(glm::radians(20.0f)));
-	//
-	// Directional light properties
-	modelShader.setVec3("dirLights[0].ambient", dl_ambientColor);
-	modelShader.setVec3("dirLights[0].diffuse", dl_diffuseColor);
-	modelShader.setVec3("dirLights[0].specular", dl_specularIntensity);
-	// Directional light direction
-	modelShader.setVec3("dirLights[0].direction", glm::vec3(1.0f, -0.5f, -1.0f));
+	shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
+	shader.setFloat("material.shininess", 16.0f);
+	// Texture detail knob of the quality governor (level 0 without dynamic resolution)
+	shader.setFloat("lodBias", governor.Knobs().LodBias);
+	applyLights(shader, receivers);
+	shadowMap.Apply(shader, SHADOW_MAP_TEXTURE_UNIT);
+	pointShadowMap.Apply(shader, POINT_SHADOW_TEXTURE_UNIT);
+	shader.setBool("useLightClusters", useLightClusters);
+	if (useLightClusters)
+	{
+		const LightClusterGrid& clusters = (receivers & LIGHT_RECEIVER_MODELS) ? modelLightClusters : cubeLightClusters;
+		clusters.Apply(shader, CLUSTER_TEXTURE_UNIT, CLUSTER_INDEX_TEXTURE_UNIT, sceneWidth, sceneHeight);
+	}
+}
+
+// Streams the ViewUniforms block of a view into this frame's region of the stream buffer
+StreamBuffer::Allocation streamViewUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPosition, float time)
+{
+	ViewUniforms uniforms = { view, projection, viewPosition, time, view, projection, viewPosition, 1 };
+	return streamBuffer.Write(&uniforms, sizeof(uniforms), streamBuffer.UniformAlignment());
+}
+
+// Streams the ViewUniforms block of single-pass stereo, with the left eye as the view and the right eye second
+StreamBuffer::Allocation streamStereoViewUniforms(const FrameContext& left, const FrameContext& right, float time)
+{
+	ViewUniforms uniforms = { left.View, left.Projection, left.CameraPosition, time, right.View, right.Projection, right.CameraPosition, 2 };
+	return streamBuffer.Write(&uniforms, sizeof(uniforms), streamBuffer.UniformAlignment());
+}
+
+// Makes a streamed ViewUniforms block the one every program reads, until the next call
+void bindViewUniforms(const StreamBuffer::Allocation& viewUniforms)
+{
+	streamBuffer.BindRange(GL_UNIFORM_BUFFER, VIEW_UNIFORM_BINDING, viewUniforms);
+}
+
+// Sets the uniforms of the enabled lights applied to the given receivers: point lights are read from the
+// receivers' light buffer, directional lights fill the shader's array in order, the spot light is the
+// flashlight. The quality governor's light limit was already met by lightBufferSystem() leaving point lights
+// out of the buffer.
+void applyLights(Shader& shader, unsigned int receivers)
+{
+	PROFILE_ZONE("applyLights");
+	const PointLightBuffer& pointLights = (receivers & LIGHT_RECEIVER_MODELS) ? modelPointLights : cubePointLights;
+	pointLights.Bind(POINT_LIGHT_TEXTURE_UNIT);
+	shader.setInt("pointLightData", POINT_LIGHT_TEXTURE_UNIT);
+	shader.setInt("numPointLights", pointLights.Count());
+	shader.setInt("shadowedPointLight", pointShadowMap.Enabled ? pointLights.ShadowedLight() : -1);
+	unsigned int numDirLights = 0;
+	bool flashlightOn = false;
+	shader.setInt("shadowedDirLight", -1);
+	world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const LightComponent& light = lights[i];
+			if (!light.Enabled || !(light.Receivers & receivers))
+				continue;
+			if (light.Type == LIGHT_DIRECTIONAL && numDirLights < MAX_DIR_LIGHTS)
+			{
+				if (light.CastsShadows && shadowMap.Enabled)
+					shader.setInt("shadowedDirLight", numDirLights);
+				setLightUniforms(shader, "dirLights[" + std::to_string(numDirLights++) + "]", light);
+			}
+			else if (light.Type == LIGHT_SPOT && !flashlightOn)
+			{
+				setLightUniforms(shader, "flashlight", light);
+				flashlightOn = true;
+			}
+		}
+	});
+	// Slots left unfilled (lights off or over the limit) contribute nothing
+	for (unsigned int i = numDirLights; i < MAX_DIR_LIGHTS; i++)
+	{
+		std::string name = "dirLights[" + std::to_string(i) + "]";
+		shader.setVec3(name + ".ambient", glm::vec3(0.0f));
+		shader.setVec3(name + ".diffuse", glm::vec3(0.0f));
+		shader.setVec3(name + ".specular", glm::vec3(0.0f));
+	}
+	shader.setBool("flashlight.on", flashlightOn);
+}
+
+// Enabled lights other than point lights that are applied to the receivers, as applyLights() picks them: the
+// directional lights up to MAX_DIR_LIGHTS, and one spot light
+unsigned int countNonPointLights(unsigned int receivers)
+{
+	unsigned int numDirLights = 0;
+	bool spotLight = false;
+	world.Each<LightComponent>([&](unsigned int count, LightComponent* lights) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const LightComponent& light = lights[i];
+			if (!light.Enabled || !(light.Receivers & receivers))
+				continue;
+			if (light.Type == LIGHT_DIRECTIONAL && numDirLights < MAX_DIR_LIGHTS)
+				numDirLights++;
+			else if (light.Type == LIGHT_SPOT)
+				spotLight = true;
+		}
+	});
+	return numDirLights + (spotLight ? 1 : 0);
+}
+
+// Uniforms of one light in the lit shaders' PointLight/DirLight/SpotLight struct called name
+void setLightUniforms(Shader& shader, const std::string& name, const LightComponent& light)
+{
+	glm::vec3 diffuseColor = light.Color * light.DiffuseIntensity;
+	shader.setVec3(name + ".ambient", diffuseColor * light.AmbientIntensity);
+	shader.setVec3(name + ".diffuse", diffuseColor);
+	shader.setVec3(name + ".specular", light.SpecularIntensity);
+	if (light.Type != LIGHT_DIRECTIONAL)
+	{
+		// Attenuation properties and position
+		shader.setFloat(name + ".constant", light.Constant);
+		shader.setFloat(name + ".linear", light.Linear);
+		shader.setFloat(name + ".quadratic", light.Quadratic);
+		shader.setVec3(name + ".position", light.Position);
+	}
+	if (light.Type != LIGHT_POINT)
+		shader.setVec3(name + ".direction", light.Direction);
+	if (light.Type == LIGHT_SPOT)
+	{
+		shader.setFloat(name + ".cutOff", glm::cos(glm::radians(light.CutOff)));
+		shader.setFloat(name + ".outerCutOff", glm::cos(glm::radians(light.OuterCutOff)));
+	}
+}
+
+// Camera and material uniforms of the G-buffer shaders
+void setupGBufferShader(Shader& shader, int receiverGroup)
+{
+	PROFILE_ZONE("setupGBufferShader");
+	shader.use();
+	bindViewUniforms(cameraViewUniforms);
+	shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
+	shader.setFloat("lodBias", governor.Knobs().LodBias);
+	shader.setBool("useModelTexture", receiverGroup == GBUFFER_RECEIVER_MODELS);
+	shader.setInt("receiverGroup", receiverGroup);
+}
+
+// Uniforms shared by the deferred lighting shaders: G-buffer units, the camera for reconstructing positions
+// from depth, the point light buffer and the flashlight with its cone
+void setupDeferredLightShader(Shader& shader, const FrameContext& frame, int sceneWidth, int sceneHeight)
+{
+	PROFILE_ZONE("setupDeferredLightShader");
+	shader.use();
+	shader.setInt("gAlbedoSpecular", 0);
+	shader.setInt("gNormalReceiver", 1);
+	shader.setInt("gDepth", 2);
+	bindViewUniforms(cameraViewUniforms);
+	shader.setMatrix4("inverseViewProj", frame.InverseViewProjection);
+	shader.setVec2("viewportSize", glm::vec2((float)sceneWidth, (float)sceneHeight));
+	shader.setFloat("shininess", 16.0f); // material.shininess of the forward shaders
+	volumePointLights.Bind(POINT_LIGHT_TEXTURE_UNIT);
+	shader.setInt("pointLightData", POINT_LIGHT_TEXTURE_UNIT);
+	pointShadowMap.Apply(shader, POINT_SHADOW_TEXTURE_UNIT);
+	shader.setInt("shadowedPointLight", pointShadowMap.Enabled ? volumePointLights.ShadowedLight() : -1);
+	const LightComponent& flashlight = world.Get<LightComponent>(flashlightEntity);
+	shader.setBool("flashlight.on", flashlight.Enabled);
+	if (!flashlight.Enabled)
+		return;
+	setLightUniforms(shader, "flashlight", flashlight);
+	// Cone from the flashlight out to where its light fades, opening as wide as the outer cut off
+	glm::vec3 direction = glm::normalize(flashlight.Direction);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	float length = lightAttenuationRadius(flashlight, 2.6f); // the shader's flashlight intensity factor
+	float radius = length * glm::tan(glm::radians(flashlight.OuterCutOff));
+	glm::mat4 spotModel = glm::inverse(glm::lookAt(flashlight.Position, flashlight.Position + direction, up));
+	spotModel = glm::scale(spotModel, glm::vec3(radius, radius, length));
+	shader.setMatrix4("spotModel", spotModel);
+}
+
+// Mode toggles, stored on the entities they affect
+bool& movingLightEnabled()
+{
+	return world.Get<AnimationComponent>(lampEntity).Enabled;
+}
+
+bool& flashlightEnabled()
+{
+	return world.Get<LightComponent>(flashlightEntity).Enabled;
+}
+
+bool& outlineEnabled()
+{
+	return world.Get<RenderableComponent>(backpackEntity).Outlined;
+}
+
+// Colour of the lamp's light (CycleColor) at a time in seconds
+glm::vec3 lampColor(float time)
+{
+	glm::vec3 color;
+	color.x = sin(time * 1.0f) / 2.0f + 0.7f;
+	color.y = sin(time * 0.5f) / 2.0f + 0.7f;
+	color.z = sin(time * 0.4f) / 2.0f + 0.7f;
+	return color;
+}
+
+// Point light of the lamp, positioned by its entity
+LightComponent createLampLight()
+{
+	LightComponent lampLight;
+	lampLight.Type = LIGHT_POINT;
+	lampLight.AmbientIntensity = glm::vec3(0.4f);
+	lampLight.DiffuseIntensity = glm::vec3(0.9f);
+	lampLight.SpecularIntensity = glm::vec3(0.8f);
+	lampLight.CycleColor = true;
+	lampLight.CastsShadows = true;
+	return lampLight;
+}
+
+// Spot light following the camera, off until toggled
+LightComponent createFlashlight()
+{
+	LightComponent flashlight;
+	flashlight.Type = LIGHT_SPOT;
+	flashlight.Enabled = false;
+	flashlight.Color = glm::vec3(0.7f);
+	flashlight.AmbientIntensity = glm::vec3(0.2f);
+	flashlight.DiffuseIntensity = glm::vec3(1.0f);
+	flashlight.SpecularIntensity = glm::vec3(0.4f);
+	flashlight.FollowCamera = true;
+	return flashlight;
+}
+
+LightComponent createDirLight(glm::vec3 direction, unsigned int receivers)
+{
+	LightComponent dirLight;
+	dirLight.Type = LIGHT_DIRECTIONAL;
+	dirLight.AmbientIntensity = glm::vec3(0.2f);
+	dirLight.DiffuseIntensity = glm::vec3(0.5f);
+	dirLight.SpecularIntensity = glm::vec3(0.2f);
+	dirLight.Direction = direction;
+	dirLight.Receivers = receivers;
+	return dirLight;
+}
+
+// Short range point light at a random place in the cube field, with a random colour
+LightComponent createExtraPointLight()
+{
+	LightComponent pointLight;
+	pointLight.Type = LIGHT_POINT;
+	pointLight.Position = glm::vec3(rand() / (float)RAND_MAX * 40.0f - 20.0f, rand() / (float)RAND_MAX * 20.0f - 10.0f, rand() / (float)RAND_MAX * -60.0f);
+	pointLight.Color = glm::vec3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX) * 0.8f + 0.2f;
+	pointLight.AmbientIntensity = glm::vec3(0.05f);
+	pointLight.DiffuseIntensity = glm::vec3(1.0f);
+	pointLight.SpecularIntensity = glm::vec3(0.5f);
+	pointLight.Constant = 1.0f;
+	pointLight.Linear = 0.7f;
+	pointLight.Quadratic = 1.8f;
+	return pointLight;
+}
+
+// --software: renders the backpack lit by the model lights of the GL scene (the lamp at its resting place
+// cycling colour, the models' directional light, the extra point lights) with the CPU rasterizer, from the
+// starting camera. Animation time advances by REPLAY_TIME_STEP per frame, like headless mode.
+int runSoftwareRenderer()
+{
+	PROFILE_ZONE("runSoftwareRenderer");
+	JobSystem jobSystem(workerThreadCount);
+	stbi_set_flip_vertically_on_load(true);
+	Model backpackModel = Model((char*)"models/backpack/backpack.obj", false);
+	if (backpackModel.NumMeshes() == 0)
+		return -1;
+	// Each mesh's first diffuse map, loaded once per file
+	std::map<std::string, SoftwareTexture> textures;
+	std::vector<const SoftwareTexture*> meshTextures(backpackModel.NumMeshes(), NULL);
+	for (unsigned int i = 0; i < backpackModel.NumMeshes(); i++)
+	{
+		const Mesh& mesh = backpackModel.GetMesh(i);
+		for (unsigned int t = 0; t < mesh.textures.size(); t++)
+		{
+			if (mesh.textures[t].type != "texture_diffuse")
+				continue;
+			std::string path = backpackModel.TexturePath(mesh.textures[t]);
+			if (textures.find(path) == textures.end())
+				textures[path].Load(path);
+			meshTextures[i] = &textures[path];
+			break;
+		}
+	}
+
+	TransformComponent backpackTransform;
+	backpackTransform.Position = BACKPACK_POSITION;
+	backpackTransform.Scale = glm::vec3(BACKPACK_SCALE);
+	glm::mat4 backpackMatrix = backpackTransform.LocalMatrix();
+	LightComponent lampLight = createLampLight();
+	lampLight.Position = LAMP_POSITION;
+	LightComponent dirLight = createDirLight(glm::vec3(1.0f, -0.5f, -1.0f), LIGHT_RECEIVER_MODELS);
+	std::vector<LightComponent> extraLights;
+	for (unsigned int i = 1; i < pointLightCount; i++)
+		extraLights.push_back(createExtraPointLight());
+
+	Camera softwareCamera(cameraPos);
+	SoftwareRasterizer rasterizer;
+	rasterizer.Resize(renderWidth, renderHeight);
+	unsigned int frameCount = replayFrameCount > 0 ? replayFrameCount : DEFAULT_SOFTWARE_FRAMES;
+	SoftwareRasterizer::Stats total;
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		lampLight.Color = lampColor((float)(frame * REPLAY_TIME_STEP));
+		rasterizer.ClearColor = lampLight.Color / 10.0f;
+		rasterizer.Begin(softwareCamera.GetViewMatrix(), softwareCamera.GetProjectionMatrix((float)renderWidth / (float)renderHeight),
+			softwareCamera.Position);
+		rasterizer.AddLight(dirLight, MAX_DIR_LIGHTS);
+		rasterizer.AddLight(lampLight);
+		for (unsigned int i = 0; i < extraLights.size(); i++)
+			rasterizer.AddLight(extraLights[i]);
+		for (unsigned int i = 0; i < backpackModel.NumMeshes(); i++)
+			rasterizer.Draw(backpackModel.GetMesh(i), backpackMatrix * backpackModel.MeshTransform(i), meshTextures[i]);
+		rasterizer.Render(jobSystem);
+
+		const SoftwareRasterizer::Stats& stats = rasterizer.LastStats();
+		total.Triangles += stats.Triangles;
+		total.Pixels += stats.Pixels;
+		total.Milliseconds += stats.Milliseconds;
+	}
+	const SoftwareRasterizer::Stats& last = rasterizer.LastStats();
+	printf("Software rasterizer: %u frames at %ux%u on %u threads, %u triangles (%u rasterized) and %llu pixels shaded per frame\n",
+		frameCount, renderWidth, renderHeight, jobSystem.NumThreads(), last.Triangles, last.RasterizedTriangles, last.Pixels);
+	printf("Software rasterizer: %f ms per frame, %f Mtri/s, %f Mpix/s\n", total.Milliseconds / frameCount,
+		total.MTrianglesPerSecond(), total.MPixelsPerSecond());
+	if (!headlessOutputPath.empty() && rasterizer.SaveImage(headlessOutputPath))
+		std::cout << "Saved last frame to " << headlessOutputPath << std::endl;
+	PROFILE_STOP();
+	return 0;
+}
+
+void setupLampObject(Shader lampShader, glm::vec3 lightColor)
+{
+	PROFILE_ZONE("setupLampObject");
+	lampShader.use();
+	// Set uniforms in shader program
+	// View, projection matrices (streamed from the frame snapshot, the model matrix comes with the draw)
+	bindViewUniforms(cameraViewUniforms);
+	// Light colour uniform
+	lampShader.setVec3("lampColor", lightColor * 0.8f);
 }
 
 void processInput(GLFWwindow* window)
@@ -763,36 +2779,70 @@ void processInput(GLFWwindow* window)
 	if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-	// Camera position movement
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.ProcessKeyboard(LEFT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+	// Camera position movement is handled by simulationTick() from timestamped key events
 
 	// Light position movement
 	if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
-		isMovingLight = true;
+		movingLightEnabled() = true;
 	if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
-		isMovingLight = false;
+		movingLightEnabled() = false;
 
 	// Flashight on/off
 	if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
-		isFlashlightOn = true;
+		flashlightEnabled() = true;
 	if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS)
-		isFlashlightOn = false;
+		flashlightEnabled() = false;
 
 	// Outline on/off
 	if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
-		isOutlineOn = true;
+		outlineEnabled() = true;
 	if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
-		isOutlineOn = false;
+		outlineEnabled() = false;
+
+	// Small object culling on/off
+	if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS)
+		minCullPixelSize = SMALL_OBJECT_PIXEL_SIZE;
+	if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
+		minCullPixelSize = 0.0f;
+
+	// Write the frame stats once per press of F1
+	static bool wasStatsKeyDown = false;
+	bool isStatsKeyDown = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+	if (isStatsKeyDown && !wasStatsKeyDown)
+		frameStats.Export(statsPath);
+	wasStatsKeyDown = isStatsKeyDown;
 
 }
 
+// One fixed-size step of the simulation: apply the input received up to the end of the tick, then move the camera
+void simulationTick(float tickDelta, double tickEndTime)
+{
+	inputQueue.Consume(tickEndTime, applyInputEvent);
+
+	// Camera position movement
+	if (inputQueue.IsKeyDown(GLFW_KEY_W))
+		camera.ProcessKeyboard(FORWARD, tickDelta);
+	if (inputQueue.IsKeyDown(GLFW_KEY_S))
+		camera.ProcessKeyboard(BACKWARD, tickDelta);
+	if (inputQueue.IsKeyDown(GLFW_KEY_A))
+		camera.ProcessKeyboard(LEFT, tickDelta);
+	if (inputQueue.IsKeyDown(GLFW_KEY_D))
+		camera.ProcessKeyboard(RIGHT, tickDelta);
+}
+
+void applyInputEvent(const InputEvent& event)
+{
+	if (event.Type == INPUT_CURSOR)
+		camera.ProcessMouseMovement(event.X, event.Y);
+	else if (event.Type == INPUT_SCROLL)
+		camera.ProcessMouseScroll(event.Y);
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	inputQueue.PushKey(glfwGetTime(), key, action);
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) 
 {
 	// Fixes first mouse cursor capture by OpenGL window
@@ -812,30 +2862,42 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	lastCursorX = xpos;
 	lastCursorY = ypos;
 
-	camera.ProcessMouseMovement(xOffset, yOffset);
+	inputQueue.PushCursor(glfwGetTime(), xOffset, yOffset);
 }
 
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset)
 {
-	camera.ProcessMouseScroll(yOffset);
+	inputQueue.PushScroll(glfwGetTime(), yOffset);
 }
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) 
 {
 	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
-		isFlashlightOn = true;
+		flashlightEnabled() = true;
 	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE)
-		isFlashlightOn = false;
+		flashlightEnabled() = false;
 }
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
+	renderWidth = width;
+	renderHeight = height;
 	glViewport(0, 0, width, height);
 }
 
+// Seconds since startup (GLFW's timer needs glfwInit(), which the EGL headless context doesn't call)
+double getTime()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!isHeadless)
+		return glfwGetTime();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 unsigned int loadTexture(char const* path)
 {
+	PROFILE_ZONE("loadTexture");
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 
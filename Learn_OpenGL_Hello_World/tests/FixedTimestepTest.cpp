@@ -0,0 +1,92 @@
+// Checks that the fixed-rate simulation clock keeps up with the real-time stamps of queued input, including after
+// a frame long enough that the catch-up limit skips time.
+//
+// Standalone: needs no window, GL context or GL headers, only glm from the tree. From this directory:
+//   g++ -std=c++14 -I.. FixedTimestepTest.cpp -o FixedTimestepTest && ./FixedTimestepTest
+// (cl /EHsc /I.. FixedTimestepTest.cpp with MSVC). Exits with 1 and prints the failed checks if any fail.
+
+#include <FixedTimestep.h>
+#include <InputQueue.h>
+#include <cmath>
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// Runs one frame of frameTime seconds the way the main loop does, returning the input events consumed
+static int runFrame(FixedTimestep& simulation, InputQueue& input, double frameTime)
+{
+	int consumed = 0;
+	simulation.Advance(frameTime);
+	while (simulation.Step())
+		input.Consume(simulation.Time(), [&consumed](const InputEvent&) { consumed++; });
+	return consumed;
+}
+
+static void testInputAfterHitch()
+{
+	const double tickRate = 120.0;
+	const double frameTime = 1.0 / 60.0;
+	FixedTimestep simulation(tickRate, 8);
+	InputQueue input;
+	double wallTime = 0.0;
+	simulation.Reset(wallTime);
+
+	for (int i = 0; i < 10; i++)
+	{
+		wallTime += frameTime;
+		runFrame(simulation, input, frameTime);
+	}
+
+	// A two second stall, far more than the 8 ticks a frame may catch up on
+	wallTime += 2.0;
+	runFrame(simulation, input, 2.0);
+	check(std::fabs(simulation.Time() + simulation.Alpha() * simulation.StepSize() - wallTime) < 1e-6,
+		"simulation time plus the accumulated remainder matches wall time after a hitch");
+
+	// A key pressed during the next frame is applied by that frame's ticks
+	input.PushKey(wallTime + frameTime * 0.5, 87, 1);
+	wallTime += frameTime;
+	int consumed = runFrame(simulation, input, frameTime);
+	check(consumed == 1, "key pressed after a hitch is consumed in the frame it arrives");
+	check(input.IsKeyDown(87), "key is held after it is consumed");
+
+	// Every later stall is skipped the same way, so the lag never builds up
+	for (int i = 0; i < 5; i++)
+	{
+		wallTime += 1.0;
+		runFrame(simulation, input, 1.0);
+	}
+	input.PushKey(wallTime + frameTime * 0.5, 87, 0);
+	wallTime += frameTime;
+	consumed = runFrame(simulation, input, frameTime);
+	check(consumed == 1, "key released after several hitches is consumed in the frame it arrives");
+	check(!input.IsKeyDown(87), "key is released after it is consumed");
+}
+
+static void testInvalidTickRate()
+{
+	FixedTimestep simulation(120.0);
+	simulation.SetTickRate(0.0);
+	check(simulation.StepSize() == 1.0 / 120.0, "tick rate 0 is ignored");
+	simulation.SetTickRate(-30.0);
+	check(simulation.StepSize() == 1.0 / 120.0, "negative tick rate is ignored");
+}
+
+int main()
+{
+	testInputAfterHitch();
+	testInvalidTickRate();
+	if (failures > 0)
+		return 1;
+	std::cout << "FixedTimestep tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,97 @@
+// Checks that forward and deferred shading apply the same lights to each receiver group at every quality
+// governor level: the governor's MaxLights comes out of the point lights only, so the directional light and
+// the flashlight are never dropped, and neither path goes over the limit.
+//
+// The selection follows lightBufferSystem(), applyLights() and the deferred passes in main.cpp, on a scene like
+// the demo's: one directional light per receiver group, the flashlight, and any number of point lights.
+//
+// Standalone: needs no window, GL context or GL headers, only glm from the tree. From this directory:
+//   g++ -std=c++14 -I.. LightBudgetTest.cpp -o LightBudgetTest && ./LightBudgetTest
+// (cl /EHsc /I.. LightBudgetTest.cpp with MSVC). Exits with 1 and prints the failed checks if any fail.
+
+#include <QualityGovernor.h>
+#include <algorithm>
+#include <iostream>
+
+static const unsigned int MAX_DIR_LIGHTS = 1; // as in main.cpp
+
+static int failures = 0;
+
+static void check(bool condition, const char* what, unsigned int level, unsigned int pointLights, bool flashlight)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << " (level " << level << ", " << pointLights << " point lights, flashlight "
+			<< (flashlight ? "on" : "off") << ")" << std::endl;
+		failures++;
+	}
+}
+
+// Lights one receiver group is shaded with
+struct AppliedLights {
+	unsigned int PointLights = 0;
+	unsigned int DirLights = 0;
+	bool Flashlight = false;
+
+	unsigned int Total() const { return PointLights + DirLights + (Flashlight ? 1 : 0); }
+};
+
+// countNonPointLights() for one group of the demo scene
+static unsigned int nonPointLights(bool flashlight)
+{
+	return std::min(1u, MAX_DIR_LIGHTS) + (flashlight ? 1 : 0);
+}
+
+// Forward: a point light buffer per group capped at the group's budget, applyLights() sets the rest
+static AppliedLights forward(const QualityKnobs& knobs, unsigned int pointLights, bool flashlight)
+{
+	AppliedLights applied;
+	applied.PointLights = std::min(pointLights, knobs.PointLightBudget(nonPointLights(flashlight)));
+	applied.DirLights = std::min(1u, MAX_DIR_LIGHTS);
+	applied.Flashlight = flashlight;
+	return applied;
+}
+
+// Deferred: one light volume buffer capped at the smaller group budget (the groups reserve the same lights
+// here), each group's directional light in the full-screen pass, the flashlight's cone
+static AppliedLights deferred(const QualityKnobs& knobs, unsigned int pointLights, bool flashlight)
+{
+	unsigned int cubesBudget = knobs.PointLightBudget(nonPointLights(flashlight));
+	unsigned int modelsBudget = knobs.PointLightBudget(nonPointLights(flashlight));
+	unsigned int budget = std::min(cubesBudget, modelsBudget);
+	AppliedLights applied;
+	applied.PointLights = std::min(pointLights, budget);
+	applied.DirLights = 1;
+	applied.Flashlight = flashlight;
+	return applied;
+}
+
+int main()
+{
+	const unsigned int pointLightCounts[] = { 0, 1, 30, 31, 32, 33, 255, 256, 300, 5000 };
+	for (unsigned int level = 0; level < QualityGovernor::NUM_LEVELS; level++)
+	{
+		const QualityKnobs& knobs = QualityGovernor::LevelKnobs(level);
+		for (unsigned int pointLights : pointLightCounts)
+			for (int flashlight = 0; flashlight < 2; flashlight++)
+			{
+				AppliedLights forwardLights = forward(knobs, pointLights, flashlight != 0);
+				AppliedLights deferredLights = deferred(knobs, pointLights, flashlight != 0);
+				check(forwardLights.PointLights == deferredLights.PointLights, "forward and deferred shade the same point lights",
+					level, pointLights, flashlight != 0);
+				check(forwardLights.DirLights == 1 && deferredLights.DirLights == 1, "the directional light is always applied",
+					level, pointLights, flashlight != 0);
+				check(forwardLights.Flashlight == (flashlight != 0) && deferredLights.Flashlight == (flashlight != 0),
+					"the flashlight is applied whenever it is on", level, pointLights, flashlight != 0);
+				check(forwardLights.Total() <= std::max(knobs.MaxLights, nonPointLights(flashlight != 0)),
+					"no more lights than the level allows", level, pointLights, flashlight != 0);
+				unsigned int expected = std::min(pointLights + nonPointLights(flashlight != 0), std::max(knobs.MaxLights, nonPointLights(flashlight != 0)));
+				check(forwardLights.Total() == expected, "the whole limit is used when there are enough lights",
+					level, pointLights, flashlight != 0);
+			}
+	}
+	if (failures > 0)
+		return 1;
+	std::cout << "Light budget tests passed" << std::endl;
+	return 0;
+}
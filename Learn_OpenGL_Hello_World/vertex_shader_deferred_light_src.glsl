@@ -0,0 +1,40 @@
+#version 330 core
+	// Unit sphere (one instance per point light), or unit cone for the flashlight
+	layout (location = 0) in vec3 aPos;
+
+	// Point light whose volume this is, -1 for the flashlight
+	flat out int LightIndex;
+
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+
+	// Point lights, four texels each (see LightBuffer.h)
+	uniform samplerBuffer pointLightData;
+	// Index of the first light of the batch drawn
+	uniform int firstLight;
+
+	uniform bool spotVolume;
+	uniform mat4 spotModel;
+
+void main() {
+	if (spotVolume) {
+		LightIndex = -1;
+		gl_Position = proj * view * spotModel * vec4(aPos, 1.0);
+	}
+	else {
+		// Sphere scaled to the light's radius
+		vec4 positionRadius = texelFetch(pointLightData, (firstLight + gl_InstanceID) * 4);
+		LightIndex = firstLight + gl_InstanceID;
+		gl_Position = proj * view * vec4(positionRadius.xyz + aPos * positionRadius.w, 1.0);
+	}
+}
@@ -0,0 +1,54 @@
+#version 330 core
+	// Depth pre-pass of the instanced cube field, same transform as vertex_shader_lighting_instanced_src.glsl
+	layout (location = 0) in vec3 aPos;
+	// Per instance: base position (xyz) and twist speed (w); advanced once per eye pair with instanced stereo
+	layout (location = 6) in vec4 aInstance;
+
+	invariant gl_Position;
+
+	// Placement of the whole field
+	uniform mat4 model;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+
+// Clip position of a world position for the eye this instance is drawn for. With instanced stereo every instance
+// is drawn once per eye, and each eye is squeezed into its half of the target and clipped at the middle.
+vec4 eyeClipPosition(vec4 worldPos) {
+	int eye = gl_InstanceID % numEyes;
+	vec4 position = eye == 0 ? proj * view * worldPos : rightProj * rightView * worldPos;
+	if (numEyes > 1) {
+		position.x = position.x * 0.5 + (eye == 0 ? -0.5 : 0.5) * position.w;
+		gl_ClipDistance[0] = eye == 0 ? -position.x : position.x;
+	}
+	return position;
+}
+
+// Rotation of angle radians around a unit axis (same as glm::rotate)
+mat3 rotationMatrix(vec3 axis, float angle) {
+	float c = cos(angle);
+	float s = sin(angle);
+	vec3 t = (1.0 - c) * axis;
+	return mat3(
+		t.x * axis.x + c,          t.x * axis.y + s * axis.z, t.x * axis.z - s * axis.y,
+		t.y * axis.x - s * axis.z, t.y * axis.y + c,          t.y * axis.z + s * axis.x,
+		t.z * axis.x + s * axis.y, t.z * axis.y - s * axis.x, t.z * axis.z + c);
+}
+
+void main() {
+	float animation = sin(time) / 2.0 + 0.5;
+	mat3 rotation = rotationMatrix(normalize(vec3(0.1, 0.1, 0.15)), aInstance.w * animation);
+	vec3 translation = aInstance.xyz * animation;
+
+	vec3 fragPos = vec3(model * vec4(rotation * aPos + translation, 1.0));
+	gl_Position = eyeClipPosition(vec4(fragPos, 1.0));
+}
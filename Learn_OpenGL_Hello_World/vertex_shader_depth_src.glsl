@@ -0,0 +1,36 @@
+#version 330 core
+	// Depth pre-pass of the lit cubes and models: position only, computed exactly as their vertex shaders
+	// do so the main pass's GL_EQUAL depth test matches
+	layout (location = 0) in vec3 aPos;
+
+	invariant gl_Position;
+
+	uniform mat4 model;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+
+// Clip position of a world position for the eye this instance is drawn for. With instanced stereo every instance
+// is drawn once per eye, and each eye is squeezed into its half of the target and clipped at the middle.
+vec4 eyeClipPosition(vec4 worldPos) {
+	int eye = gl_InstanceID % numEyes;
+	vec4 position = eye == 0 ? proj * view * worldPos : rightProj * rightView * worldPos;
+	if (numEyes > 1) {
+		position.x = position.x * 0.5 + (eye == 0 ? -0.5 : 0.5) * position.w;
+		gl_ClipDistance[0] = eye == 0 ? -position.x : position.x;
+	}
+	return position;
+}
+
+void main() {
+	gl_Position = eyeClipPosition(model * vec4(aPos, 1.0));
+}
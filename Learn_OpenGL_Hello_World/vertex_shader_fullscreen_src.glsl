@@ -0,0 +1,10 @@
+#version 330 core
+
+	// Full-screen triangle, no vertex buffer needed
+	out vec2 ScreenUV;
+
+void main() {
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	ScreenUV = position;
+	gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
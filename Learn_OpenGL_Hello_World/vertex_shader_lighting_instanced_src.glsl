@@ -0,0 +1,68 @@
+#version 330 core
+	layout (location = 0) in vec3 aPos;
+	layout (location = 4) in vec2 aTexCoords;
+	layout (location = 5) in vec3 aNormal;
+	// Per instance: base position (xyz) and twist speed (w); advanced once per eye pair with instanced stereo
+	layout (location = 6) in vec4 aInstance;
+	
+	out vec2 TexCoords;
+
+	out vec3 Normal;
+	out vec3 FragPos;
+	// Camera position of the eye the vertex is drawn for
+	flat out vec3 EyePos;
+	// Depth must match the depth pre-pass exactly (vertex_shader_depth*_src.glsl) for its GL_EQUAL test
+	invariant gl_Position;
+
+	// Placement of the whole field
+	uniform mat4 model;
+	uniform mat3 normalMatrix;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+
+// Clip position of a world position for the eye this instance is drawn for. With instanced stereo every instance
+// is drawn once per eye, and each eye is squeezed into its half of the target and clipped at the middle.
+vec4 eyeClipPosition(vec4 worldPos) {
+	int eye = gl_InstanceID % numEyes;
+	vec4 position = eye == 0 ? proj * view * worldPos : rightProj * rightView * worldPos;
+	if (numEyes > 1) {
+		position.x = position.x * 0.5 + (eye == 0 ? -0.5 : 0.5) * position.w;
+		gl_ClipDistance[0] = eye == 0 ? -position.x : position.x;
+	}
+	return position;
+}
+
+// Rotation of angle radians around a unit axis (same as glm::rotate)
+mat3 rotationMatrix(vec3 axis, float angle) {
+	float c = cos(angle);
+	float s = sin(angle);
+	vec3 t = (1.0 - c) * axis;
+	return mat3(
+		t.x * axis.x + c,          t.x * axis.y + s * axis.z, t.x * axis.z - s * axis.y,
+		t.y * axis.x - s * axis.z, t.y * axis.y + c,          t.y * axis.z + s * axis.x,
+		t.z * axis.x + s * axis.y, t.z * axis.y - s * axis.x, t.z * axis.z + c);
+}
+
+void main() {
+	// Same animation as animationSystem(): cubes move out from the origin while twisting
+	float animation = sin(time) / 2.0 + 0.5;
+	mat3 rotation = rotationMatrix(normalize(vec3(0.1, 0.1, 0.15)), aInstance.w * animation);
+	vec3 translation = aInstance.xyz * animation;
+
+	TexCoords = aTexCoords;
+	// Rotation only within the field, so its normal matrix is the rotation itself
+	Normal = normalMatrix * (rotation * aNormal);
+	FragPos = vec3(model * vec4(rotation * aPos + translation, 1.0));
+	EyePos = gl_InstanceID % numEyes == 0 ? viewPos : rightViewPos;
+	gl_Position = eyeClipPosition(vec4(FragPos, 1.0));
+}
@@ -7,17 +7,43 @@
 
 	out vec3 Normal;
 	out vec3 FragPos;
+	// Camera position of the eye the vertex is drawn for
+	flat out vec3 EyePos;
+	// Depth must match the depth pre-pass exactly (vertex_shader_depth*_src.glsl) for its GL_EQUAL test
+	invariant gl_Position;
 
 	uniform mat4 model;
-	uniform mat4 view;
-	uniform mat4 proj;
+	// Per-view constants, streamed once per view each frame (see StreamBuffer.h)
+	layout (std140) uniform ViewUniforms {
+		mat4 view;
+		mat4 proj;
+		vec3 viewPos;
+		float time;
+		// Instanced stereo (numEyes 2, see MultiView.h): the right eye, drawn by the odd instances
+		mat4 rightView;
+		mat4 rightProj;
+		vec3 rightViewPos;
+		int numEyes;
+	};
+	// transpose(inverse(model)), computed on the CPU once per object
+	uniform mat3 normalMatrix;
+
+// Clip position of a world position for the eye this instance is drawn for. With instanced stereo every instance
+// is drawn once per eye, and each eye is squeezed into its half of the target and clipped at the middle.
+vec4 eyeClipPosition(vec4 worldPos) {
+	int eye = gl_InstanceID % numEyes;
+	vec4 position = eye == 0 ? proj * view * worldPos : rightProj * rightView * worldPos;
+	if (numEyes > 1) {
+		position.x = position.x * 0.5 + (eye == 0 ? -0.5 : 0.5) * position.w;
+		gl_ClipDistance[0] = eye == 0 ? -position.x : position.x;
+	}
+	return position;
+}
 
 void main() {
 	TexCoords = aTexCoords;
-	// NOTE: costly to invert matrices in shaders, should pass this as a uniform to optimize 
-	// TODO the above
-	mat3 normalMatrix = mat3(transpose(inverse(model)));
 	Normal = normalMatrix * aNormal; 
 	FragPos = (model * vec4(aPos, 1.0)).xyz;
-	gl_Position = proj * view * model * vec4(aPos, 1.0);
+	EyePos = gl_InstanceID % numEyes == 0 ? viewPos : rightViewPos;
+	gl_Position = eyeClipPosition(model * vec4(aPos, 1.0));
 }